@@ -22,10 +22,33 @@ SOURCES += main.cpp\
     ui/receiverselectordialog.cpp \
     ui/aboutdialog.cpp \
     ui/settingsdialog.cpp \
+    transfer/checksum.cpp \
+    transfer/chunker.cpp \
+    transfer/chunksizecontrol.cpp \
+    transfer/chunkstore.cpp \
+    transfer/compressor.cpp \
+    transfer/delta.cpp \
     transfer/devicebroadcaster.cpp \
+    transfer/dirwalker.cpp \
+    transfer/fileheader.cpp \
+    transfer/filereader.cpp \
+    transfer/filewriter.cpp \
+    transfer/folderreader.cpp \
+    transfer/folderreceiver.cpp \
+    transfer/foldersender.cpp \
+    transfer/folderwriter.cpp \
+    transfer/hashcache.cpp \
+    transfer/manifest.cpp \
+    transfer/packetbuffer.cpp \
+    transfer/queuepolicy.cpp \
+    transfer/readcache.cpp \
     transfer/receiver.cpp \
     transfer/sender.cpp \
+    transfer/session.cpp \
+    transfer/sessionpool.cpp \
     transfer/transfer.cpp \
+    transfer/transferengine.cpp \
+    transfer/transferqueue.cpp \
     transfer/transferserver.cpp \
     model/device.cpp \
     model/devicelistmodel.cpp \
@@ -39,10 +62,33 @@ HEADERS += settings.h \
     ui/receiverselectordialog.h \
     ui/aboutdialog.h \
     ui/settingsdialog.h \
+    transfer/checksum.h \
+    transfer/chunker.h \
+    transfer/chunksizecontrol.h \
+    transfer/chunkstore.h \
+    transfer/compressor.h \
+    transfer/delta.h \
     transfer/devicebroadcaster.h \
+    transfer/dirwalker.h \
+    transfer/fileheader.h \
+    transfer/filereader.h \
+    transfer/filewriter.h \
+    transfer/folderreader.h \
+    transfer/folderreceiver.h \
+    transfer/foldersender.h \
+    transfer/folderwriter.h \
+    transfer/hashcache.h \
+    transfer/manifest.h \
+    transfer/packetbuffer.h \
+    transfer/queuepolicy.h \
+    transfer/readcache.h \
     transfer/receiver.h \
     transfer/sender.h \
+    transfer/session.h \
+    transfer/sessionpool.h \
     transfer/transfer.h \
+    transfer/transferengine.h \
+    transfer/transferqueue.h \
     transfer/transferserver.h \
     model/device.h \
     model/devicelistmodel.h \
@@ -22,7 +22,7 @@
 TransferInfo::TransferInfo(Transfer* owner, QObject *parent) :
     QObject(parent),
     mState(TransferState::Idle), mLastState(TransferState::Idle),
-    mType(TransferType::None), mProgress(0), mDataSize(0),
+    mType(TransferType::None), mProgress(0), mDataSize(0), mChunkSize(0),
     mOwner(owner)
 {
 }
@@ -40,9 +40,11 @@ bool TransferInfo::canPause() const
 
 bool TransferInfo::canCancel() const
 {
-    return mState == TransferState::Waiting ||
+    return mState == TransferState::Queued ||
+            mState == TransferState::Waiting ||
             mState == TransferState::Transfering ||
-            mState == TransferState::Paused;
+            mState == TransferState::Paused ||
+            mState == TransferState::Disconnected;
 }
 
 void TransferInfo::setPeer(Device peer)
@@ -57,7 +59,20 @@ void TransferInfo::setState(TransferState newState)
 
         switch (mState) {
         case TransferState::Idle : {
-            if (newState == TransferState::Waiting) {
+            /*
+             * Cancelled when it could not start
+             */
+            if (newState == TransferState::Queued ||
+                    newState == TransferState::Waiting ||
+                    newState == TransferState::Cancelled) {
+                mState = newState;
+                emit stateChanged(mState);
+            }
+            break;
+        }
+        case TransferState::Queued : {
+            if (newState == TransferState::Waiting ||
+                    newState == TransferState::Cancelled) {
                 mState = newState;
                 emit stateChanged(mState);
             }
@@ -66,7 +81,8 @@ void TransferInfo::setState(TransferState newState)
         case TransferState::Waiting : {
             if (newState == TransferState::Transfering ||
                     newState == TransferState::Cancelled ||
-                    newState == TransferState::Paused) {
+                    newState == TransferState::Paused ||
+                    newState == TransferState::Disconnected) {
                 mState = newState;
                 emit stateChanged(mState);
             }
@@ -85,7 +101,7 @@ void TransferInfo::setState(TransferState newState)
         case TransferState::Paused : {
             if (newState == TransferState::Waiting ||
                     newState == TransferState::Transfering) {
-                mState = mLastState;
+                mState = mLastState.load();
                 emit stateChanged(mState);
             }
             else if (newState == TransferState::Cancelled ||
@@ -95,6 +111,17 @@ void TransferInfo::setState(TransferState newState)
             }
             break;
         }
+        case TransferState::Disconnected : {
+            /*
+             * Interrupted transfer being resumed or given up
+             */
+            if (newState == TransferState::Waiting ||
+                    newState == TransferState::Cancelled) {
+                mState = newState;
+                emit stateChanged(mState);
+            }
+            break;
+        }
         default:
             break;
         }
@@ -121,7 +148,19 @@ void TransferInfo::setDataSize(qint64 size)
     mDataSize = size;
 }
 
+void TransferInfo::setChunkSize(qint32 size)
+{
+    mChunkSize = size;
+}
+
 void TransferInfo::setFilePath(const QString &fileName)
 {
+    QMutexLocker locker(&mMutex);
     mFilePath = fileName;
 }
+
+QString TransferInfo::getFilePath() const
+{
+    QMutexLocker locker(&mMutex);
+    return mFilePath;
+}
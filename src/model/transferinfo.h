@@ -20,12 +20,16 @@
 #ifndef TRANSFERINFO_H
 #define TRANSFERINFO_H
 
+#include <atomic>
+
+#include <QMutex>
 #include <QObject>
 
 #include "device.h"
 
 enum class TransferState {
     Idle,
+    Queued,
     Waiting,
     Disconnected,
     Paused,
@@ -40,8 +44,15 @@ enum class TransferType {
     Upload
 };
 
+Q_DECLARE_METATYPE(TransferState)
+
 class Transfer;
 
+/*
+ * TransferInfo is written by its Transfer on a worker thread and read
+ * by the GUI. Signals reach the GUI queued, the getters are safe to
+ * call from any thread.
+ */
 class TransferInfo : public QObject
 {
     Q_OBJECT
@@ -55,7 +66,8 @@ public:
     inline TransferState getLastState() const { return mLastState; }
     inline TransferType getTransferType() const { return mType; }
     inline qint64 getDataSize() const { return mDataSize; }
-    inline QString getFilePath() const { return mFilePath; }
+    inline qint32 getChunkSize() const { return mChunkSize; }
+    QString getFilePath() const;
     inline Transfer* getOwner() const { return mOwner; }
 
     bool canResume() const;
@@ -67,6 +79,7 @@ public:
     void setTransferType(TransferType type);
     void setProgress(int progress);
     void setDataSize(qint64 size);
+    void setChunkSize(qint32 size);
     void setFilePath(const QString& fileName);
 
 Q_SIGNALS:
@@ -78,12 +91,18 @@ Q_SIGNALS:
 
 private:
     Device mPeer;
-    TransferState mState;
-    TransferState mLastState;
+    std::atomic<TransferState> mState;
+    std::atomic<TransferState> mLastState;
     TransferType mType;
-    int mProgress;
-    qint64 mDataSize;
+    std::atomic<int> mProgress;
+    std::atomic<qint64> mDataSize;
+
+    /*
+     * Chunk size the Sender currently uses, for diagnostics
+     */
+    std::atomic<qint32> mChunkSize;
     QString mFilePath;
+    mutable QMutex mMutex;
 
     Transfer* mOwner;
 };
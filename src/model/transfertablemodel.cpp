@@ -65,6 +65,9 @@ QVariant TransferTableModel::data(const QModelIndex &index, int role) const
             else if (role == Qt::ForegroundRole && col == Column::State) {
                 return getStateColor(info->getState());
             }
+            else if (role == Qt::ToolTipRole && col == Column::State && info->getChunkSize() > 0) {
+                return tr("Chunk size: %1").arg(Util::sizeToString(info->getChunkSize()));
+            }
         }
     }
 
@@ -100,14 +103,14 @@ void TransferTableModel::insertTransfer(Transfer *t)
     emit dataChanged(index(1, 0), index(mTransfers.size()-1, (int) Column::Count));
 
     TransferInfo* info = t->getTransferInfo();
-    connect(info, &TransferInfo::fileOpened, [=]() {
+    connect(info, &TransferInfo::fileOpened, this, [=]() {
         int idx = mTransfers.indexOf(info->getOwner());
         QModelIndex fNameIdx = index(idx, (int) Column::FileName);
         QModelIndex fSizeIdx = index(idx, (int) Column::FileSize);
         emit dataChanged(fNameIdx, fSizeIdx);
     });
 
-    connect(info, &TransferInfo::stateChanged, [=](TransferState state) {
+    connect(info, &TransferInfo::stateChanged, this, [=](TransferState state) {
         Q_UNUSED(state);
 
         int idx = mTransfers.indexOf(info->getOwner());
@@ -165,6 +168,7 @@ QString TransferTableModel::getStateString(TransferState state) const
 {
     switch (state) {
     case TransferState::Idle : return tr("Idle");
+    case TransferState::Queued : return tr("Queued");
     case TransferState::Waiting : return tr("Waiting");
     case TransferState::Disconnected : return tr("Disconnected");
     case TransferState::Paused : return tr("Paused");
@@ -180,6 +184,7 @@ QColor TransferTableModel::getStateColor(TransferState state) const
 {
     switch (state) {
     case TransferState::Idle : return QColor("black");
+    case TransferState::Queued : return QColor("gray");
     case TransferState::Waiting : return QColor("orange");
     case TransferState::Disconnected : return QColor("red");
     case TransferState::Paused : return QColor("orange");
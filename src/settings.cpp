@@ -22,6 +22,8 @@
 #include <QSettings>
 #include <QDir>
 #include <QStandardPaths>
+#include <QThread>
+#include <QMutexLocker>
 
 #include "settings.h"
 
@@ -30,6 +32,17 @@
 #define DefaultBroadcastInterval    5000    // 5 secs
 #define DefaultFileBufferSize       98304   // 96 KB
 #define MaxFileBufferSize           1024*1024 // 1 MB
+#define DefaultStripeCount          4
+#define MaxStripeCount              16
+#define DefaultReadAheadSize        8*1024*1024 // 8 MB
+#define MaxReadAheadSize            256*1024*1024 // 256 MB
+#define DefaultWorkerThreadCount    qMax(1, QThread::idealThreadCount())
+#define MaxWorkerThreadCount        64
+#define DefaultMaxActiveTransfers   8
+#define MaxMaxActiveTransfers       100
+#define DefaultMaxPeerTransfers     4
+#define DefaultQueuePolicy          0   // QueuePolicy::Type::Fifo
+#define QueuePolicyCount            3
 
 Settings* Settings::obj = new Settings;
 Settings::Settings()
@@ -52,43 +65,104 @@ Settings::Settings()
 
 void Settings::setDeviceName(const QString &name)
 {
+    QMutexLocker locker(&mMutex);
     mThisDevice.setName(name);
 }
 
 void Settings::setBroadcastPort(quint16 port)
 {
+    QMutexLocker locker(&mMutex);
     if (port > 0)
         mBCPort = port;
 }
 
 void Settings::setBroadcastInterval(quint16 interval)
 {
+    QMutexLocker locker(&mMutex);
     mBCInterval = interval;
 }
 
 void Settings::setTransferPort(quint16 port)
 {
+    QMutexLocker locker(&mMutex);
     if (port > 0)
         mTransferPort = port;
 }
 
 void Settings::setFileBufferSize(qint32 size)
 {
+    QMutexLocker locker(&mMutex);
     if (size > 0 && size < MaxFileBufferSize)
         mFileBuffSize = size;
 }
 
+void Settings::setStripeCount(int count)
+{
+    QMutexLocker locker(&mMutex);
+    if (count > 0 && count <= MaxStripeCount)
+        mStripeCount = count;
+}
+
+void Settings::setReadAheadSize(qint32 size)
+{
+    QMutexLocker locker(&mMutex);
+    if (size > 0 && size <= MaxReadAheadSize)
+        mReadAheadSize = size;
+}
+
+void Settings::setWorkerThreadCount(int count)
+{
+    QMutexLocker locker(&mMutex);
+    if (count > 0 && count <= MaxWorkerThreadCount)
+        mWorkerThreadCount = count;
+}
+
+void Settings::setMaxActiveTransfers(int count)
+{
+    QMutexLocker locker(&mMutex);
+    if (count > 0 && count <= MaxMaxActiveTransfers)
+        mMaxActiveTransfers = count;
+}
+
+void Settings::setMaxPeerTransfers(int count)
+{
+    QMutexLocker locker(&mMutex);
+    if (count > 0 && count <= MaxMaxActiveTransfers)
+        mMaxPeerTransfers = count;
+}
+
+void Settings::setQueuePolicy(int policy)
+{
+    QMutexLocker locker(&mMutex);
+    if (policy >= 0 && policy < QueuePolicyCount)
+        mQueuePolicy = policy;
+}
+
 void Settings::setDownloadDir(const QString& dir)
 {
+    QMutexLocker locker(&mMutex);
     if (!dir.isEmpty() && QDir(dir).exists())
         mDownloadDir = dir;
 }
 
 void Settings::setReplaceExistingFile(bool replace)
 {
+    QMutexLocker locker(&mMutex);
     mReplaceExistingFile = replace;
 }
 
+void Settings::setDeltaTransfer(bool delta)
+{
+    QMutexLocker locker(&mMutex);
+    mDeltaTransfer = delta;
+}
+
+void Settings::setCompression(bool compression)
+{
+    QMutexLocker locker(&mMutex);
+    mCompression = compression;
+}
+
 void Settings::loadSettings()
 {
     QSettings settings(SETTINGS_FILE);
@@ -96,6 +170,12 @@ void Settings::loadSettings()
     mBCPort = settings.value("BroadcastPort", DefaultBroadcastPort).value<quint16>();
     mTransferPort = settings.value("TransferPort", DefaultTransferPort).value<quint16>();
     mFileBuffSize = settings.value("FileBufferSize", DefaultFileBufferSize).value<quint32>();
+    mStripeCount = settings.value("StripeCount", DefaultStripeCount).toInt();
+    mReadAheadSize = settings.value("ReadAheadSize", DefaultReadAheadSize).value<qint32>();
+    mWorkerThreadCount = settings.value("WorkerThreadCount", DefaultWorkerThreadCount).toInt();
+    mMaxActiveTransfers = settings.value("MaxActiveTransfers", DefaultMaxActiveTransfers).toInt();
+    mMaxPeerTransfers = settings.value("MaxPeerTransfers", DefaultMaxPeerTransfers).toInt();
+    mQueuePolicy = settings.value("QueuePolicy", DefaultQueuePolicy).toInt();
     mDownloadDir = settings.value("DownloadDir", getDefaultDownloadPath()).toString();
 
     if (!QDir(mDownloadDir).exists()) {
@@ -105,6 +185,8 @@ void Settings::loadSettings()
 
     mBCInterval = settings.value("BroadcastInterval", DefaultBroadcastInterval).value<quint16>();
     mReplaceExistingFile = settings.value("ReplaceExistingFile", false).toBool();
+    mDeltaTransfer = settings.value("DeltaTransfer", true).toBool();
+    mCompression = settings.value("Compression", true).toBool();
 }
 
 QString Settings::getDefaultDownloadPath()
@@ -119,73 +201,149 @@ QString Settings::getDefaultDownloadPath()
 
 void Settings::saveSettings()
 {
+    QMutexLocker locker(&mMutex);
     QSettings settings(SETTINGS_FILE);
     settings.setValue("DeviceName", mThisDevice.getName());
     settings.setValue("BroadcastPort", mBCPort);
     settings.setValue("TransferPort", mTransferPort);
     settings.setValue("FileBufferSize", mFileBuffSize);
+    settings.setValue("StripeCount", mStripeCount);
+    settings.setValue("ReadAheadSize", mReadAheadSize);
+    settings.setValue("WorkerThreadCount", mWorkerThreadCount);
+    settings.setValue("MaxActiveTransfers", mMaxActiveTransfers);
+    settings.setValue("MaxPeerTransfers", mMaxPeerTransfers);
+    settings.setValue("QueuePolicy", mQueuePolicy);
     settings.setValue("DownloadDir", mDownloadDir);
     settings.setValue("BroadcastInterval", mBCInterval);
     settings.setValue("ReplaceExistingFile", mReplaceExistingFile);
+    settings.setValue("DeltaTransfer", mDeltaTransfer);
+    settings.setValue("Compression", mCompression);
 }
 
 void Settings::reset()
 {
+    QMutexLocker locker(&mMutex);
     mThisDevice.setName(QHostInfo::localHostName());
     mBCPort = DefaultBroadcastPort;
     mTransferPort = DefaultTransferPort;
     mBCInterval = DefaultBroadcastInterval;
     mFileBuffSize = DefaultFileBufferSize;
+    mStripeCount = DefaultStripeCount;
+    mReadAheadSize = DefaultReadAheadSize;
+    mWorkerThreadCount = DefaultWorkerThreadCount;
+    mMaxActiveTransfers = DefaultMaxActiveTransfers;
+    mMaxPeerTransfers = DefaultMaxPeerTransfers;
+    mQueuePolicy = DefaultQueuePolicy;
+    mDeltaTransfer = true;
+    mCompression = true;
     mDownloadDir = getDefaultDownloadPath();
 }
 
 quint16 Settings::getBroadcastPort() const
 {
+    QMutexLocker locker(&mMutex);
     return mBCPort; 
 }
 
 quint16 Settings::getTransferPort() const
 {
+    QMutexLocker locker(&mMutex);
     return mTransferPort;
 }
 
 quint16 Settings::getBroadcastInterval() const
 {
+    QMutexLocker locker(&mMutex);
     return mBCInterval;
 }
 
 qint32 Settings::getFileBufferSize() const 
 { 
+    QMutexLocker locker(&mMutex);
     return mFileBuffSize; 
 }
 
+int Settings::getStripeCount() const
+{
+    QMutexLocker locker(&mMutex);
+    return mStripeCount;
+}
+
+qint32 Settings::getReadAheadSize() const
+{
+    QMutexLocker locker(&mMutex);
+    return mReadAheadSize;
+}
+
+int Settings::getWorkerThreadCount() const
+{
+    QMutexLocker locker(&mMutex);
+    return mWorkerThreadCount;
+}
+
+int Settings::getMaxActiveTransfers() const
+{
+    QMutexLocker locker(&mMutex);
+    return mMaxActiveTransfers;
+}
+
+int Settings::getMaxPeerTransfers() const
+{
+    QMutexLocker locker(&mMutex);
+    return mMaxPeerTransfers;
+}
+
+int Settings::getQueuePolicy() const
+{
+    QMutexLocker locker(&mMutex);
+    return mQueuePolicy;
+}
+
 QString Settings::getDownloadDir() const
 {
+    QMutexLocker locker(&mMutex);
     return mDownloadDir;
 }
 
 Device Settings::getMyDevice() const
 {
+    QMutexLocker locker(&mMutex);
     return mThisDevice;
 }
 
 QString Settings::getDeviceId() const
 {
+    QMutexLocker locker(&mMutex);
     return mThisDevice.getId();
 }
 
 QString Settings::getDeviceName() const
 {
+    QMutexLocker locker(&mMutex);
     return mThisDevice.getName();
 }
 
 QHostAddress Settings::getDeviceAddress() const
 {
+    QMutexLocker locker(&mMutex);
     return mThisDevice.getAddress();
 }
 
 bool Settings::getReplaceExistingFile() const
 {
+    QMutexLocker locker(&mMutex);
     return mReplaceExistingFile;
 }
 
+bool Settings::getDeltaTransfer() const
+{
+    QMutexLocker locker(&mMutex);
+    return mDeltaTransfer;
+}
+
+bool Settings::getCompression() const
+{
+    QMutexLocker locker(&mMutex);
+    return mCompression;
+}
+
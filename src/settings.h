@@ -20,6 +20,7 @@
 #define SETTINGS_H
 
 #include <QHostAddress>
+#include <QMutex>
 #include <QString>
 
 #include "model/device.h"
@@ -51,6 +52,12 @@ public:
     quint16 getTransferPort() const;
     quint16 getBroadcastInterval() const;
     qint32 getFileBufferSize() const;
+    int getStripeCount() const;
+    qint32 getReadAheadSize() const;
+    int getWorkerThreadCount() const;
+    int getMaxActiveTransfers() const;
+    int getMaxPeerTransfers() const;
+    int getQueuePolicy() const;
     QString getDownloadDir() const;
 
     Device getMyDevice() const;
@@ -58,14 +65,24 @@ public:
     QString getDeviceName() const;
     QHostAddress getDeviceAddress() const;
     bool getReplaceExistingFile() const;
+    bool getDeltaTransfer() const;
+    bool getCompression() const;
     
     void setDeviceName(const QString& name);
     void setBroadcastPort(quint16 port);
     void setTransferPort(quint16 port);
     void setBroadcastInterval(quint16 interval);
     void setFileBufferSize(qint32 size);
+    void setStripeCount(int count);
+    void setReadAheadSize(qint32 size);
+    void setWorkerThreadCount(int count);
+    void setMaxActiveTransfers(int count);
+    void setMaxPeerTransfers(int count);
+    void setQueuePolicy(int policy);
     void setDownloadDir(const QString& dir);
     void setReplaceExistingFile(bool replace);
+    void setDeltaTransfer(bool delta);
+    void setCompression(bool compression);
 
     void saveSettings();
     void reset();
@@ -76,13 +93,27 @@ private:
 
     QString getDefaultDownloadPath();
 
+    /*
+     * The settings dialog writes on the GUI thread while
+     * transfers read on the worker threads
+     */
+    mutable QMutex mMutex;
+
     Device mThisDevice;
     quint16 mBCPort{0};
     quint16 mTransferPort{0};
     quint16 mBCInterval{0};
     qint32 mFileBuffSize{0};
+    int mStripeCount{0};
+    qint32 mReadAheadSize{0};
+    int mWorkerThreadCount{0};
+    int mMaxActiveTransfers{0};
+    int mMaxPeerTransfers{0};
+    int mQueuePolicy{0};
     QString mDownloadDir;
     bool mReplaceExistingFile{false};
+    bool mDeltaTransfer{true};
+    bool mCompression{true};
 
     static Settings* obj;
 };
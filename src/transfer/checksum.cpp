@@ -0,0 +1,378 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QFile>
+#include <QThreadPool>
+#include <QtEndian>
+
+#include "checksum.h"
+#include "hashcache.h"
+#include "transferengine.h"
+
+#define BlockSize   1024*1024
+
+/*
+ * XXH64 constants
+ */
+static const quint64 Prime1 = 11400714785074694791ULL;
+static const quint64 Prime2 = 14029467366897019727ULL;
+static const quint64 Prime3 = 1609587929392839161ULL;
+static const quint64 Prime4 = 9650029242287828579ULL;
+static const quint64 Prime5 = 2870177450012600261ULL;
+
+static inline quint64 rotl(quint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline quint64 round64(quint64 acc, quint64 input)
+{
+    acc += input * Prime2;
+    acc = rotl(acc, 31);
+    return acc * Prime1;
+}
+
+static inline quint64 mergeRound(quint64 acc, quint64 val)
+{
+    acc ^= round64(0, val);
+    return acc * Prime1 + Prime4;
+}
+
+FileChecksum::FileChecksum(const QString& filePath, qint64 fileSize, QObject* parent)
+    : QObject(parent), mFilePath(filePath), mFileSize(fileSize),
+      mBlocksPending(0), mFinishing(false), mFailed(false), mInFlight(0)
+{
+    int blocks = static_cast<int>((fileSize + BlockSize - 1) / BlockSize);
+    mBlockHashes.resize(blocks);
+    mScheduled = QBitArray(blocks);
+    mHashed = QBitArray(blocks);
+}
+
+FileChecksum::~FileChecksum()
+{
+    QMutexLocker locker(&mMutex);
+    while (mInFlight > 0)
+        mIdle.wait(&mMutex);
+}
+
+quint64 FileChecksum::hash(const char* data, qint64 size, quint64 seed)
+{
+    const uchar* p = reinterpret_cast<const uchar*>(data);
+    const uchar* end = p + size;
+    quint64 h;
+
+    if (size >= 32) {
+        quint64 v1 = seed + Prime1 + Prime2;
+        quint64 v2 = seed + Prime2;
+        quint64 v3 = seed;
+        quint64 v4 = seed - Prime1;
+
+        const uchar* limit = end - 32;
+        do {
+            v1 = round64(v1, qFromLittleEndian<quint64>(p));
+            v2 = round64(v2, qFromLittleEndian<quint64>(p + 8));
+            v3 = round64(v3, qFromLittleEndian<quint64>(p + 16));
+            v4 = round64(v4, qFromLittleEndian<quint64>(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    }
+    else {
+        h = seed + Prime5;
+    }
+
+    h += static_cast<quint64>(size);
+
+    while (end - p >= 8) {
+        h ^= round64(0, qFromLittleEndian<quint64>(p));
+        h = rotl(h, 27) * Prime1 + Prime4;
+        p += 8;
+    }
+
+    if (end - p >= 4) {
+        h ^= static_cast<quint64>(qFromLittleEndian<quint32>(p)) * Prime1;
+        h = rotl(h, 23) * Prime2 + Prime3;
+        p += 4;
+    }
+
+    while (p < end) {
+        h ^= (*p++) * Prime5;
+        h = rotl(h, 11) * Prime1;
+    }
+
+    h ^= h >> 33;
+    h *= Prime2;
+    h ^= h >> 29;
+    h *= Prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+void FileChecksum::addData(qint64 offset, const QByteArray& chunk, int headroom)
+{
+    qint64 size = chunk.size() - headroom;
+
+    /*
+     * Chunk is exactly one block, hash it from memory
+     */
+    if (offset % BlockSize == 0 && (size == BlockSize || (size > 0 && offset + size == mFileSize))) {
+        int block = static_cast<int>(offset / BlockSize);
+        if (!mScheduled.testBit(block))
+            hashBlock(block, chunk, headroom);
+        cover(offset, size);
+        return;
+    }
+
+    addRange(offset, size);
+}
+
+void FileChecksum::addRange(qint64 offset, qint64 size)
+{
+    if (offset < 0 || size <= 0 || offset + size > mFileSize)
+        return;
+
+    cover(offset, size);
+
+    /*
+     * Blocks completed by this range are read back while
+     * they are still in the page cache.
+     */
+    int first = static_cast<int>(offset / BlockSize);
+    int last = static_cast<int>((offset + size - 1) / BlockSize);
+    for (int block = first; block <= last; block++) {
+        if (!mScheduled.testBit(block) && isCovered(block))
+            hashBlock(block);
+    }
+}
+
+void FileChecksum::cover(qint64 offset, qint64 size)
+{
+    qint64 start = offset;
+    qint64 end = offset + size;
+
+    /*
+     * Merge with the ranges it touches
+     */
+    auto it = mCovered.upperBound(start);
+    if (it != mCovered.begin()) {
+        auto prev = it;
+        --prev;
+        if (prev.value() >= start) {
+            start = prev.key();
+            end = qMax(end, prev.value());
+            it = mCovered.erase(prev);
+        }
+    }
+
+    while (it != mCovered.end() && it.key() <= end) {
+        end = qMax(end, it.value());
+        it = mCovered.erase(it);
+    }
+
+    mCovered.insert(start, end);
+}
+
+void FileChecksum::uncover(qint64 offset, qint64 size)
+{
+    qint64 start = offset;
+    qint64 end = offset + size;
+
+    /*
+     * Cut the range out of the ones it overlaps
+     */
+    auto it = mCovered.upperBound(start);
+    if (it != mCovered.begin()) {
+        auto prev = it;
+        --prev;
+        qint64 prevEnd = prev.value();
+        if (prevEnd > start) {
+            if (prev.key() < start)
+                prev.value() = start;
+            else
+                mCovered.erase(prev);
+
+            if (prevEnd > end) {
+                mCovered.insert(end, prevEnd);
+                return;
+            }
+        }
+    }
+
+    while (it != mCovered.end() && it.key() < end) {
+        qint64 itEnd = it.value();
+        it = mCovered.erase(it);
+        if (itEnd > end) {
+            mCovered.insert(end, itEnd);
+            break;
+        }
+    }
+}
+
+void FileChecksum::blockBounds(int block, qint64& offset, qint64& size) const
+{
+    offset = static_cast<qint64>(block) * BlockSize;
+    size = qMin<qint64>(BlockSize, mFileSize - offset);
+}
+
+bool FileChecksum::blockHash(int block, quint64& blockHash) const
+{
+    if (block < 0 || block >= mHashed.size() || !mHashed.testBit(block))
+        return false;
+
+    blockHash = mBlockHashes.at(block);
+    return true;
+}
+
+void FileChecksum::invalidate(int block)
+{
+    if (block < 0 || block >= mScheduled.size())
+        return;
+
+    qint64 offset, size;
+    blockBounds(block, offset, size);
+    uncover(offset, size);
+    mScheduled.clearBit(block);
+    mHashed.clearBit(block);
+}
+
+bool FileChecksum::loadFromCache()
+{
+    QVector<quint64> blockHashes;
+    if (mFileSize <= 0 || !HashCache::instance()->lookup(mFilePath, blockHashes) ||
+            blockHashes.size() != mBlockHashes.size())
+        return false;
+
+    mBlockHashes = blockHashes;
+    mScheduled.fill(true);
+    mHashed.fill(true);
+    cover(0, mFileSize);
+    return true;
+}
+
+void FileChecksum::saveToCache()
+{
+    if (!mFailed && mHashed.count(true) == mHashed.size())
+        HashCache::instance()->insert(mFilePath, mBlockHashes);
+}
+
+bool FileChecksum::isCovered(int block) const
+{
+    qint64 start = static_cast<qint64>(block) * BlockSize;
+    qint64 end = qMin(start + BlockSize, mFileSize);
+
+    auto it = mCovered.upperBound(start);
+    if (it == mCovered.begin())
+        return false;
+
+    --it;
+    return it.value() >= end;
+}
+
+void FileChecksum::finish()
+{
+    mFinishing = true;
+    for (int block = 0; block < mScheduled.size(); block++) {
+        if (!mScheduled.testBit(block))
+            hashBlock(block);
+    }
+
+    if (mBlocksPending == 0)
+        QMetaObject::invokeMethod(this, [this]() { emitDigest(); }, Qt::QueuedConnection);
+}
+
+void FileChecksum::hashBlock(int block, const QByteArray& chunk, int headroom)
+{
+    mScheduled.setBit(block);
+    mBlocksPending++;
+
+    {
+        QMutexLocker locker(&mMutex);
+        mInFlight++;
+    }
+
+    QString filePath = mFilePath;
+    qint64 offset = static_cast<qint64>(block) * BlockSize;
+    qint64 size = qMin<qint64>(BlockSize, mFileSize - offset);
+
+    TransferEngine::instance()->computePool()->start([=]() {
+        bool ok = true;
+        quint64 blockHash = 0;
+
+        if (!chunk.isEmpty()) {
+            blockHash = hash(chunk.constData() + headroom, size, block);
+        }
+        else {
+            QFile file(filePath);
+            QByteArray data;
+            ok = file.open(QIODevice::ReadOnly) && file.seek(offset);
+            if (ok) {
+                data = file.read(size);
+                ok = data.size() == size;
+            }
+
+            if (ok)
+                blockHash = hash(data.constData(), size, block);
+        }
+
+        QMetaObject::invokeMethod(this, [this, block, blockHash, ok]() {
+            onBlockHashed(block, blockHash, ok);
+        }, Qt::QueuedConnection);
+
+        QMutexLocker locker(&mMutex);
+        if (--mInFlight == 0)
+            mIdle.wakeAll();
+    });
+}
+
+void FileChecksum::onBlockHashed(int block, quint64 blockHash, bool ok)
+{
+    mBlockHashes[block] = blockHash;
+    mFailed = mFailed || !ok;
+    mBlocksPending--;
+
+    if (ok) {
+        mHashed.setBit(block);
+        emit blockHashed(block, blockHash);
+    }
+
+    if (mFinishing && mBlocksPending == 0)
+        emitDigest();
+}
+
+void FileChecksum::emitDigest()
+{
+    if (!mFinishing)
+        return;
+
+    mFinishing = false;
+    emit finished(!mFailed, digest());
+}
+
+quint64 FileChecksum::digest() const
+{
+    QByteArray hashes(mBlockHashes.size() * static_cast<int>(sizeof(quint64)), Qt::Uninitialized);
+    for (int i = 0; i < mBlockHashes.size(); i++)
+        qToLittleEndian<quint64>(mBlockHashes.at(i), hashes.data() + i * sizeof(quint64));
+
+    return hash(hashes.constData(), hashes.size(), static_cast<quint64>(mFileSize));
+}
@@ -0,0 +1,125 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <QBitArray>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+#include <QWaitCondition>
+
+/*
+ * FileChecksum is the end-to-end checksum of a file, built while the
+ * file goes through a Sender or Receiver. The file is cut into blocks
+ * hashed with XXH64 on the compute pool as soon as they are complete,
+ * in memory if the caller has the block or else read back from the
+ * page cache. The digest is the XXH64 of every block hash in order,
+ * so it doesn't depend on the order the parts of the file came in
+ * (stripes, resume).
+ */
+class FileChecksum : public QObject
+{
+    Q_OBJECT
+
+public:
+    FileChecksum(const QString& filePath, qint64 fileSize, QObject* parent = nullptr);
+    ~FileChecksum() override;
+
+    static quint64 hash(const char* data, qint64 size, quint64 seed = 0);
+
+    /*
+     * Bytes [offset, offset+size) of the file are final (sent or
+     * written). addData() for a chunk in memory, it starts with
+     * 'headroom' bytes that are not part of the file.
+     */
+    void addData(qint64 offset, const QByteArray& chunk, int headroom = 0);
+    void addRange(qint64 offset, qint64 size);
+
+    /*
+     * Blocks and their hashes, blockHashed() is emitted for
+     * every block as soon as it is hashed.
+     */
+    inline int blockCount() const { return mBlockHashes.size(); }
+    void blockBounds(int block, qint64& offset, qint64& size) const;
+    bool blockHash(int block, quint64& blockHash) const;
+
+    /*
+     * The block is going to be written again, it is hashed
+     * again once all of it has been added. Not to be called
+     * while the block is being hashed.
+     */
+    void invalidate(int block);
+
+    /*
+     * Block hashes of an unchanged file from the HashCache, false
+     * if there are none. saveToCache() stores them once every
+     * block is hashed.
+     */
+    bool loadFromCache();
+    void saveToCache();
+
+    /*
+     * Only valid once every block is hashed
+     */
+    quint64 digest() const;
+
+    /*
+     * Hashes the blocks not seen yet from the file,
+     * then finished() follows.
+     */
+    void finish();
+
+Q_SIGNALS:
+    void blockHashed(int block, quint64 blockHash);
+    void finished(bool ok, quint64 digest);
+
+private:
+    void cover(qint64 offset, qint64 size);
+    void uncover(qint64 offset, qint64 size);
+    bool isCovered(int block) const;
+    void hashBlock(int block, const QByteArray& chunk = QByteArray(), int headroom = 0);
+    void onBlockHashed(int block, quint64 blockHash, bool ok);
+    void emitDigest();
+
+    QString mFilePath;
+    qint64 mFileSize;
+
+    /*
+     * Final parts of the file (start -> end)
+     */
+    QMap<qint64, qint64> mCovered;
+
+    QVector<quint64> mBlockHashes;
+    QBitArray mScheduled;
+    QBitArray mHashed;
+    int mBlocksPending;
+    bool mFinishing;
+    bool mFailed;
+
+    /*
+     * Blocks on the pool, the destructor waits for them
+     */
+    int mInFlight;
+    QMutex mMutex;
+    QWaitCondition mIdle;
+};
+
+#endif // CHECKSUM_H
@@ -0,0 +1,199 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QFile>
+#include <QThreadPool>
+#include <QtEndian>
+
+#include "chunker.h"
+#include "checksum.h"
+#include "transferengine.h"
+
+/*
+ * Chunks are 16 to 256 KB, 64 KB on average. Normalized chunking
+ * makes cuts less likely before the average size (MaskSmall) and
+ * more likely after it (MaskLarge).
+ */
+#define MinChunkSize    16*1024
+#define AvgChunkSize    64*1024
+#define MaxChunkSize    256*1024
+#define ChunkReadSize   4*1024*1024
+
+#define ChunkEntrySize  12
+
+static const quint64 MaskSmall = 0xffffc00000000000ULL; // 18 bits
+static const quint64 MaskLarge = 0xfffc000000000000ULL; // 14 bits
+
+/*
+ * Gear table, the same on every peer
+ */
+static const quint64* gearTable()
+{
+    static quint64 table[256];
+    static bool ready = [] {
+        quint64 x = 0x4c414e5368617265ULL;
+        for (int i = 0; i < 256; i++) {
+            quint64 z = (x += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            table[i] = z ^ (z >> 31);
+        }
+        return true;
+    }();
+
+    Q_UNUSED(ready);
+    return table;
+}
+
+Chunker::Chunker(QObject* parent) : QObject(parent), mInFlight(0)
+{
+}
+
+Chunker::~Chunker()
+{
+    QMutexLocker locker(&mMutex);
+    while (mInFlight > 0)
+        mIdle.wait(&mMutex);
+}
+
+int Chunker::cutPoint(const uchar* data, int size)
+{
+    if (size <= MinChunkSize)
+        return size;
+
+    const quint64* gear = gearTable();
+    int normal = qMin(size, AvgChunkSize);
+    int max = qMin(size, MaxChunkSize);
+    quint64 fp = 0;
+    int i = MinChunkSize;
+
+    for (; i < normal; i++) {
+        fp = (fp << 1) + gear[data[i]];
+        if (!(fp & MaskSmall))
+            return i + 1;
+    }
+
+    for (; i < max; i++) {
+        fp = (fp << 1) + gear[data[i]];
+        if (!(fp & MaskLarge))
+            return i + 1;
+    }
+
+    return max;
+}
+
+QVector<Chunker::Chunk> Chunker::chunkFile(const QString& filePath, bool& ok,
+                                           const QAtomicInt* cancelled)
+{
+    QVector<Chunk> chunks;
+    QFile file(filePath);
+    ok = file.open(QIODevice::ReadOnly);
+    if (!ok)
+        return chunks;
+
+    qint64 fileSize = file.size();
+    qint64 offset = 0;
+    QByteArray buff;
+    int pos = 0;
+    bool eof = false;
+
+    forever {
+        /*
+         * Always a whole chunk in the buffer, unless
+         * the file ends sooner.
+         */
+        if (!eof && buff.size() - pos < MaxChunkSize) {
+            if (cancelled && cancelled->loadAcquire()) {
+                ok = false;
+                return chunks;
+            }
+
+            buff.remove(0, pos);
+            pos = 0;
+
+            QByteArray more = file.read(ChunkReadSize);
+            if (more.isEmpty())
+                eof = true;
+            else
+                buff.append(more);
+            continue;
+        }
+
+        if (pos == buff.size())
+            break;
+
+        const uchar* data = reinterpret_cast<const uchar*>(buff.constData()) + pos;
+        int size = cutPoint(data, buff.size() - pos);
+        chunks.push_back({ offset, size, FileChecksum::hash(buff.constData() + pos, size) });
+        offset += size;
+        pos += size;
+    }
+
+    ok = offset == fileSize;
+    return chunks;
+}
+
+QByteArray Chunker::encode(const QVector<Chunk>& chunks)
+{
+    QByteArray data(chunks.size() * ChunkEntrySize, Qt::Uninitialized);
+    char* p = data.data();
+    for (const Chunk& chunk : chunks) {
+        qToLittleEndian<qint32>(chunk.size, p);
+        qToLittleEndian<quint64>(chunk.hash, p + sizeof(qint32));
+        p += ChunkEntrySize;
+    }
+
+    return data;
+}
+
+QVector<Chunker::Chunk> Chunker::decode(const QByteArray& data)
+{
+    QVector<Chunk> chunks;
+    qint64 offset = 0;
+    for (int i = 0; i + ChunkEntrySize <= data.size(); i += ChunkEntrySize) {
+        qint32 size = qFromLittleEndian<qint32>(data.constData() + i);
+        if (size <= 0 || size > MaxChunkSize)
+            return QVector<Chunk>();
+
+        chunks.push_back({ offset, size, qFromLittleEndian<quint64>(data.constData() + i + sizeof(qint32)) });
+        offset += size;
+    }
+
+    return chunks;
+}
+
+void Chunker::start(const QString& filePath)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        mInFlight++;
+    }
+
+    TransferEngine::instance()->computePool()->start([=]() {
+        bool ok;
+        QVector<Chunk> chunks = chunkFile(filePath, ok);
+
+        QMetaObject::invokeMethod(this, [this, ok, chunks]() {
+            emit chunked(ok, chunks);
+        }, Qt::QueuedConnection);
+
+        QMutexLocker locker(&mMutex);
+        if (--mInFlight == 0)
+            mIdle.wakeAll();
+    });
+}
@@ -0,0 +1,78 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHUNKER_H
+#define CHUNKER_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+#include <QWaitCondition>
+
+/*
+ * Chunker cuts a file into content-defined chunks (FastCDC): chunk
+ * boundaries depend on the bytes around them rather than on their
+ * offset, so content shared by two files is cut the same way even
+ * at different offsets. Every chunk is identified by its XXH64.
+ */
+class Chunker : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Chunk
+    {
+        qint64 offset;
+        qint32 size;
+        quint64 hash;
+    };
+
+    explicit Chunker(QObject* parent = nullptr);
+    ~Chunker() override;
+
+    /*
+     * Gives up (not ok) once 'cancelled' is set
+     */
+    static QVector<Chunk> chunkFile(const QString& filePath, bool& ok,
+                                    const QAtomicInt* cancelled = nullptr);
+
+    /*
+     * Chunk list as sent to the receiver, the size and hash of
+     * every chunk in file order (little endian).
+     */
+    static QByteArray encode(const QVector<Chunk>& chunks);
+    static QVector<Chunk> decode(const QByteArray& data);
+
+    /*
+     * chunkFile() on the compute pool, chunked() follows
+     */
+    void start(const QString& filePath);
+
+Q_SIGNALS:
+    void chunked(bool ok, QVector<Chunker::Chunk> chunks);
+
+private:
+    static int cutPoint(const uchar* data, int size);
+
+    int mInFlight;
+    QMutex mMutex;
+    QWaitCondition mIdle;
+};
+
+#endif // CHUNKER_H
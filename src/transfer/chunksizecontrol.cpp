@@ -0,0 +1,87 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "chunksizecontrol.h"
+
+#define MinChunkSize        4*1024
+#define MaxChunkSize        8*1024*1024
+#define ChunkAlignment      4*1024
+
+#define RateWindow          500     // ms
+#define TargetChunkTime     10      // ms
+
+/*
+ * Round trip time beyond QueueingFactor times the lowest one
+ * (plus RttMargin usecs) means packets are queueing.
+ */
+#define QueueingFactor      2
+#define RttMargin           5000
+
+ChunkSizeControl::ChunkSizeControl()
+{
+    reset(64*1024);
+}
+
+void ChunkSizeControl::reset(qint32 chunkSize)
+{
+    mChunkSize = qBound(MinChunkSize, chunkSize, MaxChunkSize);
+    mMinRtt = -1;
+
+    mWindow.start();
+    mBytes = 0;
+}
+
+void ChunkSizeControl::restartWindow()
+{
+    mWindow.restart();
+    mBytes = 0;
+}
+
+bool ChunkSizeControl::addSent(qint64 bytes)
+{
+    mBytes += bytes;
+    return mWindow.elapsed() >= RateWindow;
+}
+
+bool ChunkSizeControl::adjust(qint64 rtt)
+{
+    double seconds = mWindow.elapsed() / 1000.0;
+    qint64 rate = static_cast<qint64>(mBytes / seconds);
+    qint64 target = rate * TargetChunkTime / 1000;
+
+    if (rtt > 0 && (mMinRtt < 0 || rtt < mMinRtt))
+        mMinRtt = rtt;
+
+    qint64 size = mChunkSize;
+    if (rtt > 0 && rtt > mMinRtt * QueueingFactor + RttMargin)
+        size /= 2;
+    else if (target > size)
+        size = qMin(size * 2, target);
+    else if (target < size / 2)
+        size = qMax(size / 2, target);
+
+    size = size / ChunkAlignment * ChunkAlignment;
+    size = qBound<qint64>(MinChunkSize, size, MaxChunkSize);
+
+    restartWindow();
+    if (size == mChunkSize)
+        return false;
+
+    mChunkSize = static_cast<qint32>(size);
+    return true;
+}
@@ -0,0 +1,70 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHUNKSIZECONTROL_H
+#define CHUNKSIZECONTROL_H
+
+#include <QElapsedTimer>
+
+/*
+ * ChunkSizeControl picks the size of the chunks a Sender reads and
+ * sends. Every window it aims at chunks that take TargetChunkTime on
+ * the link at the throughput delivered so far, doubling or halving
+ * towards it. When the round trip time grows well beyond the lowest
+ * seen, packets are queueing on the way (bufferbloat) and the chunk
+ * size is halved.
+ */
+class ChunkSizeControl
+{
+public:
+    ChunkSizeControl();
+
+    void reset(qint32 chunkSize);
+
+    inline qint32 chunkSize() const { return mChunkSize; }
+
+    /*
+     * Nothing was sent for a while (paused), that
+     * is not measured.
+     */
+    void restartWindow();
+
+    /*
+     * 'bytes' handed to the session, true once the window
+     * is over and adjust() is due.
+     */
+    bool addSent(qint64 bytes);
+
+    /*
+     * 'rtt' is the connection's round trip time in microseconds,
+     * -1 if unknown. True if chunkSize() has changed.
+     */
+    bool adjust(qint64 rtt);
+
+private:
+    qint32 mChunkSize;
+    qint64 mMinRtt;
+
+    /*
+     * Current measuring window
+     */
+    QElapsedTimer mWindow;
+    qint64 mBytes;
+};
+
+#endif // CHUNKSIZECONTROL_H
@@ -0,0 +1,321 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QDir>
+#include <QtEndian>
+
+#include "chunkstore.h"
+#include "transferengine.h"
+#include "settings.h"
+
+#define ChunkIndexFileName      "LANSChunkIndex"
+#define ChunkIndexMagic         0x4943534c // "LSCI"
+#define ChunkIndexVersion       1
+
+/*
+ * Only files this large are indexed (they are the ones negotiated),
+ * up to MaxIndexedChunks chunks (about 128 GB of files).
+ */
+#define MinIndexedFileSize      1024*1024
+#define MaxIndexedChunks        2*1024*1024
+
+#define ChunkEntrySize          12
+
+/*
+ * Files received and not indexed yet that are remembered,
+ * and how long the index is waited for on quit.
+ */
+#define MaxPendingFiles         4096
+#define SaveTimeout             2000    // 2 secs
+
+ChunkStore::ChunkStore(QObject* parent)
+    : QObject(parent), mNextId(0), mDirty(false), mInFlight(0)
+{
+#if defined (Q_OS_WIN)
+    QString dirPath = QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation);
+#else
+    QString dirPath = QFileInfo(QSettings(SETTINGS_FILE).fileName()).absolutePath();
+#endif
+    QDir().mkpath(dirPath);
+    mFilePath = dirPath + QDir::separator() + ChunkIndexFileName;
+
+    load();
+    connect(qApp, &QCoreApplication::aboutToQuit, this, &ChunkStore::onAboutToQuit);
+}
+
+ChunkStore* ChunkStore::instance()
+{
+    static ChunkStore* obj = new ChunkStore(qApp);
+    return obj;
+}
+
+bool ChunkStore::isEmpty()
+{
+    QMutexLocker locker(&mMutex);
+    return mChunks.isEmpty() && mPending.isEmpty();
+}
+
+void ChunkStore::addFile(const QString& filePath)
+{
+    QFileInfo info(filePath);
+    if (!info.isFile() || info.size() < MinIndexedFileSize)
+        return;
+
+    IndexedFile file;
+    file.filePath = info.absoluteFilePath();
+    file.size = info.size();
+    file.mtime = info.lastModified().toMSecsSinceEpoch();
+
+    QMutexLocker locker(&mMutex);
+    int id = mFileIds.value(file.filePath, -1);
+    if (id != -1 && mFiles.value(id).size == file.size && mFiles.value(id).mtime == file.mtime)
+        return;
+
+    if (mPending.size() >= MaxPendingFiles && !mPending.contains(file.filePath))
+        return;
+
+    mPending.insert(file.filePath, file);
+    mDirty = true;
+}
+
+void ChunkStore::indexPending()
+{
+    QMutexLocker locker(&mMutex);
+    for (const IndexedFile& file : mPending) {
+        if (mIndexing.contains(file.filePath))
+            continue;
+
+        mIndexing.insert(file.filePath);
+        mInFlight++;
+        TransferEngine::instance()->computePool()->start([this, file]() { indexFile(file); });
+    }
+}
+
+/*
+ * Called on the compute pool
+ */
+void ChunkStore::indexFile(IndexedFile file)
+{
+    bool ok = false;
+    if (!mQuitting.loadAcquire())
+        file.chunks = Chunker::chunkFile(file.filePath, ok, &mQuitting);
+
+    QMutexLocker locker(&mMutex);
+    mIndexing.remove(file.filePath);
+
+    /*
+     * A file received again meanwhile waits for the next
+     * round, one cut short by the quit is saved unindexed.
+     */
+    auto it = mPending.find(file.filePath);
+    if (it != mPending.end() && it.value().size == file.size && it.value().mtime == file.mtime) {
+        if (ok && isUnchanged(file)) {
+            mPending.erase(it);
+            insertFile(file);
+        }
+        else if (!mQuitting.loadAcquire()) {
+            mPending.erase(it);
+            mDirty = true;
+        }
+    }
+
+    if (--mInFlight == 0)
+        mIdle.wakeAll();
+}
+
+QVector<ChunkStore::Location> ChunkStore::locate(const QVector<Chunker::Chunk>& chunks)
+{
+    QVector<Location> locations(chunks.size(), { QString(), 0 });
+    QHash<int, bool> unchanged;
+
+    QMutexLocker locker(&mMutex);
+    for (int i = 0; i < chunks.size(); i++) {
+        auto it = mChunks.constFind(chunks.at(i).hash);
+        if (it == mChunks.constEnd() || it.value().size != chunks.at(i).size)
+            continue;
+
+        Entry entry = it.value();
+        if (!unchanged.contains(entry.file))
+            unchanged.insert(entry.file, isUnchanged(mFiles.value(entry.file)));
+
+        /*
+         * The file has changed since it was indexed
+         */
+        if (!unchanged.value(entry.file)) {
+            removeFile(entry.file);
+            continue;
+        }
+
+        locations[i] = { mFiles.value(entry.file).filePath, entry.offset };
+    }
+
+    return locations;
+}
+
+bool ChunkStore::isUnchanged(const IndexedFile& file) const
+{
+    QFileInfo info(file.filePath);
+    return info.isFile() && info.size() == file.size &&
+            info.lastModified().toMSecsSinceEpoch() == file.mtime;
+}
+
+void ChunkStore::insertFile(const IndexedFile& file)
+{
+    int old = mFileIds.value(file.filePath, -1);
+    if (old != -1)
+        removeFile(old);
+
+    int id = mNextId++;
+    mFiles.insert(id, file);
+    mFileIds.insert(file.filePath, id);
+    for (const Chunker::Chunk& chunk : file.chunks)
+        mChunks.insert(chunk.hash, { id, chunk.offset, chunk.size });
+
+    while (mChunks.size() > MaxIndexedChunks && mFiles.size() > 1)
+        removeFile(mFiles.firstKey());
+
+    mDirty = true;
+}
+
+void ChunkStore::removeFile(int id)
+{
+    IndexedFile file = mFiles.take(id);
+    mFileIds.remove(file.filePath);
+
+    /*
+     * A chunk some other file has too may point
+     * to that file, it stays then.
+     */
+    for (const Chunker::Chunk& chunk : file.chunks) {
+        auto it = mChunks.find(chunk.hash);
+        if (it != mChunks.end() && it.value().file == id)
+            mChunks.erase(it);
+    }
+
+    mDirty = true;
+}
+
+/*
+ * Index file, little endian: magic, version and number of files, then
+ * for every file its path (length and UTF-8), size, mtime, number of
+ * chunks and the size and hash of every chunk. A file not indexed
+ * yet has no chunks.
+ */
+void ChunkStore::load()
+{
+    QFile file(mFilePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QByteArray data = file.readAll();
+    const char* p = data.constData();
+    const char* end = p + data.size();
+    if (end - p < 12 || qFromLittleEndian<quint32>(p) != ChunkIndexMagic ||
+            qFromLittleEndian<quint32>(p + 4) != ChunkIndexVersion)
+        return;
+
+    quint32 count = qFromLittleEndian<quint32>(p + 8);
+    p += 12;
+
+    QMutexLocker locker(&mMutex);
+    for (quint32 i = 0; i < count && end - p >= 4; i++) {
+        qint32 pathSize = qFromLittleEndian<qint32>(p);
+        p += 4;
+        if (pathSize < 0 || end - p < pathSize + 20)
+            break;
+
+        IndexedFile indexed;
+        indexed.filePath = QString::fromUtf8(p, pathSize);
+        p += pathSize;
+        indexed.size = qFromLittleEndian<qint64>(p);
+        indexed.mtime = qFromLittleEndian<qint64>(p + 8);
+        qint32 chunkCount = qFromLittleEndian<qint32>(p + 16);
+        p += 20;
+        if (chunkCount < 0 || (end - p) / ChunkEntrySize < chunkCount)
+            break;
+
+        indexed.chunks = Chunker::decode(QByteArray::fromRawData(p, chunkCount * ChunkEntrySize));
+        p += chunkCount * ChunkEntrySize;
+        if (indexed.chunks.isEmpty())
+            mPending.insert(indexed.filePath, indexed);
+        else
+            insertFile(indexed);
+    }
+
+    mDirty = false;
+}
+
+/*
+ * Files still being indexed are cut short, they stay pending
+ */
+void ChunkStore::onAboutToQuit()
+{
+    mQuitting.storeRelease(1);
+    save();
+}
+
+void ChunkStore::save()
+{
+    QMutexLocker locker(&mMutex);
+    QElapsedTimer timer;
+    timer.start();
+    while (mInFlight > 0 && !timer.hasExpired(SaveTimeout))
+        mIdle.wait(&mMutex, SaveTimeout - timer.elapsed());
+
+    if (!mDirty)
+        return;
+
+    QSaveFile file(mFilePath);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    char header[12];
+    qToLittleEndian<quint32>(ChunkIndexMagic, header);
+    qToLittleEndian<quint32>(ChunkIndexVersion, header + 4);
+    qToLittleEndian<quint32>(static_cast<quint32>(mFiles.size() + mPending.size()), header + 8);
+    file.write(header, sizeof(header));
+
+    QVector<IndexedFile> files = mFiles.values().toVector();
+    for (const IndexedFile& pending : mPending)
+        files.push_back(pending);
+
+    for (const IndexedFile& indexed : files) {
+        QByteArray path = indexed.filePath.toUtf8();
+        char fileHeader[24];
+        qToLittleEndian<qint32>(path.size(), fileHeader);
+        file.write(fileHeader, 4);
+        file.write(path);
+
+        qToLittleEndian<qint64>(indexed.size, fileHeader);
+        qToLittleEndian<qint64>(indexed.mtime, fileHeader + 8);
+        qToLittleEndian<qint32>(indexed.chunks.size(), fileHeader + 16);
+        file.write(fileHeader, 20);
+        file.write(Chunker::encode(indexed.chunks));
+    }
+
+    if (file.commit())
+        mDirty = false;
+}
@@ -0,0 +1,124 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "chunker.h"
+
+/*
+ * ChunkStore is the index of the content-defined chunks (see Chunker)
+ * of the files received, by chunk hash. A new file is assembled from
+ * the chunks already here and only the others are sent.
+ *
+ * Files received are only recorded, they are read again to be indexed
+ * (on the compute pool) when a new file is negotiated, so they cost
+ * nothing as long as no file is sent by chunks. A file that has
+ * changed since is dropped when one of its chunks is looked up.
+ * The oldest files are dropped when the index grows beyond its limit.
+ * The index is kept next to the config file. Thread safe.
+ */
+class ChunkStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    /*
+     * Local copy of a chunk, no file path if there is none
+     */
+    struct Location
+    {
+        QString filePath;
+        qint64 offset;
+    };
+
+    static ChunkStore* instance();
+
+    bool isEmpty();
+    void addFile(const QString& filePath);
+
+    /*
+     * Index the files recorded by addFile(), the ones done before
+     * the sender's chunk list arrives are used for that file.
+     */
+    void indexPending();
+    QVector<Location> locate(const QVector<Chunker::Chunk>& chunks);
+
+    void save();
+
+private:
+    struct IndexedFile
+    {
+        QString filePath;
+        qint64 size;
+        qint64 mtime;
+        QVector<Chunker::Chunk> chunks;
+    };
+
+    struct Entry
+    {
+        int file;
+        qint64 offset;
+        qint32 size;
+    };
+
+    explicit ChunkStore(QObject* parent = nullptr);
+
+    void indexFile(IndexedFile file);
+    void onAboutToQuit();
+    void insertFile(const IndexedFile& file);
+    void removeFile(int id);
+    bool isUnchanged(const IndexedFile& file) const;
+    void load();
+
+    QString mFilePath;
+
+    /*
+     * Files by id, the oldest first
+     */
+    QMap<int, IndexedFile> mFiles;
+    QHash<QString, int> mFileIds;
+    QHash<quint64, Entry> mChunks;
+
+    /*
+     * Files recorded but not indexed yet, by path
+     */
+    QHash<QString, IndexedFile> mPending;
+    QSet<QString> mIndexing;
+    int mNextId;
+    bool mDirty;
+
+    /*
+     * Files being indexed, save() waits a while for them
+     */
+    int mInFlight;
+    QAtomicInt mQuitting;
+    QMutex mMutex;
+    QWaitCondition mIdle;
+};
+
+#endif // CHUNKSTORE_H
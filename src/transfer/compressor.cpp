@@ -0,0 +1,207 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QThreadPool>
+
+#include <cmath>
+
+#include "compressor.h"
+#include "transferengine.h"
+
+/*
+ * Entropy is measured on the first EntropySampleSize bytes of a
+ * probed chunk, above MaxEntropy it is not compressed at all. A
+ * compressed chunk must save at least 1/MinSavingDivisor of its size.
+ */
+#define EntropySampleSize   64*1024
+#define MaxEntropy          7.5
+#define MinSavingDivisor    10
+
+/*
+ * zlib levels, above MaxLevel it gets much slower for little gain
+ */
+#define MinLevel            1
+#define MaxLevel            6
+
+#define ProbeChunks         4
+#define RateWindow          1000 // ms
+
+Compressor::Compressor(int headroom, QObject* parent)
+    : QObject(parent), mHeadroom(headroom), mNextSeq(0), mNextEmitted(0), mInFlight(0)
+{
+}
+
+Compressor::~Compressor()
+{
+    QMutexLocker locker(&mMutex);
+    while (mInFlight > 0)
+        mIdle.wait(&mMutex);
+}
+
+double Compressor::entropy(const char* data, int size)
+{
+    if (size <= 0)
+        return 0;
+
+    quint32 counts[256] = {0};
+    for (int i = 0; i < size; i++)
+        counts[static_cast<uchar>(data[i])]++;
+
+    double bits = 0;
+    for (quint32 count : counts) {
+        if (count) {
+            double p = static_cast<double>(count) / size;
+            bits -= p * std::log2(p);
+        }
+    }
+
+    return bits;
+}
+
+void Compressor::compress(qint64 offset, const QByteArray& chunk, int level, bool probe)
+{
+    quint64 seq = mNextSeq++;
+    int headroom = mHeadroom;
+
+    {
+        QMutexLocker locker(&mMutex);
+        mInFlight++;
+    }
+
+    /*
+     * The frame comes back queued, this object is not
+     * deleted before every frame is done.
+     */
+    TransferEngine::instance()->computePool()->start([=]() {
+        Frame frame = compressFrame(offset, chunk, headroom, level, probe);
+        QMetaObject::invokeMethod(this, [this, seq, frame]() {
+            onFrameDone(seq, frame);
+        }, Qt::QueuedConnection);
+
+        QMutexLocker locker(&mMutex);
+        if (--mInFlight == 0)
+            mIdle.wakeAll();
+    });
+}
+
+Compressor::Frame Compressor::compressFrame(qint64 offset, const QByteArray& chunk, int headroom,
+                                            int level, bool probe)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const char* data = chunk.constData() + headroom;
+    int size = chunk.size() - headroom;
+
+    if (probe && entropy(data, qMin(size, EntropySampleSize)) > MaxEntropy)
+        return { offset, chunk, size, false, probe, timer.nsecsElapsed() };
+
+    /*
+     * qCompress output starts with the size of the data (big endian),
+     * the receiver needs nothing else to uncompress it.
+     */
+    QByteArray packed = qCompress(reinterpret_cast<const uchar*>(data), size, level);
+    if (packed.size() > size - size / MinSavingDivisor)
+        return { offset, chunk, size, false, probe, timer.nsecsElapsed() };
+
+    packed.prepend(chunk.constData(), headroom);
+    return { offset, packed, size, true, probe, timer.nsecsElapsed() };
+}
+
+void Compressor::onFrameDone(quint64 seq, const Frame& frame)
+{
+    mDone.insert(seq, frame);
+
+    while (!mDone.isEmpty() && mDone.firstKey() == mNextEmitted) {
+        Frame next = mDone.take(mNextEmitted);
+        mNextEmitted++;
+        emit compressed(next.offset, next.chunk, next.rawSize, next.isCompressed,
+                        next.probe, next.nsecs);
+    }
+}
+
+CompressionControl::CompressionControl()
+{
+    reset();
+}
+
+void CompressionControl::reset()
+{
+    mEnabled = true;
+    mLevel = MinLevel;
+
+    mProbesSent = 0;
+    mProbeResults = 0;
+    mCompressible = false;
+
+    mWindow.start();
+    mRawBytes = 0;
+    mCompressNsecs = 0;
+    mLinkBusy = false;
+}
+
+bool CompressionControl::nextIsProbe()
+{
+    if (mProbesSent >= ProbeChunks)
+        return false;
+
+    mProbesSent++;
+    return true;
+}
+
+void CompressionControl::addProbeResult(bool compressible)
+{
+    mCompressible = mCompressible || compressible;
+    if (++mProbeResults == ProbeChunks && !mCompressible)
+        mEnabled = false;
+}
+
+void CompressionControl::addChunk(qint64 rawSize, qint64 nsecs)
+{
+    mRawBytes += rawSize;
+    mCompressNsecs += nsecs;
+
+    if (mWindow.elapsed() >= RateWindow)
+        adjustLevel();
+}
+
+/*
+ * Compare what the compressor could do with what the link took
+ * during the last window.
+ */
+void CompressionControl::adjustLevel()
+{
+    double seconds = mWindow.elapsed() / 1000.0;
+    double linkRate = mRawBytes / seconds;
+    double compressRate = mCompressNsecs ? mRawBytes * 1e9 / mCompressNsecs : 0;
+
+    /*
+     * Frames are compressed in parallel
+     */
+    compressRate *= TransferEngine::instance()->computePool()->maxThreadCount();
+
+    if (!mLinkBusy && mLevel > MinLevel)
+        mLevel--;
+    else if (mLinkBusy && compressRate > 2 * linkRate && mLevel < MaxLevel)
+        mLevel++;
+
+    mWindow.restart();
+    mRawBytes = 0;
+    mCompressNsecs = 0;
+    mLinkBusy = false;
+}
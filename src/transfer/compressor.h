@@ -0,0 +1,136 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COMPRESSOR_H
+#define COMPRESSOR_H
+
+#include <QElapsedTimer>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QWaitCondition>
+
+/*
+ * Compressor compresses the chunks of a Sender with zlib (qCompress).
+ * Every chunk is an independent frame compressed on the compute pool,
+ * so one file uses every core. Frames come back through compressed()
+ * in the order they were given, a frame that doesn't get smaller
+ * comes back as it is.
+ */
+class Compressor : public QObject
+{
+    Q_OBJECT
+
+public:
+    /*
+     * Every chunk starts with 'headroom' bytes (packet prefix),
+     * they are put in front of the compressed data.
+     */
+    explicit Compressor(int headroom, QObject* parent = nullptr);
+    ~Compressor() override;
+
+    /*
+     * Bits per byte of 'data', close to 8 for data that
+     * is already compressed.
+     */
+    static double entropy(const char* data, int size);
+
+    void compress(qint64 offset, const QByteArray& chunk, int level, bool probe);
+
+Q_SIGNALS:
+    void compressed(qint64 offset, const QByteArray& chunk, qint32 rawSize,
+                    bool isCompressed, bool probe, qint64 nsecs);
+
+private:
+    struct Frame
+    {
+        qint64 offset;
+        QByteArray chunk;
+        qint32 rawSize;
+        bool isCompressed;
+        bool probe;
+        qint64 nsecs;
+    };
+
+    static Frame compressFrame(qint64 offset, const QByteArray& chunk, int headroom,
+                               int level, bool probe);
+    void onFrameDone(quint64 seq, const Frame& frame);
+
+    int mHeadroom;
+
+    /*
+     * Frames done out of order wait in mDone until
+     * every frame before them is done.
+     */
+    quint64 mNextSeq;
+    quint64 mNextEmitted;
+    QMap<quint64, Frame> mDone;
+
+    /*
+     * Frames on the pool, the destructor waits for them
+     */
+    int mInFlight;
+    QMutex mMutex;
+    QWaitCondition mIdle;
+};
+
+/*
+ * CompressionControl decides whether and how hard a Sender compresses.
+ * The first chunks of a file are probed, a file that doesn't compress
+ * is sent raw. The level goes down while the link waits for the
+ * compressor and up while the compressor is well ahead of the link.
+ */
+class CompressionControl
+{
+public:
+    CompressionControl();
+
+    void reset();
+
+    inline bool isEnabled() const { return mEnabled; }
+    inline int level() const { return mLevel; }
+
+    /*
+     * True if the next chunk is compressed as a probe
+     */
+    bool nextIsProbe();
+    void addProbeResult(bool compressible);
+
+    void addChunk(qint64 rawSize, qint64 nsecs);
+    inline void setLinkBusy() { mLinkBusy = true; }
+
+private:
+    void adjustLevel();
+
+    bool mEnabled;
+    int mLevel;
+
+    int mProbesSent;
+    int mProbeResults;
+    bool mCompressible;
+
+    /*
+     * Current measuring window
+     */
+    QElapsedTimer mWindow;
+    qint64 mRawBytes;
+    qint64 mCompressNsecs;
+    bool mLinkBusy;
+};
+
+#endif // COMPRESSOR_H
@@ -0,0 +1,327 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QtMath>
+#include <QtEndian>
+
+#include "delta.h"
+
+#define MinBlockSize        2048
+#define MaxBlockCount       1024*1024
+
+/*
+ * Unmatched data is sent in literal ops of at most this size,
+ * read data before the literal being built is dropped past
+ * DeltaCompactSize.
+ */
+#define MaxLiteralSize      256*1024
+#define DeltaReadSize       1024*1024
+#define DeltaCompactSize    4*1024*1024
+
+void RollingChecksum::reset(const char* data, int size)
+{
+    mA = mB = 0;
+    mSize = static_cast<quint32>(size);
+
+    const uchar* p = reinterpret_cast<const uchar*>(data);
+    for (int i = 0; i < size; i++) {
+        mA += p[i];
+        mB += static_cast<quint32>(size - i) * p[i];
+    }
+
+    mA &= 0xffff;
+    mB &= 0xffff;
+}
+
+/*
+ * About sqrt(size) like rsync, but never more than MaxBlockCount blocks
+ */
+int DeltaSignature::blockSizeFor(qint64 fileSize)
+{
+    qint64 size = (static_cast<qint64>(qSqrt(fileSize)) + 1023) / 1024 * 1024;
+    size = qMax<qint64>(size, (fileSize + MaxBlockCount - 1) / MaxBlockCount);
+    return static_cast<int>(qMax<qint64>(size, MinBlockSize));
+}
+
+QByteArray DeltaSignature::build(QIODevice* file, int blockSize)
+{
+    QByteArray signature(sizeof(blockSize), Qt::Uninitialized);
+    qToLittleEndian<qint32>(blockSize, signature.data());
+    QByteArray block(blockSize, Qt::Uninitialized);
+    RollingChecksum weak;
+
+    forever {
+        qint64 size = file->read(block.data(), blockSize);
+        if (size < 0)
+            return QByteArray();
+
+        /*
+         * The last, partial block is never matched
+         */
+        if (size < blockSize)
+            break;
+
+        weak.reset(block.constData(), blockSize);
+        char value[sizeof(quint32)];
+        qToLittleEndian<quint32>(weak.value(), value);
+        signature.append(value, sizeof(value));
+        signature.append(QCryptographicHash::hash(block, QCryptographicHash::Md5));
+    }
+
+    return signature;
+}
+
+bool DeltaSignature::parse(const QByteArray& signature)
+{
+    if (signature.size() < static_cast<int>(sizeof(mBlockSize)))
+        return false;
+
+    mBlockSize = qFromLittleEndian<qint32>(signature.constData());
+    int entries = signature.size() - sizeof(mBlockSize);
+    if (mBlockSize < MinBlockSize || entries % EntrySize)
+        return false;
+
+    mSignature = signature;
+    mBlockCount = entries / EntrySize;
+    mTags = QBitArray(0x10000);
+    mBlocks.clear();
+    mBlocks.reserve(mBlockCount);
+
+    const char* p = mSignature.constData() + sizeof(mBlockSize);
+    for (int i = 0; i < mBlockCount; i++, p += EntrySize) {
+        quint32 weak = qFromLittleEndian<quint32>(p);
+        mTags.setBit(tag(weak));
+        mBlocks.insert(weak, i);
+    }
+
+    return true;
+}
+
+int DeltaSignature::findBlock(quint32 weak, const char* data) const
+{
+    if (!mTags.testBit(tag(weak)))
+        return -1;
+
+    QByteArray strong;
+    const char* entries = mSignature.constData() + sizeof(mBlockSize);
+    for (auto it = mBlocks.constFind(weak); it != mBlocks.constEnd() && it.key() == weak; ++it) {
+        if (strong.isNull())
+            strong = QCryptographicHash::hash(QByteArray::fromRawData(data, mBlockSize),
+                                              QCryptographicHash::Md5);
+
+        if (!memcmp(entries + it.value() * EntrySize + sizeof(weak), strong.constData(), strong.size()))
+            return it.value();
+    }
+
+    return -1;
+}
+
+DeltaEncoder::DeltaEncoder(QIODevice* file, const DeltaSignature& signature)
+    : mFile(file), mSignature(signature), mWeakValid(false),
+      mPos(0), mLiteralStart(0), mLastCopyOp(-1),
+      mEof(false), mAtEnd(false), mError(false)
+{
+}
+
+/*
+ * Make sure 'size' bytes from mPos are buffered, false at end of file
+ */
+bool DeltaEncoder::fill(int size)
+{
+    while (mBuff.size() - mPos < size && !mEof) {
+        if (mLiteralStart > DeltaCompactSize) {
+            mBuff.remove(0, mLiteralStart);
+            mPos -= mLiteralStart;
+            mLiteralStart = 0;
+        }
+
+        int oldSize = mBuff.size();
+        mBuff.resize(oldSize + DeltaReadSize);
+        qint64 bytesRead = mFile->read(mBuff.data() + oldSize, DeltaReadSize);
+        if (bytesRead < 0) {
+            mError = true;
+            bytesRead = 0;
+        }
+
+        mBuff.resize(oldSize + static_cast<int>(bytesRead));
+        if (bytesRead < DeltaReadSize)
+            mEof = true;
+    }
+
+    return mBuff.size() - mPos >= size;
+}
+
+static void appendInt(QByteArray& ops, qint32 value)
+{
+    char bytes[sizeof(value)];
+    qToLittleEndian<qint32>(value, bytes);
+    ops.append(bytes, sizeof(bytes));
+}
+
+void DeltaEncoder::appendLiteral(QByteArray& ops, int end)
+{
+    qint32 size = end - mLiteralStart;
+    if (size <= 0)
+        return;
+
+    ops.append('L');
+    appendInt(ops, size);
+    ops.append(mBuff.constData() + mLiteralStart, size);
+    mLiteralStart = end;
+    mLastCopyOp = -1;
+}
+
+/*
+ * Consecutive basis blocks become one op
+ */
+void DeltaEncoder::appendCopy(QByteArray& ops, int block)
+{
+    if (mLastCopyOp != -1) {
+        char* op = ops.data() + mLastCopyOp + 1;
+        qint32 first = qFromLittleEndian<qint32>(op);
+        qint32 count = qFromLittleEndian<qint32>(op + sizeof(first));
+        if (first + count == block) {
+            qToLittleEndian<qint32>(count + 1, op + sizeof(first));
+            return;
+        }
+    }
+
+    mLastCopyOp = ops.size();
+    ops.append('C');
+    appendInt(ops, block);
+    appendInt(ops, 1);
+}
+
+QByteArray DeltaEncoder::next(qint64 maxInput, qint64& consumed)
+{
+    QByteArray ops;
+    int blockSize = mSignature.blockSize();
+    consumed = 0;
+    mLastCopyOp = -1;
+
+    while (!mAtEnd && !mError && consumed < maxInput) {
+
+        /*
+         * Less than a block left, the rest is literal
+         */
+        if (!fill(blockSize)) {
+            if (mError)
+                break;
+
+            consumed += mBuff.size() - mPos;
+            mPos = mBuff.size();
+            appendLiteral(ops, mPos);
+            mAtEnd = true;
+            break;
+        }
+
+        if (!mWeakValid) {
+            mWeak.reset(mBuff.constData() + mPos, blockSize);
+            mWeakValid = true;
+        }
+
+        int block = mSignature.findBlock(mWeak.value(), mBuff.constData() + mPos);
+        if (block >= 0) {
+            appendLiteral(ops, mPos);
+            appendCopy(ops, block);
+            mPos += blockSize;
+            mLiteralStart = mPos;
+            mWeakValid = false;
+            consumed += blockSize;
+            continue;
+        }
+
+        /*
+         * No match, slide the window one byte
+         */
+        if (fill(blockSize + 1))
+            mWeak.roll(static_cast<uchar>(mBuff.at(mPos)), static_cast<uchar>(mBuff.at(mPos + blockSize)));
+        else
+            mWeakValid = false;
+
+        mPos++;
+        consumed++;
+
+        if (mPos - mLiteralStart >= MaxLiteralSize)
+            appendLiteral(ops, mPos);
+    }
+
+    return ops;
+}
+
+DeltaReader::DeltaReader(const QByteArray& ops)
+    : mPos(ops.constData()), mEnd(ops.constData() + ops.size()), mAtEnd(false)
+{
+}
+
+bool DeltaReader::next(Op& op)
+{
+    if (mPos == mEnd) {
+        mAtEnd = true;
+        return false;
+    }
+
+    char type = *mPos++;
+    if (type == 'L' && mEnd - mPos >= static_cast<int>(sizeof(op.size))) {
+        op.copy = false;
+        op.size = qFromLittleEndian<qint32>(mPos);
+        mPos += sizeof(op.size);
+        if (op.size < 0 || mEnd - mPos < op.size)
+            return false;
+
+        op.data = mPos;
+        mPos += op.size;
+        return true;
+    }
+
+    if (type == 'C' && mEnd - mPos >= static_cast<int>(sizeof(op.first) + sizeof(op.count))) {
+        op.copy = true;
+        op.first = qFromLittleEndian<qint32>(mPos);
+        op.count = qFromLittleEndian<qint32>(mPos + sizeof(op.first));
+        mPos += sizeof(op.first) + sizeof(op.count);
+        return op.first >= 0 && op.count > 0;
+    }
+
+    return false;
+}
+
+SignatureBuilder::SignatureBuilder(const QString& filePath, int blockSize, QThread* thread)
+    : QObject(nullptr), mFilePath(filePath), mBlockSize(blockSize)
+{
+    moveToThread(thread);
+    connect(this, &SignatureBuilder::startRequested,
+            this, &SignatureBuilder::onStartRequested, Qt::QueuedConnection);
+}
+
+void SignatureBuilder::start()
+{
+    emit startRequested();
+}
+
+void SignatureBuilder::onStartRequested()
+{
+    QFile file(mFilePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        emit built(QByteArray());
+        return;
+    }
+
+    emit built(DeltaSignature::build(&file, mBlockSize));
+}
@@ -0,0 +1,195 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <QBitArray>
+#include <QMultiHash>
+#include <QObject>
+
+class QIODevice;
+class QThread;
+
+/*
+ * rsync style delta transfer. The receiver sends the signature of the
+ * file it already has (the basis), the sender answers with Delta
+ * packets that rebuild the new file from basis blocks and literal data.
+ *
+ * signature --> block size (4) | per full block: weak (4) | MD5 (16)
+ * delta op  --> 'C' | first block (4) | block count (4)
+ *               'L' | size (4) | data
+ */
+
+/*
+ * Weak checksum of a block that can be rolled one byte at a time
+ */
+class RollingChecksum
+{
+public:
+    void reset(const char* data, int size);
+
+    inline void roll(uchar out, uchar in)
+    {
+        mA = (mA - out + in) & 0xffff;
+        mB = (mB - mSize * out + mA) & 0xffff;
+    }
+
+    inline quint32 value() const { return mA | (mB << 16); }
+
+private:
+    quint32 mA{0};
+    quint32 mB{0};
+    quint32 mSize{0};
+};
+
+class DeltaSignature
+{
+public:
+    static constexpr int EntrySize = sizeof(quint32) + 16;
+
+    static int blockSizeFor(qint64 fileSize);
+
+    /*
+     * Signature of 'file' from its current position to the end,
+     * empty on read error.
+     */
+    static QByteArray build(QIODevice* file, int blockSize);
+
+    bool parse(const QByteArray& signature);
+
+    inline int blockSize() const { return mBlockSize; }
+    inline int blockCount() const { return mBlockCount; }
+
+    /*
+     * Index of a basis block equal to 'data' (blockSize() bytes)
+     * whose weak checksum is 'weak', -1 if none.
+     */
+    int findBlock(quint32 weak, const char* data) const;
+
+private:
+    static inline int tag(quint32 weak) { return (weak ^ (weak >> 16)) & 0xffff; }
+
+    QByteArray mSignature;
+    int mBlockSize{0};
+    int mBlockCount{0};
+    QBitArray mTags;
+    QMultiHash<quint32, int> mBlocks;
+};
+
+/*
+ * Turns the new file into delta ops against a basis signature,
+ * a slice at a time.
+ */
+class DeltaEncoder
+{
+public:
+    DeltaEncoder(QIODevice* file, const DeltaSignature& signature);
+
+    /*
+     * Ops for the next 'maxInput' bytes (or a bit more) of the file,
+     * 'consumed' is how many bytes of the file they cover.
+     */
+    QByteArray next(qint64 maxInput, qint64& consumed);
+
+    inline bool atEnd() const { return mAtEnd; }
+    inline bool hasError() const { return mError; }
+
+private:
+    bool fill(int size);
+    void appendLiteral(QByteArray& ops, int end);
+    void appendCopy(QByteArray& ops, int block);
+
+    QIODevice* mFile;
+    DeltaSignature mSignature;
+    RollingChecksum mWeak;
+    bool mWeakValid;
+
+    QByteArray mBuff;
+    int mPos;
+    int mLiteralStart;
+    int mLastCopyOp;
+    bool mEof;
+    bool mAtEnd;
+    bool mError;
+};
+
+/*
+ * Reads the ops of a Delta packet one at a time
+ */
+class DeltaReader
+{
+public:
+    struct Op
+    {
+        /*
+         * 'count' basis blocks from block 'first' are copied,
+         * or the 'size' bytes at 'data' (literal)
+         */
+        bool copy;
+        qint32 first;
+        qint32 count;
+        const char* data;
+        qint32 size;
+    };
+
+    /*
+     * 'ops' must outlive the reader, literals point into it
+     */
+    explicit DeltaReader(const QByteArray& ops);
+
+    /*
+     * False past the last op and on a malformed one
+     */
+    bool next(Op& op);
+
+    /*
+     * Every op has been read and was well formed
+     */
+    inline bool atEnd() const { return mAtEnd; }
+
+private:
+    const char* mPos;
+    const char* mEnd;
+    bool mAtEnd;
+};
+
+/*
+ * Builds the signature of a basis file on 'thread'
+ */
+class SignatureBuilder : public QObject
+{
+    Q_OBJECT
+
+public:
+    SignatureBuilder(const QString& filePath, int blockSize, QThread* thread);
+
+    void start();
+
+Q_SIGNALS:
+    void built(const QByteArray& signature);
+    void startRequested();
+
+private:
+    void onStartRequested();
+
+    QString mFilePath;
+    int mBlockSize;
+};
+
+#endif // DELTA_H
@@ -0,0 +1,210 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QThreadPool>
+
+#ifdef Q_OS_UNIX
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#include "dirwalker.h"
+#include "transferengine.h"
+
+/*
+ * Files a consumer may hold before the walk waits for it
+ */
+#define MaxBacklog      16384
+
+DirWalker::DirWalker(const QString& dirPath, QObject* parent)
+    : QObject(parent), mDirPath(dirPath), mListing(0), mStarted(false), mFinished(false), mInFlight(0)
+{
+}
+
+DirWalker::~DirWalker()
+{
+    QMutexLocker locker(&mMutex);
+    while (mInFlight > 0)
+        mIdle.wait(&mMutex);
+}
+
+void DirWalker::addConsumer(QObject* consumer)
+{
+    mBacklogs.insert(consumer, 0);
+}
+
+void DirWalker::start()
+{
+    mStarted = true;
+    mDirs.enqueue({ QDir(mDirPath).dirName(), mDirPath });
+    walk();
+}
+
+void DirWalker::setBacklog(QObject* consumer, int backlog)
+{
+    if (!mBacklogs.contains(consumer))
+        return;
+
+    mBacklogs.insert(consumer, backlog);
+    walk();
+}
+
+void DirWalker::removeConsumer(QObject* consumer)
+{
+    mBacklogs.remove(consumer);
+    walk();
+}
+
+bool DirWalker::isThrottled() const
+{
+    for (int backlog : mBacklogs) {
+        if (backlog >= MaxBacklog)
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * One directory per thread of the pool
+ */
+void DirWalker::walk()
+{
+    if (!mStarted)
+        return;
+
+    if (mBacklogs.isEmpty())
+        mDirs.clear();
+
+    QThreadPool* pool = TransferEngine::instance()->ioPool();
+    while (!mDirs.isEmpty() && mListing < pool->maxThreadCount() && !isThrottled()) {
+        Dir dir = mDirs.dequeue();
+        mListing++;
+
+        {
+            QMutexLocker locker(&mMutex);
+            mInFlight++;
+        }
+
+        pool->start([=]() {
+            Listing listing = listDir(dir);
+            QMetaObject::invokeMethod(this, [this, listing]() {
+                onDirListed(listing);
+            }, Qt::QueuedConnection);
+
+            QMutexLocker locker(&mMutex);
+            if (--mInFlight == 0)
+                mIdle.wakeAll();
+        });
+    }
+
+    if (mDirs.isEmpty() && mListing == 0) {
+        if (!mFinished && !mBacklogs.isEmpty()) {
+            mFinished = true;
+            emit finished();
+        }
+
+        if (mBacklogs.isEmpty())
+            deleteLater();
+    }
+}
+
+void DirWalker::onDirListed(const Listing& listing)
+{
+    mListing--;
+    for (const Dir& dir : listing.dirs)
+        mDirs.enqueue(dir);
+
+    if (!listing.files.isEmpty() && !mBacklogs.isEmpty())
+        emit filesFound(listing.files);
+
+    walk();
+}
+
+/*
+ * Runs on the I/O pool. On Unix the entries are read with readdir()
+ * (getdents) and only files are stat'ed, relative to the directory,
+ * folders are known by their type.
+ */
+DirWalker::Listing DirWalker::listDir(const Dir& dir)
+{
+    Listing listing;
+
+#ifdef Q_OS_UNIX
+    DIR* d = opendir(QFile::encodeName(dir.dirPath).constData());
+    if (!d)
+        return listing;
+
+    int fd = dirfd(d);
+    while (dirent* ent = readdir(d)) {
+        /*
+         * '.', '..' and hidden entries
+         */
+        if (ent->d_name[0] == '.')
+            continue;
+
+        bool isDir = ent->d_type == DT_DIR;
+        struct stat st;
+        if (!isDir) {
+            if (fstatat(fd, ent->d_name, &st, 0) != 0)
+                continue;
+
+            /*
+             * Type not given by the file system
+             */
+            if (ent->d_type == DT_UNKNOWN && S_ISDIR(st.st_mode)) {
+                struct stat lst;
+                isDir = fstatat(fd, ent->d_name, &lst, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(lst.st_mode);
+                if (!isDir)
+                    continue;
+            }
+            else if (!S_ISREG(st.st_mode)) {
+                continue;
+            }
+        }
+
+        QString fileName = QFile::decodeName(ent->d_name);
+        QString filePath = dir.dirPath + '/' + fileName;
+        if (isDir)
+            listing.dirs.push_back({ dir.folder + QDir::separator() + fileName, filePath });
+        else
+            listing.files.push_back({ dir.folder, filePath, static_cast<qint64>(st.st_size) });
+    }
+
+    closedir(d);
+#else
+    QDirIterator it(dir.dirPath, QDir::NoDotAndDotDot | QDir::Files | QDir::Dirs);
+    while (it.hasNext()) {
+        it.next();
+        QFileInfo info = it.fileInfo();
+        if (info.isDir()) {
+            if (!info.isSymLink())
+                listing.dirs.push_back({ dir.folder + QDir::separator() + info.fileName(), info.filePath() });
+        }
+        else {
+            listing.files.push_back({ dir.folder, info.filePath(), info.size() });
+        }
+    }
+#endif
+
+    return listing;
+}
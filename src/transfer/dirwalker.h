@@ -0,0 +1,107 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DIRWALKER_H
+#define DIRWALKER_H
+
+#include <QMutex>
+#include <QHash>
+#include <QObject>
+#include <QQueue>
+#include <QVector>
+#include <QWaitCondition>
+
+/*
+ * DirWalker lists the files of a folder tree on the I/O pool, several
+ * directories at a time, and hands them out in batches (filesFound(),
+ * one batch per directory) while it is still walking, so the first
+ * files can be sent right away.
+ *
+ * Consumers (FolderSender) report how many files they hold that are
+ * not sent yet, the walk waits while one of them holds too many. The
+ * walk stops when every consumer is gone, the walker deletes itself
+ * once it is over and no consumer is left.
+ *
+ * Hidden files and folders are left out, as are symbolic links to
+ * folders (they can loop).
+ */
+class DirWalker : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Entry
+    {
+        /*
+         * Relative folder, starting with the name of the walked folder
+         */
+        QString folder;
+        QString filePath;
+        qint64 size;
+    };
+
+    explicit DirWalker(const QString& dirPath, QObject* parent = nullptr);
+    ~DirWalker() override;
+
+    /*
+     * Consumers are added before start()
+     */
+    void addConsumer(QObject* consumer);
+    void start();
+
+public Q_SLOTS:
+    void setBacklog(QObject* consumer, int backlog);
+    void removeConsumer(QObject* consumer);
+
+Q_SIGNALS:
+    void filesFound(const QVector<DirWalker::Entry>& files);
+    void finished();
+
+private:
+    struct Dir
+    {
+        QString folder;
+        QString dirPath;
+    };
+
+    struct Listing
+    {
+        QVector<Entry> files;
+        QVector<Dir> dirs;
+    };
+
+    static Listing listDir(const Dir& dir);
+    void walk();
+    void onDirListed(const Listing& listing);
+    bool isThrottled() const;
+
+    QString mDirPath;
+    QQueue<Dir> mDirs;
+    QHash<QObject*, int> mBacklogs;
+    int mListing;
+    bool mStarted;
+    bool mFinished;
+
+    QMutex mMutex;
+    QWaitCondition mIdle;
+    int mInFlight;
+};
+
+Q_DECLARE_METATYPE(DirWalker::Entry)
+
+#endif // DIRWALKER_H
@@ -0,0 +1,187 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtEndian>
+
+#include "fileheader.h"
+
+#define HeaderVersion       1
+#define FixedHeaderSize     33
+
+void FileHeader::appendString(QByteArray& data, const QString& str)
+{
+    QByteArray utf8 = str.toUtf8().left(0xffff);
+    char size[2];
+    qToLittleEndian<quint16>(static_cast<quint16>(utf8.size()), size);
+    data.append(size, sizeof(size));
+    data.append(utf8);
+}
+
+bool FileHeader::readString(const char*& p, const char* end, QString& str)
+{
+    if (end - p < 2)
+        return false;
+
+    int size = qFromLittleEndian<quint16>(p);
+    p += 2;
+    if (end - p < size)
+        return false;
+
+    str = QString::fromUtf8(p, size);
+    p += size;
+    return true;
+}
+
+QByteArray FileHeader::toBinary() const
+{
+    QByteArray data(FixedHeaderSize, Qt::Uninitialized);
+    char* p = data.data();
+    *p = HeaderVersion;
+    qToLittleEndian<quint32>(flags, p + 1);
+    qToLittleEndian<qint64>(size, p + 5);
+    qToLittleEndian<qint64>(mtime, p + 13);
+    qToLittleEndian<quint64>(hash, p + 21);
+    qToLittleEndian<qint32>(stripe, p + 29);
+
+    appendString(data, name);
+    appendString(data, folder);
+    appendString(data, token);
+    appendString(data, join);
+
+    if (has(Inline))
+        data.append(payload);
+    return data;
+}
+
+QByteArray FileHeader::toJson() const
+{
+    QJsonObject obj;
+    if (isStripe()) {
+        obj.insert("join", join);
+        obj.insert("stripe", stripe);
+        return QJsonDocument(obj).toJson(QJsonDocument::Compact);
+    }
+
+    obj.insert("name", name);
+    obj.insert("folder", folder);
+    obj.insert("size", size);
+    if (isNegotiated()) {
+        obj.insert("token", token);
+        obj.insert("mtime", mtime);
+    }
+
+    if (has(Delta))
+        obj.insert("delta", true);
+    if (has(Verify))
+        obj.insert("verify", true);
+    if (has(Chunks))
+        obj.insert("chunks", true);
+    if (has(Compress))
+        obj.insert("compress", true);
+    if (has(HasHash))
+        obj.insert("hash", QString::number(hash, 16));
+    if (has(Folder))
+        obj.insert("manifest", true);
+    if (has(Inline))
+        obj.insert("inline", QString::fromLatin1(payload.toBase64()));
+
+    return QJsonDocument(obj).toJson(QJsonDocument::Compact);
+}
+
+bool FileHeader::parse(const QByteArray& data, FileHeader& header)
+{
+    header = FileHeader();
+    if (!data.isEmpty() && data.at(0) == HeaderVersion)
+        return parseBinary(data, header);
+
+    return parseJson(data, header);
+}
+
+/*
+ * Bytes after the known fields come from newer peers
+ * and are ignored, the payload is taken from the end.
+ */
+bool FileHeader::parseBinary(const QByteArray& data, FileHeader& header)
+{
+    if (data.size() < FixedHeaderSize)
+        return false;
+
+    const char* p = data.constData();
+    const char* end = p + data.size();
+    header.flags = qFromLittleEndian<quint32>(p + 1);
+    header.size = qFromLittleEndian<qint64>(p + 5);
+    header.mtime = qFromLittleEndian<qint64>(p + 13);
+    header.hash = qFromLittleEndian<quint64>(p + 21);
+    header.stripe = qFromLittleEndian<qint32>(p + 29);
+    p += FixedHeaderSize;
+
+    if (header.has(Inline)) {
+        if (header.size < 0 || header.size > end - p)
+            return false;
+
+        end -= header.size;
+        header.payload = QByteArray(end, static_cast<int>(header.size));
+    }
+
+    return readString(p, end, header.name) && readString(p, end, header.folder) &&
+            readString(p, end, header.token) && readString(p, end, header.join) &&
+            header.size >= 0;
+}
+
+bool FileHeader::parseJson(const QByteArray& data, FileHeader& header)
+{
+    QJsonObject obj = QJsonDocument::fromJson(data).object();
+    if (obj.isEmpty())
+        return false;
+
+    header.name = obj.value("name").toString();
+    header.folder = obj.value("folder").toString();
+    header.size = obj.value("size").toVariant().value<qint64>();
+    header.mtime = obj.value("mtime").toVariant().value<qint64>();
+    header.token = obj.value("token").toString();
+    header.join = obj.value("join").toString();
+    header.stripe = obj.value("stripe").toInt();
+
+    if (obj.value("delta").toBool())
+        header.flags |= Delta;
+    if (obj.value("verify").toBool())
+        header.flags |= Verify;
+    if (obj.value("chunks").toBool())
+        header.flags |= Chunks;
+    if (obj.value("compress").toBool())
+        header.flags |= Compress;
+    if (obj.value("manifest").toBool())
+        header.flags |= Folder;
+
+    if (obj.contains("inline")) {
+        header.payload = QByteArray::fromBase64(obj.value("inline").toString().toLatin1());
+        if (header.payload.size() != header.size)
+            return false;
+
+        header.flags |= Inline;
+    }
+
+    bool ok;
+    header.hash = obj.value("hash").toString().toULongLong(&ok, 16);
+    if (ok)
+        header.flags |= HasHash;
+
+    return header.size >= 0;
+}
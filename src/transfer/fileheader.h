@@ -0,0 +1,105 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FILEHEADER_H
+#define FILEHEADER_H
+
+#include <QByteArray>
+#include <QString>
+
+/*
+ * FileHeader is the Header packet that opens a stream, a file
+ * (name, folder, size and what the sender offers for it) or a
+ * stripe of a file ('join').
+ *
+ * Peers that announced Session::CapBinaryHeader get it in binary,
+ * little endian:
+ *
+ * version (1) | flags (4) | size (8) | mtime (8) | hash (8) | stripe (4)
+ *             | name | folder | token | join
+ *
+ * where every string is its UTF-8 length (2) and bytes. Peers that
+ * didn't announce it get a JSON object with the same fields (an Inline
+ * payload in base64), parse() takes either.
+ *
+ * A small file may come Inline, its 'size' bytes then end the
+ * binary header.
+ */
+class FileHeader
+{
+public:
+    enum Flag : quint32
+    {
+        Delta       = 0x01,
+        Verify      = 0x02,
+        Chunks      = 0x04,
+        Compress    = 0x08,
+        HasHash     = 0x10,
+
+        /*
+         * Folder job, the files and their sizes follow
+         * in Manifest packets.
+         */
+        Folder      = 0x20,
+        Inline      = 0x40
+    };
+
+    inline bool isNegotiated() const { return !token.isEmpty(); }
+    inline bool isStripe() const { return !join.isEmpty(); }
+    inline bool has(Flag flag) const { return flags & flag; }
+
+    QByteArray toBinary() const;
+    QByteArray toJson() const;
+    static bool parse(const QByteArray& data, FileHeader& header);
+
+    /*
+     * String as its UTF-8 length (2 bytes, little endian) and bytes
+     */
+    static void appendString(QByteArray& data, const QString& str);
+    static bool readString(const char*& p, const char* end, QString& str);
+
+    QString name;
+    QString folder;
+    qint64 size{0};
+    qint64 mtime{0};
+    quint64 hash{0};
+    quint32 flags{0};
+
+    /*
+     * Names the file for its stripes and for resuming,
+     * negotiated files only.
+     */
+    QString token;
+
+    /*
+     * Stripe header, token of the file and lane
+     */
+    QString join;
+    int stripe{0};
+
+    /*
+     * Content of an Inline file
+     */
+    QByteArray payload;
+
+private:
+    static bool parseBinary(const QByteArray& data, FileHeader& header);
+    static bool parseJson(const QByteArray& data, FileHeader& header);
+};
+
+#endif // FILEHEADER_H
@@ -0,0 +1,128 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+
+#include <QFileInfo>
+#include <QStorageInfo>
+
+#include "filereader.h"
+#include "readcache.h"
+#include "transferengine.h"
+
+#if defined (Q_OS_LINUX)
+#include <fcntl.h>
+#endif
+
+FileReader::FileReader(const QString& filePath, qint64 offset, qint64 length,
+                       qint32 chunkSize, int headroom)
+    : QObject(nullptr), mFile(filePath), mOffset(offset), mBytesRemaining(length),
+      mChunkSize(chunkSize), mHeadroom(headroom)
+{
+    QThread* thread = readerThread(filePath);
+    moveToThread(thread);
+    mFile.moveToThread(thread);
+}
+
+FileReader::~FileReader()
+{
+    ReadCache::instance()->detach(this);
+}
+
+QThread* FileReader::readerThread(const QString& filePath)
+{
+    QByteArray disk = QStorageInfo(QFileInfo(filePath).absolutePath()).device();
+    return TransferEngine::instance()->namedThread("FileReader " + QString::fromLocal8Bit(disk));
+}
+
+void FileReader::setChunkSize(qint32 chunkSize)
+{
+    mChunkSize = chunkSize;
+}
+
+void FileReader::read(int chunks)
+{
+    ReadCache* cache = ReadCache::instance();
+    if (!mFile.isOpen()) {
+        if (!mFile.open(QIODevice::ReadOnly) || (mOffset && !mFile.seek(mOffset))) {
+            emit errorOcurred();
+            return;
+        }
+
+#if defined (Q_OS_LINUX)
+        /*
+         * The range is read front to back, let the kernel
+         * read ahead more aggressively.
+         */
+        posix_fadvise(mFile.handle(), mOffset, mBytesRemaining, POSIX_FADV_SEQUENTIAL);
+#endif
+
+        cache->attach(this, mFile.fileName(), mOffset, mOffset + mBytesRemaining);
+    }
+
+    while (chunks-- > 0 && mBytesRemaining > 0) {
+        qint32 size = static_cast<qint32>(qMin<qint64>(mBytesRemaining, mChunkSize));
+        QByteArray chunk(mHeadroom + size, Qt::Uninitialized);
+
+        char* data = chunk.data() + mHeadroom;
+        qint64 bytesRead = cache->isShared(this) ? readShared(data, size) : readFile(data, size);
+        if (bytesRead <= 0) {
+            emit errorOcurred();
+            return;
+        }
+
+        if (bytesRead < size)
+            chunk.resize(mHeadroom + static_cast<int>(bytesRead));
+
+        emit chunkRead(mOffset, chunk);
+        mOffset += bytesRead;
+        mBytesRemaining -= bytesRead;
+        cache->setPosition(this, mOffset);
+    }
+}
+
+/*
+ * Copied out of the shared blocks, the file position
+ * is left wherever the last block was read.
+ */
+qint64 FileReader::readShared(char* data, qint32 size)
+{
+    ReadCache* cache = ReadCache::instance();
+    qint32 done = 0;
+    while (done < size) {
+        qint64 offset = mOffset + done;
+        QByteArray block = cache->block(this, mFile, offset / ReadCache::BlockSize);
+        qint32 start = static_cast<qint32>(offset % ReadCache::BlockSize);
+        if (block.size() <= start)
+            break;
+
+        qint32 count = qMin(size - done, block.size() - start);
+        std::memcpy(data + done, block.constData() + start, count);
+        done += count;
+    }
+
+    return done > 0 ? done : -1;
+}
+
+qint64 FileReader::readFile(char* data, qint32 size)
+{
+    if (mFile.pos() != mOffset && !mFile.seek(mOffset))
+        return -1;
+
+    return mFile.read(data, size);
+}
@@ -0,0 +1,79 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FILEREADER_H
+#define FILEREADER_H
+
+#include <QFile>
+#include <QObject>
+
+class QThread;
+
+/*
+ * FileReader reads a byte range of a file ahead of the Sender on the
+ * reader thread of its disk, so the next chunks are read while the
+ * current one is on the wire, and a slow disk doesn't hold up the
+ * readers of the others. The Sender asks for chunks with read() and gets
+ * them back through chunkRead(), it decides how many are in flight.
+ *
+ * Readers of the same file share the blocks they read (ReadCache)
+ * while they keep pace with each other.
+ */
+class FileReader : public QObject
+{
+    Q_OBJECT
+
+public:
+    /*
+     * Every chunk starts with 'headroom' bytes the Sender
+     * may fill in (packet prefix), the file data follows.
+     */
+    FileReader(const QString& filePath, qint64 offset, qint64 length,
+               qint32 chunkSize, int headroom = 0);
+    ~FileReader() override;
+
+    /*
+     * Thread the readers of the files on the disk of
+     * 'filePath' live in, one per disk.
+     */
+    static QThread* readerThread(const QString& filePath);
+
+public Q_SLOTS:
+    void read(int chunks);
+
+    /*
+     * Chunks read from now on are 'chunkSize' bytes
+     */
+    void setChunkSize(qint32 chunkSize);
+
+Q_SIGNALS:
+    void chunkRead(qint64 offset, const QByteArray& chunk);
+    void errorOcurred();
+
+private:
+    qint64 readShared(char* data, qint32 size);
+    qint64 readFile(char* data, qint32 size);
+
+    QFile mFile;
+    qint64 mOffset;
+    qint64 mBytesRemaining;
+    qint32 mChunkSize;
+    int mHeadroom;
+};
+
+#endif // FILEREADER_H
@@ -0,0 +1,362 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QStorageInfo>
+#include <QFileInfo>
+#include <QThreadPool>
+
+#include "filewriter.h"
+#include "transferengine.h"
+#include "checksum.h"
+
+#include <cstdio>
+
+#if defined (Q_OS_LINUX)
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#define CopyBufferSize  1024*1024
+#define SplicePipeSize  1024*1024
+
+FileWriter::FileWriter(const QString& filePath)
+    : QObject(nullptr), mFile(filePath), mFailed(false), mInFlight(0), mPipeSize(0)
+{
+    mPipe[0] = mPipe[1] = -1;
+
+    QThread* thread = writerThread(filePath);
+    moveToThread(thread);
+    mFile.moveToThread(thread);
+    mSource.moveToThread(thread);
+    mChunkSource.moveToThread(thread);
+
+    connect(this, &FileWriter::writeRequested,
+            this, &FileWriter::onWriteRequested, Qt::QueuedConnection);
+    connect(this, &FileWriter::spliceRequested,
+            this, &FileWriter::onSpliceRequested, Qt::QueuedConnection);
+    connect(this, &FileWriter::copyRequested,
+            this, &FileWriter::onCopyRequested, Qt::QueuedConnection);
+    connect(this, &FileWriter::copyChunkRequested,
+            this, &FileWriter::onCopyChunkRequested, Qt::QueuedConnection);
+    connect(this, &FileWriter::commitRequested,
+            this, &FileWriter::onCommitRequested, Qt::QueuedConnection);
+    connect(this, &FileWriter::discardRequested,
+            this, &FileWriter::onDiscardRequested, Qt::QueuedConnection);
+}
+
+FileWriter::~FileWriter()
+{
+    QMutexLocker locker(&mMutex);
+    while (mInFlight > 0)
+        mIdle.wait(&mMutex);
+
+#if defined (Q_OS_LINUX)
+    if (mPipe[0] != -1) {
+        ::close(mPipe[0]);
+        ::close(mPipe[1]);
+    }
+#endif
+}
+
+QThread* FileWriter::writerThread(const QString& filePath)
+{
+    QByteArray disk = QStorageInfo(QFileInfo(filePath).absolutePath()).device();
+    return TransferEngine::instance()->namedThread("FileWriter " + QString::fromLocal8Bit(disk));
+}
+
+void FileWriter::write(qint64 offset, const QByteArray& data)
+{
+    emit writeRequested(offset, data);
+}
+
+void FileWriter::writeCompressed(qint64 offset, const QByteArray& data, qint64 size)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        mInFlight++;
+    }
+
+    /*
+     * Frames finish in any order, that's fine as
+     * every write has its own offset.
+     */
+    TransferEngine::instance()->computePool()->start([=]() {
+        QByteArray raw = qUncompress(data);
+        if (raw.size() == size) {
+            emit writeRequested(offset, raw);
+        }
+        else {
+            QMetaObject::invokeMethod(this, [this]() {
+                mFailed = true;
+                emit errorOcurred();
+            }, Qt::QueuedConnection);
+        }
+
+        QMutexLocker locker(&mMutex);
+        if (--mInFlight == 0)
+            mIdle.wakeAll();
+    });
+}
+
+qint64 FileWriter::spliceFrom(int socketDescriptor, qint64 offset, qint64 size)
+{
+#if defined (Q_OS_LINUX)
+    QMutexLocker locker(&mPipeMutex);
+    if (mPipe[0] == -1) {
+        if (::pipe2(mPipe, O_NONBLOCK | O_CLOEXEC) == -1) {
+            mPipe[0] = mPipe[1] = -1;
+            return -1;
+        }
+
+        ::fcntl(mPipe[1], F_SETPIPE_SZ, SplicePipeSize);
+        mPipeSize = ::fcntl(mPipe[1], F_GETPIPE_SZ);
+        if (mPipeSize <= 0)
+            mPipeSize = 64*1024;
+    }
+
+    ssize_t len;
+    do {
+        len = ::splice(socketDescriptor, nullptr, mPipe[1], nullptr,
+                       static_cast<size_t>(qMin<qint64>(size, mPipeSize)),
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    } while (len < 0 && errno == EINTR);
+
+    if (len < 0)
+        return errno == EAGAIN ? 0 : -1;
+
+    if (len > 0)
+        emit spliceRequested(offset, len);
+    return len;
+#else
+    Q_UNUSED(socketDescriptor);
+    Q_UNUSED(offset);
+    Q_UNUSED(size);
+    return -1;
+#endif
+}
+
+void FileWriter::setSource(const QString& filePath)
+{
+    mSource.setFileName(filePath);
+}
+
+void FileWriter::copy(qint64 sourceOffset, qint64 size, qint64 offset)
+{
+    emit copyRequested(sourceOffset, size, offset);
+}
+
+void FileWriter::copyChunk(const QString& sourcePath, qint64 sourceOffset, qint64 size, qint64 offset, quint64 hash)
+{
+    emit copyChunkRequested(sourcePath, sourceOffset, size, offset, hash);
+}
+
+void FileWriter::commit(const QString& targetPath)
+{
+    emit commitRequested(targetPath);
+}
+
+void FileWriter::discard()
+{
+    emit discardRequested();
+}
+
+bool FileWriter::openFile()
+{
+    if (mFailed)
+        return false;
+
+    /*
+     * The Receiver has already created the file,
+     * don't truncate it.
+     */
+    if (!mFile.isOpen() && !mFile.open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+        mFailed = true;
+        emit errorOcurred();
+        return false;
+    }
+
+    return true;
+}
+
+void FileWriter::onWriteRequested(qint64 offset, const QByteArray& data)
+{
+    if (!openFile())
+        return;
+
+    if (!mFile.seek(offset) || mFile.write(data) != data.size()) {
+        mFailed = true;
+        emit errorOcurred();
+        return;
+    }
+
+    emit bytesWritten(offset, data.size());
+}
+
+/*
+ * The bytes are in the pipe already, they are taken out even
+ * when the file has failed so that the next ones line up.
+ */
+void FileWriter::onSpliceRequested(qint64 offset, qint64 size)
+{
+#if defined (Q_OS_LINUX)
+    bool ok = openFile();
+    loff_t pos = offset;
+    qint64 left = size;
+    QByteArray buff;
+
+    while (left > 0) {
+        ssize_t len;
+        if (ok) {
+            len = ::splice(mPipe[0], nullptr, mFile.handle(), &pos,
+                           static_cast<size_t>(left), SPLICE_F_MOVE);
+        }
+        else {
+            buff.resize(static_cast<int>(qMin<qint64>(left, CopyBufferSize)));
+            len = ::read(mPipe[0], buff.data(), static_cast<size_t>(buff.size()));
+        }
+
+        if (len < 0 && errno == EINTR)
+            continue;
+
+        if (len <= 0) {
+            if (!ok)
+                return;
+
+            ok = false;
+            mFailed = true;
+            emit errorOcurred();
+            continue;
+        }
+
+        left -= len;
+    }
+
+    if (ok)
+        emit bytesWritten(offset, size);
+#else
+    Q_UNUSED(offset);
+    Q_UNUSED(size);
+#endif
+}
+
+void FileWriter::onCopyRequested(qint64 sourceOffset, qint64 size, qint64 offset)
+{
+    if (!openFile())
+        return;
+
+    if ((!mSource.isOpen() && !mSource.open(QIODevice::ReadOnly)) ||
+            !mSource.seek(sourceOffset) || !mFile.seek(offset)) {
+        mFailed = true;
+        emit errorOcurred();
+        return;
+    }
+
+    QByteArray buff(static_cast<int>(qMin<qint64>(size, CopyBufferSize)), Qt::Uninitialized);
+    qint64 left = size;
+    while (left > 0) {
+        qint64 len = qMin<qint64>(left, buff.size());
+        if (mSource.read(buff.data(), len) != len || mFile.write(buff.constData(), len) != len) {
+            mFailed = true;
+            emit errorOcurred();
+            return;
+        }
+
+        left -= len;
+    }
+
+    emit bytesWritten(offset, size);
+}
+
+/*
+ * A chunk that can't be read or has changed is not copied,
+ * it has to be received.
+ */
+void FileWriter::onCopyChunkRequested(const QString& sourcePath, qint64 sourceOffset, qint64 size,
+                                      qint64 offset, quint64 hash)
+{
+    if (!openFile()) {
+        emit chunkCopied(offset, size, false);
+        return;
+    }
+
+    if (mChunkSource.fileName() != sourcePath) {
+        mChunkSource.close();
+        mChunkSource.setFileName(sourcePath);
+    }
+
+    QByteArray data;
+    bool ok = (mChunkSource.isOpen() || mChunkSource.open(QIODevice::ReadOnly)) && mChunkSource.seek(sourceOffset);
+    if (ok) {
+        data = mChunkSource.read(size);
+        ok = data.size() == size && FileChecksum::hash(data.constData(), size) == hash;
+    }
+
+    if (!ok) {
+        emit chunkCopied(offset, size, false);
+        return;
+    }
+
+    if (!mFile.seek(offset) || mFile.write(data) != data.size()) {
+        mFailed = true;
+        emit errorOcurred();
+        emit chunkCopied(offset, size, false);
+        return;
+    }
+
+    emit bytesWritten(offset, size);
+    emit chunkCopied(offset, size, true);
+}
+
+/*
+ * Replace the target with the finished file in one step
+ */
+void FileWriter::onCommitRequested(const QString& targetPath)
+{
+    mSource.close();
+    mChunkSource.close();
+    mFile.close();
+
+    if (mFailed) {
+        emit committed(false);
+        return;
+    }
+
+#if defined (Q_OS_UNIX)
+    bool ok = ::rename(QFile::encodeName(mFile.fileName()).constData(),
+                       QFile::encodeName(targetPath).constData()) == 0;
+#else
+    QFile::remove(targetPath);
+    bool ok = mFile.rename(targetPath);
+#endif
+
+    emit committed(ok);
+}
+
+/*
+ * On the writer thread, the file is closed before it is removed
+ * (Windows) and frames uncompressed later don't open it again.
+ */
+void FileWriter::onDiscardRequested()
+{
+    mFailed = true;
+    mSource.close();
+    mChunkSource.close();
+    mFile.close();
+    mFile.remove();
+}
@@ -0,0 +1,130 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FILEWRITER_H
+#define FILEWRITER_H
+
+#include <QFile>
+#include <QMutex>
+#include <QObject>
+#include <QWaitCondition>
+
+class QThread;
+
+/*
+ * FileWriter writes received data behind the Receiver on the writer
+ * thread of the disk the file is on, so a slow disk doesn't stall
+ * the session. write() can be called from any thread, every call
+ * is answered with bytesWritten() once the data is in the file.
+ *
+ * Compressed data is uncompressed on the compute pool first, several
+ * frames of one file at a time.
+ *
+ * For delta transfers the writer also copies ranges of a source
+ * file (the receiver's old copy) and finally renames the file over
+ * its target with commit().
+ *
+ * Chunks of other local files (see ChunkStore) are copied after
+ * checking their hash, chunkCopied() tells if they were.
+ */
+class FileWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FileWriter(const QString& filePath);
+    ~FileWriter() override;
+
+    void write(qint64 offset, const QByteArray& data);
+
+    /*
+     * 'data' as made by qCompress(), 'size' bytes uncompressed
+     */
+    void writeCompressed(qint64 offset, const QByteArray& data, qint64 size);
+
+    /*
+     * Must be set before the first copy()
+     */
+    void setSource(const QString& filePath);
+    void copy(qint64 sourceOffset, qint64 size, qint64 offset);
+    void copyChunk(const QString& sourcePath, qint64 sourceOffset, qint64 size, qint64 offset, quint64 hash);
+    void commit(const QString& targetPath);
+
+    /*
+     * Linux, moves up to 'size' bytes from the socket into the writer's
+     * pipe, they are written at 'offset' on the writer thread. Returns
+     * the bytes moved, 0 when the socket is empty or the pipe is full,
+     * -1 on error.
+     */
+    qint64 spliceFrom(int socketDescriptor, qint64 offset, qint64 size);
+
+    /*
+     * Remove the file once the writes queued before are done,
+     * the ones after are dropped.
+     */
+    void discard();
+
+    /*
+     * One writer thread per disk
+     */
+    static QThread* writerThread(const QString& filePath);
+
+Q_SIGNALS:
+    void bytesWritten(qint64 offset, qint64 bytes);
+    void committed(bool ok);
+    void chunkCopied(qint64 offset, qint64 size, bool ok);
+    void errorOcurred();
+
+    void writeRequested(qint64 offset, const QByteArray& data);
+    void spliceRequested(qint64 offset, qint64 size);
+    void copyRequested(qint64 sourceOffset, qint64 size, qint64 offset);
+    void copyChunkRequested(const QString& sourcePath, qint64 sourceOffset, qint64 size, qint64 offset, quint64 hash);
+    void commitRequested(const QString& targetPath);
+    void discardRequested();
+
+private:
+    bool openFile();
+    void onWriteRequested(qint64 offset, const QByteArray& data);
+    void onSpliceRequested(qint64 offset, qint64 size);
+    void onCopyRequested(qint64 sourceOffset, qint64 size, qint64 offset);
+    void onCopyChunkRequested(const QString& sourcePath, qint64 sourceOffset, qint64 size, qint64 offset, quint64 hash);
+    void onCommitRequested(const QString& targetPath);
+    void onDiscardRequested();
+
+    QFile mFile;
+    QFile mSource;
+    QFile mChunkSource;
+    bool mFailed;
+
+    /*
+     * Frames being uncompressed, the destructor waits for them
+     */
+    int mInFlight;
+    QMutex mMutex;
+    QWaitCondition mIdle;
+
+    /*
+     * Spliced data waits here for the writer thread, what is
+     * in the pipe is in the order of the spliceRequested() calls.
+     */
+    int mPipe[2];
+    int mPipeSize;
+    QMutex mPipeMutex;
+};
+
+#endif // FILEWRITER_H
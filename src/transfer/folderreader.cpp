@@ -0,0 +1,118 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "folderreader.h"
+#include "filereader.h"
+
+FolderReader::FolderReader(const QString& dirPath, qint32 chunkSize, bool pack)
+    : QObject(nullptr), mCurrent(-1), mBytesRemaining(0), mChunkSize(chunkSize), mChunksWanted(0),
+      mPack(pack), mFailed(false)
+{
+    QThread* thread = FileReader::readerThread(dirPath);
+    moveToThread(thread);
+    mFile.moveToThread(thread);
+}
+
+void FolderReader::setChunkSize(qint32 chunkSize)
+{
+    mChunkSize = chunkSize;
+}
+
+/*
+ * Chunks asked for before the file was added are read now
+ */
+void FolderReader::addFile(int file, const QString& filePath, qint64 size)
+{
+    mPending.enqueue({ file, filePath, size });
+    if (mChunksWanted > 0 && !mFailed)
+        read(0);
+}
+
+bool FolderReader::openNext()
+{
+    mFile.close();
+    while (!mPending.isEmpty()) {
+        PendingFile next = mPending.dequeue();
+        if (next.size == 0)
+            continue;
+
+        mCurrent = next.file;
+        mBytesRemaining = next.size;
+        mFile.setFileName(next.filePath);
+        if (!mFile.open(QIODevice::ReadOnly)) {
+            fail();
+            return false;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void FolderReader::fail()
+{
+    mFailed = true;
+    mChunksWanted = 0;
+    mBytesRemaining = 0;
+    mPending.clear();
+    mFile.close();
+    emit errorOcurred(mFile.fileName());
+}
+
+/*
+ * A chunk is sent as soon as the files queued run out,
+ * it isn't held back to be filled up.
+ */
+void FolderReader::read(int chunks)
+{
+    mChunksWanted += chunks;
+    while (mChunksWanted > 0 && !mFailed) {
+        QByteArray chunk(mChunkSize, Qt::Uninitialized);
+        int chunkSize = 0;
+        int last = -1;
+
+        while (chunkSize < mChunkSize) {
+            if (mBytesRemaining == 0 && !openNext())
+                break;
+
+            qint32 size = static_cast<qint32>(qMin<qint64>(mBytesRemaining, mChunkSize - chunkSize));
+
+            /*
+             * The file shrank since it was listed
+             */
+            if (mFile.read(chunk.data() + chunkSize, size) != size) {
+                fail();
+                return;
+            }
+
+            chunkSize += size;
+            mBytesRemaining -= size;
+            last = mCurrent;
+            if (!mPack)
+                break;
+        }
+
+        if (mFailed || chunkSize == 0)
+            return;
+
+        chunk.resize(chunkSize);
+        mChunksWanted--;
+        emit chunkRead(last, chunk);
+    }
+}
@@ -0,0 +1,79 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FOLDERREADER_H
+#define FOLDERREADER_H
+
+#include <QFile>
+#include <QQueue>
+#include <QObject>
+
+/*
+ * FolderReader reads the files of a folder job one after another
+ * on the reader thread of the folder's disk (see FileReader), ahead
+ * of the FolderSender.
+ * Files are queued with addFile() and read front to back. Empty
+ * files give no chunk.
+ *
+ * When packing, consecutive files are read into the same chunk
+ * (tar style) so many small files go in one Data packet, otherwise
+ * a chunk never spans two files. chunkRead() gives the last file
+ * in the chunk.
+ */
+class FolderReader : public QObject
+{
+    Q_OBJECT
+
+public:
+    FolderReader(const QString& dirPath, qint32 chunkSize, bool pack);
+
+public Q_SLOTS:
+    /*
+     * 'size' bytes of the file are read, the size it had
+     * when it was listed.
+     */
+    void addFile(int file, const QString& filePath, qint64 size);
+    void read(int chunks);
+    void setChunkSize(qint32 chunkSize);
+
+Q_SIGNALS:
+    void chunkRead(int file, const QByteArray& chunk);
+    void errorOcurred(const QString& filePath);
+
+private:
+    struct PendingFile
+    {
+        int file;
+        QString filePath;
+        qint64 size;
+    };
+
+    bool openNext();
+    void fail();
+
+    QQueue<PendingFile> mPending;
+    QFile mFile;
+    int mCurrent;
+    qint64 mBytesRemaining;
+    qint32 mChunkSize;
+    int mChunksWanted;
+    bool mPack;
+    bool mFailed;
+};
+
+#endif // FOLDERREADER_H
@@ -0,0 +1,252 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDir>
+
+#include "folderreceiver.h"
+#include "folderwriter.h"
+#include "fileheader.h"
+#include "manifest.h"
+#include "session.h"
+#include "settings.h"
+#include "util.h"
+
+/*
+ * Reading from the session is suspended while this much received
+ * data waits for the disk, and resumed below half of it.
+ */
+#define MaxWriteBehindSize  16*1024*1024 // 16 MB
+
+FolderReceiver::FolderReceiver(const Device& sender, Session* session, quint32 streamId, QObject* parent)
+    : Transfer(parent), mSenderDev(sender)
+{
+    mWriter = nullptr;
+    mFileCount = 0;
+    mTotalSize = 0;
+    mBytesReceived = 0;
+    mBytesWritten = 0;
+    mReadingSuspended = false;
+
+    setSession(session, streamId);
+    mInfo->setState(TransferState::Waiting);
+
+    mInfo->setTransferType(TransferType::Download);
+    mInfo->setPeer(sender);
+}
+
+FolderReceiver::~FolderReceiver()
+{
+    stopWriter();
+}
+
+bool FolderReceiver::isFolderHeader(const QByteArray& header)
+{
+    FileHeader fileHeader;
+    return FileHeader::parse(header, fileHeader) && fileHeader.has(FileHeader::Folder);
+}
+
+void FolderReceiver::resume()
+{
+    if (mInfo->canResume()) {
+        mInfo->setState(mInfo->getLastState());
+        writePacket(PacketType::Resume, QByteArray());
+    }
+}
+
+void FolderReceiver::pause()
+{
+    if (mInfo->canPause()) {
+        mInfo->setState(TransferState::Paused);
+        writePacket(PacketType::Pause, QByteArray());
+    }
+}
+
+/*
+ * Files already written are kept
+ */
+void FolderReceiver::cancel()
+{
+    if (mInfo->canCancel()) {
+        mInfo->setState(TransferState::Cancelled);
+        mInfo->setProgress(0);
+        writePacket(PacketType::Cancel, QByteArray());
+        detachSession();
+        stopWriter();
+    }
+}
+
+void FolderReceiver::onSessionDisconnected()
+{
+    mSession = nullptr;
+    stopWriter();
+
+    TransferState state = mInfo->getState();
+    if (state == TransferState::Finish || state == TransferState::Cancelled)
+        return;
+
+    mInfo->setState(TransferState::Disconnected);
+    emit mInfo->errorOcurred("Sender disconnected");
+}
+
+void FolderReceiver::processHeaderPacket(QByteArray& data)
+{
+    FileHeader header;
+    if (!FileHeader::parse(data, header) || !Util::isSafePath(QString(), header.name)) {
+        fail(tr("Invalid data received"));
+        return;
+    }
+
+    QString dirPath = Settings::instance()->getDownloadDir();
+    mInfo->setFilePath(dirPath + QDir::separator() + header.name);
+    mInfo->setDataSize(header.size);
+
+    mWriter = new FolderWriter(dirPath);
+    connect(mWriter, &FolderWriter::bytesWritten, this, &FolderReceiver::onBytesWritten);
+    connect(mWriter, &FolderWriter::finished, this, &FolderReceiver::onWriterFinished);
+    connect(mWriter, &FolderWriter::fileFailed, this, [this](const QString& filePath) {
+        mFailedFiles.push_back(filePath);
+    });
+    connect(mWriter, &FolderWriter::errorOcurred, this, [this]() {
+        fail(tr("Invalid data received"));
+    });
+
+    mInfo->setState(TransferState::Transfering);
+    emit mInfo->fileOpened();
+}
+
+void FolderReceiver::processManifestPacket(QByteArray& data)
+{
+    QVector<Manifest::Entry> entries;
+    if (!mWriter || !Manifest::decode(data, entries)) {
+        fail(tr("Invalid data received"));
+        return;
+    }
+
+    for (const Manifest::Entry& entry : entries)
+        mTotalSize += entry.size;
+    mFileCount += entries.size();
+
+    if (mTotalSize > mInfo->getDataSize())
+        mInfo->setDataSize(mTotalSize);
+
+    mWriter->addFiles(entries);
+}
+
+void FolderReceiver::processDataPacket(QByteArray& data)
+{
+    if (!mWriter || mBytesReceived + data.size() > mTotalSize) {
+        fail(tr("Invalid data received"));
+        return;
+    }
+
+    /*
+     * 'data' points into the session's receive buffer,
+     * the writer thread gets its own copy.
+     */
+    mWriter->write(QByteArray(data.constData(), data.size()));
+    mBytesReceived += data.size();
+
+    if (mBytesReceived - mBytesWritten >= MaxWriteBehindSize && !mReadingSuspended)
+        setReadingSuspended(true);
+}
+
+/*
+ * The sender is done, the job is once
+ * the writer has caught up.
+ */
+void FolderReceiver::processFinishPacket(QByteArray& data)
+{
+    QJsonObject obj = QJsonDocument::fromJson(data).object();
+    if (!mWriter || obj.value("files").toInt() != mFileCount || mBytesReceived != mTotalSize) {
+        fail(tr("Invalid data received"));
+        return;
+    }
+
+    detachSession();
+    mWriter->finish();
+}
+
+void FolderReceiver::processCancelPacket(QByteArray& data)
+{
+    Q_UNUSED(data);
+
+    mInfo->setState(TransferState::Cancelled);
+    mInfo->setProgress(0);
+    detachSession();
+    stopWriter();
+}
+
+void FolderReceiver::onBytesWritten(qint64 bytes)
+{
+    mBytesWritten += bytes;
+    if (mTotalSize > 0)
+        mInfo->setProgress( (int)(mBytesWritten * 100 / mTotalSize) );
+
+    if (mReadingSuspended && mBytesReceived - mBytesWritten <= MaxWriteBehindSize / 2)
+        setReadingSuspended(false);
+}
+
+void FolderReceiver::onWriterFinished(bool complete)
+{
+    stopWriter();
+    if (!complete) {
+        fail(tr("Invalid data received"));
+        return;
+    }
+
+    mInfo->setProgress(100);
+    mInfo->setState(TransferState::Finish);
+    if (!mFailedFiles.isEmpty())
+        emit mInfo->errorOcurred(tr("Failed to write %1 files, first one: %2")
+                                 .arg(mFailedFiles.size()).arg(mFailedFiles.first()));
+    emit mInfo->done();
+}
+
+void FolderReceiver::setReadingSuspended(bool suspended)
+{
+    mReadingSuspended = suspended;
+    if (!mSession)
+        return;
+
+    if (suspended)
+        mSession->suspendReading(mStreamId);
+    else
+        mSession->resumeReading(mStreamId);
+}
+
+void FolderReceiver::stopWriter()
+{
+    if (mWriter) {
+        mWriter->deleteLater();
+        mWriter = nullptr;
+    }
+
+    if (mReadingSuspended)
+        setReadingSuspended(false);
+}
+
+void FolderReceiver::fail(const QString& errStr)
+{
+    emit mInfo->errorOcurred(errStr);
+    mInfo->setState(TransferState::Cancelled);
+    writePacket(PacketType::Cancel, QByteArray());
+    detachSession();
+    stopWriter();
+}
@@ -0,0 +1,76 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FOLDERRECEIVER_H
+#define FOLDERRECEIVER_H
+
+#include <QStringList>
+
+#include "transfer.h"
+#include "model/device.h"
+
+class FolderWriter;
+
+/*
+ * FolderReceiver is the receiving end of a FolderSender, every file
+ * listed in the Manifest packets is written under the download
+ * folder by a FolderWriter.
+ */
+class FolderReceiver : public Transfer
+{
+public:
+    FolderReceiver(const Device& sender, Session* session, quint32 streamId, QObject* parent = nullptr);
+    ~FolderReceiver() override;
+
+    inline Device getSender() const { return mSenderDev; }
+
+    /*
+     * True if the header opens a folder job
+     */
+    static bool isFolderHeader(const QByteArray& header);
+
+    void resume() override;
+    void pause() override;
+    void cancel() override;
+
+private:
+    void onSessionDisconnected() override;
+
+    void processHeaderPacket(QByteArray& data) override;
+    void processManifestPacket(QByteArray& data) override;
+    void processDataPacket(QByteArray& data) override;
+    void processFinishPacket(QByteArray& data) override;
+    void processCancelPacket(QByteArray& data) override;
+
+    void onBytesWritten(qint64 bytes);
+    void onWriterFinished(bool complete);
+    void setReadingSuspended(bool suspended);
+    void stopWriter();
+    void fail(const QString& errStr);
+
+    Device mSenderDev;
+    FolderWriter* mWriter;
+    int mFileCount;
+    qint64 mTotalSize;
+    qint64 mBytesReceived;
+    qint64 mBytesWritten;
+    bool mReadingSuspended;
+    QStringList mFailedFiles;
+};
+
+#endif // FOLDERRECEIVER_H
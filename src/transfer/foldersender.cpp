@@ -0,0 +1,409 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDir>
+
+#include "foldersender.h"
+#include "folderreader.h"
+#include "fileheader.h"
+#include "sessionpool.h"
+#include "settings.h"
+
+/*
+ * Files announced by every Manifest packet, at most
+ */
+#define ManifestBatch   1024
+
+FolderSender::FolderSender(const Device& receiver, const QString& dirPath, DirWalker* walker,
+                           QObject* parent)
+    : Transfer(parent), mReceiverDev(receiver), mDirPath(dirPath), mWalker(walker)
+{
+    mWalkDone = false;
+    mTotalSize = 0;
+    mBytesSent = 0;
+
+    mManifest = false;
+    mAnnounced = 0;
+    mAnnouncedSize = 0;
+    mLegacyFile = -1;
+
+    mReader = nullptr;
+    mReadAheadChunks = 0;
+    mChunksRequested = 0;
+    mFileBuffSize = Settings::instance()->getFileBufferSize();
+
+    mCancelled = false;
+    mPaused = false;
+    mPausedByReceiver = false;
+    mIsHeaderSent = false;
+
+    mInfo->setTransferType(TransferType::Upload);
+    mInfo->setPeer(receiver);
+
+    /*
+     * Queued once this is moved to its worker thread
+     */
+    mWalker->addConsumer(this);
+    connect(mWalker, &DirWalker::filesFound, this, &FolderSender::addFiles);
+    connect(mWalker, &DirWalker::finished, this, &FolderSender::onWalkFinished);
+}
+
+FolderSender::~FolderSender()
+{
+    releaseWalker();
+    stopReader();
+}
+
+bool FolderSender::start()
+{
+    mInfo->setFilePath(mDirPath);
+
+    mChunkSize.reset(mFileBuffSize);
+    mFileBuffSize = mChunkSize.chunkSize();
+    mInfo->setChunkSize(mFileBuffSize);
+
+    setSession(SessionPool::instance()->session(mReceiverDev));
+    mInfo->setState(TransferState::Waiting);
+    if (mSession->isReady())
+        onSessionConnected();
+
+    return mSession;
+}
+
+void FolderSender::resume()
+{
+    if (mInfo->canResume()) {
+        mInfo->setState(mInfo->getLastState());
+        mPaused = false;
+        mChunkSize.restartWindow();
+        sendData();
+    }
+}
+
+void FolderSender::pause()
+{
+    if (mInfo->canPause()) {
+        mInfo->setState(TransferState::Paused);
+        mPaused = true;
+    }
+}
+
+void FolderSender::cancel()
+{
+    if (mInfo->canCancel()) {
+        writePacket(PacketType::Cancel, QByteArray());
+        mInfo->setState(TransferState::Cancelled);
+        mInfo->setProgress(0);
+        mCancelled = true;
+        detachSession();
+        stopReader();
+        releaseWalker();
+    }
+}
+
+/*
+ * The files from MaxFileSize on have Senders of their own (MainWindow)
+ */
+void FolderSender::addFiles(const QVector<DirWalker::Entry>& files)
+{
+    if (!mWalker)
+        return;
+
+    for (const DirWalker::Entry& file : files) {
+        if (file.size >= MaxFileSize)
+            continue;
+
+        QString fileName = file.filePath.mid(file.filePath.lastIndexOf('/') + 1);
+        mFiles.enqueue({ { file.folder, fileName, file.size }, file.filePath });
+        mTotalSize += file.size;
+    }
+
+    mInfo->setDataSize(mTotalSize);
+    reportBacklog();
+    sendData();
+}
+
+void FolderSender::onWalkFinished()
+{
+    mWalkDone = true;
+    sendData();
+}
+
+void FolderSender::reportBacklog()
+{
+    if (mWalker)
+        QMetaObject::invokeMethod(mWalker, "setBacklog", Qt::QueuedConnection,
+                                  Q_ARG(QObject*, this), Q_ARG(int, mFiles.size()));
+}
+
+/*
+ * The walker outlives its consumers, it is still there
+ */
+void FolderSender::releaseWalker()
+{
+    if (mWalker) {
+        QMetaObject::invokeMethod(mWalker, "removeConsumer", Qt::QueuedConnection, Q_ARG(QObject*, this));
+        mWalker = nullptr;
+    }
+
+    mFiles.clear();
+}
+
+void FolderSender::onSessionConnected()
+{
+    mInfo->setState(TransferState::Transfering);
+    mManifest = mSession->peerSupports(Session::CapManifest);
+    sendHeader();
+    sendData();
+}
+
+void FolderSender::onSessionWritable()
+{
+    sendData();
+}
+
+void FolderSender::onSessionDisconnected()
+{
+    mSession = nullptr;
+    stopReader();
+    releaseWalker();
+
+    TransferState state = mInfo->getState();
+    if (mCancelled || state == TransferState::Finish)
+        return;
+
+    mInfo->setState(TransferState::Disconnected);
+    emit mInfo->errorOcurred(tr("Receiver disconnected"));
+}
+
+/*
+ * Without manifest every file has its own header
+ * (openLegacyFile()). The size grows with the manifests.
+ */
+void FolderSender::sendHeader()
+{
+    if (mManifest) {
+        FileHeader header;
+        header.name = QDir(mDirPath).dirName();
+        header.size = mTotalSize;
+        header.flags = FileHeader::Folder;
+        writeHeader(header);
+    }
+
+    mIsHeaderSent = true;
+}
+
+void FolderSender::announceFiles()
+{
+    int count = qMin(ManifestBatch, mFiles.size());
+    QVector<Manifest::Entry> entries;
+    entries.reserve(count);
+
+    for (int i = 0; i < count; i++) {
+        File file = mFiles.dequeue();
+        mAnnouncedSize += file.entry.size;
+        QMetaObject::invokeMethod(mReader, "addFile", Qt::QueuedConnection, Q_ARG(int, mAnnounced + i),
+                                  Q_ARG(QString, file.filePath), Q_ARG(qint64, file.entry.size));
+
+        if (mManifest)
+            entries.push_back(file.entry);
+        else
+            mLegacyEntries.enqueue(file.entry);
+    }
+
+    if (mManifest)
+        writePacket(PacketType::Manifest, Manifest::encode(entries, 0, count));
+
+    mAnnounced += count;
+    reportBacklog();
+}
+
+/*
+ * Finish the stream of the current file and open one for every
+ * file up to 'file', empty files have no data.
+ */
+void FolderSender::openLegacyFile(int file)
+{
+    while (mLegacyFile < file) {
+        if (mLegacyFile >= 0) {
+            Session* session = mSession;
+            writePacket(PacketType::Finish, QByteArray());
+            detachSession();
+            setSession(session);
+        }
+
+        mLegacyFile++;
+        Manifest::Entry entry = mLegacyEntries.dequeue();
+
+        FileHeader header;
+        header.name = entry.name;
+        header.folder = entry.folder;
+        header.size = entry.size;
+        writeHeader(header);
+    }
+}
+
+void FolderSender::sendData()
+{
+    if (!mIsHeaderSent || mCancelled || mPaused || mPausedByReceiver || !mSession)
+        return;
+
+    if (!mReader)
+        startReader();
+
+    while (!mFiles.isEmpty() && mAnnouncedSize - mBytesSent < Settings::instance()->getReadAheadSize())
+        announceFiles();
+
+    if (isDone()) {
+        finish();
+        return;
+    }
+
+    /*
+     * Nothing read yet, onChunkRead() comes back
+     */
+    if (!mSession->canWrite() || mReadyChunks.isEmpty())
+        return;
+
+    Chunk chunk = mReadyChunks.dequeue();
+    mChunksRequested--;
+    requestChunks();
+
+    if (!mManifest)
+        openLegacyFile(chunk.file);
+
+    writePacket(PacketType::Data, chunk.data);
+    mBytesSent += chunk.data.size();
+    mInfo->setProgress( (int) (mBytesSent * 100 / mTotalSize) );
+    addChunkSent(chunk.data.size());
+
+    if (isDone())
+        finish();
+}
+
+/*
+ * The receiver checks it got every file
+ */
+void FolderSender::finish()
+{
+    if (mManifest) {
+        QJsonObject obj;
+        obj.insert("files", mAnnounced);
+        writePacket(PacketType::Finish, QJsonDocument(obj).toJson(QJsonDocument::Compact));
+    }
+    else if (mAnnounced > 0) {
+        openLegacyFile(mAnnounced - 1);
+        writePacket(PacketType::Finish, QByteArray());
+    }
+
+    detachSession();
+    stopReader();
+    releaseWalker();
+
+    mInfo->setProgress(100);
+    mInfo->setState(TransferState::Finish);
+    emit mInfo->done();
+}
+
+void FolderSender::addChunkSent(qint64 bytes)
+{
+    if (!mChunkSize.addSent(bytes) || !mChunkSize.adjust(mSession->roundTripTime()))
+        return;
+
+    mFileBuffSize = mChunkSize.chunkSize();
+    mInfo->setChunkSize(mFileBuffSize);
+    mReadAheadChunks = qMax(2, Settings::instance()->getReadAheadSize() / mFileBuffSize);
+    QMetaObject::invokeMethod(mReader, "setChunkSize", Qt::QueuedConnection, Q_ARG(qint32, mFileBuffSize));
+}
+
+void FolderSender::startReader()
+{
+    mReader = new FolderReader(mDirPath, mFileBuffSize, mManifest);
+    mReadAheadChunks = qMax(2, Settings::instance()->getReadAheadSize() / mFileBuffSize);
+    mChunksRequested = 0;
+
+    connect(mReader, &FolderReader::chunkRead, this, &FolderSender::onChunkRead);
+    connect(mReader, &FolderReader::errorOcurred, this, [this](const QString& filePath) {
+        emit mInfo->errorOcurred(tr("Error while reading ") + filePath);
+        cancel();
+    });
+
+    requestChunks();
+}
+
+void FolderSender::stopReader()
+{
+    if (mReader) {
+        mReader->deleteLater();
+        mReader = nullptr;
+    }
+
+    mReadyChunks.clear();
+}
+
+void FolderSender::requestChunks()
+{
+    int chunks = mReadAheadChunks - mChunksRequested;
+    if (chunks <= 0)
+        return;
+
+    mChunksRequested += chunks;
+    QMetaObject::invokeMethod(mReader, "read", Qt::QueuedConnection, Q_ARG(int, chunks));
+}
+
+void FolderSender::onChunkRead(int file, QByteArray chunk)
+{
+    /*
+     * Left over from a reader that has been stopped
+     */
+    if (!mReader)
+        return;
+
+    mReadyChunks.enqueue({ file, chunk });
+    sendData();
+}
+
+void FolderSender::processCancelPacket(QByteArray& data)
+{
+    Q_UNUSED(data);
+
+    mInfo->setState(TransferState::Cancelled);
+    mInfo->setProgress(0);
+    mCancelled = true;
+    detachSession();
+    stopReader();
+    releaseWalker();
+}
+
+void FolderSender::processPausePacket(QByteArray& data)
+{
+    Q_UNUSED(data);
+
+    mPausedByReceiver = true;
+}
+
+void FolderSender::processResumePacket(QByteArray& data)
+{
+    Q_UNUSED(data);
+
+    mPausedByReceiver = false;
+    mChunkSize.restartWindow();
+    sendData();
+}
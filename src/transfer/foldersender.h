@@ -0,0 +1,152 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FOLDERSENDER_H
+#define FOLDERSENDER_H
+
+#include <QQueue>
+
+#include "transfer.h"
+#include "manifest.h"
+#include "dirwalker.h"
+#include "chunksizecontrol.h"
+#include "model/device.h"
+
+class FolderReader;
+
+/*
+ * FolderSender sends the small files of a folder as one job over a
+ * single stream: a Header (FileHeader::Folder), the list of files in
+ * Manifest packets and the contents of the files back to back in Data
+ * packets, without a header or a Finish for every file.
+ *
+ * The files come from a DirWalker while it walks the folder, the job
+ * starts with the first ones and ends once the walk is over.
+ *
+ * A receiver without Session::CapManifest gets every file as a plain
+ * file on a stream of its own, one after another.
+ */
+class FolderSender : public Transfer
+{
+public:
+    /*
+     * Files from this size on are sent by a Sender of their own,
+     * which negotiates resume, delta transfer and striping.
+     */
+    static constexpr qint64 MaxFileSize = 1024*1024;
+
+    /*
+     * Takes the files below MaxFileSize found by 'walker', which
+     * must not be started yet.
+     */
+    FolderSender(const Device& receiver, const QString& dirPath, DirWalker* walker,
+                 QObject* parent = nullptr);
+    ~FolderSender() override;
+
+    bool start();
+
+    Device getReceiver() const { return mReceiverDev; }
+
+    void resume() override;
+    void pause() override;
+    void cancel() override;
+
+private:
+    /*
+     * Chunk of file number 'file'
+     */
+    struct Chunk
+    {
+        int file;
+        QByteArray data;
+    };
+
+    struct File
+    {
+        Manifest::Entry entry;
+        QString filePath;
+    };
+
+    void onSessionConnected() override;
+    void onSessionWritable() override;
+    void onSessionDisconnected() override;
+
+    void addFiles(const QVector<DirWalker::Entry>& files);
+    void onWalkFinished();
+    void reportBacklog();
+    void releaseWalker();
+
+    void sendHeader();
+    void announceFiles();
+    void openLegacyFile(int file);
+    void sendData();
+    void finish();
+    void startReader();
+    void stopReader();
+    void requestChunks();
+    void onChunkRead(int file, QByteArray chunk);
+    void addChunkSent(qint64 bytes);
+    inline bool isDone() const { return mWalkDone && mFiles.isEmpty() && mBytesSent == mAnnouncedSize; }
+
+    void processCancelPacket(QByteArray& data) override;
+    void processPausePacket(QByteArray& data) override;
+    void processResumePacket(QByteArray& data) override;
+
+    Device mReceiverDev;
+    QString mDirPath;
+
+    /*
+     * Files found and not announced yet, the walker is gone
+     * (nullptr) once the job is over.
+     */
+    DirWalker* mWalker;
+    QQueue<File> mFiles;
+    bool mWalkDone;
+    qint64 mTotalSize;
+    qint64 mBytesSent;
+
+    /*
+     * Files are announced (Manifest packets) and handed to the
+     * reader in batches, about a read-ahead worth of data before
+     * it is sent.
+     */
+    bool mManifest;
+    int mAnnounced;
+    qint64 mAnnouncedSize;
+
+    /*
+     * Without manifest, the file whose stream is open and
+     * the files announced after it
+     */
+    int mLegacyFile;
+    QQueue<Manifest::Entry> mLegacyEntries;
+
+    FolderReader* mReader;
+    QQueue<Chunk> mReadyChunks;
+    int mReadAheadChunks;
+    int mChunksRequested;
+    qint32 mFileBuffSize;
+    ChunkSizeControl mChunkSize;
+
+    bool mCancelled;
+    bool mPaused;
+    bool mPausedByReceiver;
+    bool mIsHeaderSent;
+};
+
+#endif // FOLDERSENDER_H
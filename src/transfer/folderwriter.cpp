@@ -0,0 +1,138 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDir>
+
+#include "folderwriter.h"
+#include "filewriter.h"
+#include "settings.h"
+#include "util.h"
+
+FolderWriter::FolderWriter(const QString& dirPath)
+    : QObject(nullptr), mDirPath(dirPath), mBytesRemaining(0), mFileFailed(false)
+{
+    QThread* thread = FileWriter::writerThread(dirPath);
+    moveToThread(thread);
+    mFile.moveToThread(thread);
+}
+
+void FolderWriter::addFiles(const QVector<Manifest::Entry>& entries)
+{
+    QMetaObject::invokeMethod(this, [this, entries]() { onFilesAdded(entries); }, Qt::QueuedConnection);
+}
+
+void FolderWriter::write(const QByteArray& data)
+{
+    QMetaObject::invokeMethod(this, [this, data]() { onWriteRequested(data); }, Qt::QueuedConnection);
+}
+
+void FolderWriter::finish()
+{
+    QMetaObject::invokeMethod(this, [this]() {
+        mFile.close();
+        emit finished(mBytesRemaining == 0 && mPending.isEmpty());
+    }, Qt::QueuedConnection);
+}
+
+void FolderWriter::onFilesAdded(const QVector<Manifest::Entry>& entries)
+{
+    for (const Manifest::Entry& entry : entries)
+        mPending.enqueue(entry);
+
+    if (mBytesRemaining == 0)
+        nextFile();
+}
+
+void FolderWriter::onWriteRequested(const QByteArray& data)
+{
+    const char* p = data.constData();
+    qint64 left = data.size();
+    while (left > 0) {
+        if (mBytesRemaining == 0) {
+            emit errorOcurred();
+            return;
+        }
+
+        qint64 len = qMin(left, mBytesRemaining);
+        if (!mFileFailed && mFile.write(p, len) != len)
+            failFile();
+
+        p += len;
+        left -= len;
+        mBytesRemaining -= len;
+        if (mBytesRemaining == 0)
+            nextFile();
+    }
+
+    emit bytesWritten(data.size());
+}
+
+/*
+ * Close the current file and create the next ones up to
+ * the first one that takes data, empty files are done
+ * once created.
+ */
+void FolderWriter::nextFile()
+{
+    mFile.close();
+    while (!mPending.isEmpty()) {
+        Manifest::Entry entry = mPending.dequeue();
+        mBytesRemaining = entry.size;
+        mFileFailed = false;
+
+        QString folderPath = mDirPath;
+        if (!entry.folder.isEmpty())
+            folderPath = folderPath + QDir::separator() + entry.folder;
+
+        if (!Util::isSafePath(entry.folder, entry.name)) {
+            mFile.setFileName(folderPath + QDir::separator() + entry.name);
+            mFileFailed = true;
+            emit fileFailed(mFile.fileName());
+        }
+        else {
+            if (folderPath != mLastFolder) {
+                QDir().mkpath(folderPath);
+                mLastFolder = folderPath;
+            }
+
+            QString filePath = folderPath + QDir::separator() + entry.name;
+            if (!Settings::instance()->getReplaceExistingFile())
+                filePath = Util::getUniqueFileName(entry.name, folderPath);
+
+            mFile.setFileName(filePath);
+            if (!mFile.open(QIODevice::WriteOnly))
+                failFile();
+        }
+
+        if (mBytesRemaining > 0)
+            return;
+
+        mFile.close();
+    }
+}
+
+void FolderWriter::failFile()
+{
+    mFileFailed = true;
+    if (mFile.isOpen()) {
+        mFile.close();
+        mFile.remove();
+    }
+
+    emit fileFailed(mFile.fileName());
+}
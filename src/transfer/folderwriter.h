@@ -0,0 +1,77 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FOLDERWRITER_H
+#define FOLDERWRITER_H
+
+#include <QFile>
+#include <QQueue>
+#include <QObject>
+
+#include "manifest.h"
+
+/*
+ * FolderWriter writes the files of a folder job on the writer thread
+ * of their disk (see FileWriter). The data written is the contents
+ * of the files added with addFiles() back to back, it is cut into
+ * the files in that order. Both can be called from any thread.
+ *
+ * A file that can't be written is reported with fileFailed() and
+ * its data dropped, the other files are still written.
+ */
+class FolderWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FolderWriter(const QString& dirPath);
+
+    void addFiles(const QVector<Manifest::Entry>& entries);
+    void write(const QByteArray& data);
+
+    /*
+     * Answered with finished() once everything before it is
+     * written, 'complete' if every file listed got its data.
+     */
+    void finish();
+
+Q_SIGNALS:
+    void bytesWritten(qint64 bytes);
+    void finished(bool complete);
+    void fileFailed(const QString& filePath);
+
+    /*
+     * More data than the files listed
+     */
+    void errorOcurred();
+
+private:
+    void onFilesAdded(const QVector<Manifest::Entry>& entries);
+    void onWriteRequested(const QByteArray& data);
+    void nextFile();
+    void failFile();
+
+    QString mDirPath;
+    QString mLastFolder;
+    QQueue<Manifest::Entry> mPending;
+    QFile mFile;
+    qint64 mBytesRemaining;
+    bool mFileFailed;
+};
+
+#endif // FOLDERWRITER_H
@@ -0,0 +1,272 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QDir>
+#include <QtEndian>
+#include <algorithm>
+
+#include "hashcache.h"
+#include "checksum.h"
+#include "settings.h"
+
+#if defined (Q_OS_UNIX)
+#include <sys/stat.h>
+#endif
+
+#define HashCacheFileName   "LANSHashCache"
+#define HashCacheMagic      0x4348534c // "LSHC"
+#define HashCacheVersion    1
+#define MaxHashCacheSize    64*1024*1024 // 64 MB
+
+/*
+ * Cache file, little endian: magic and version, then one entry
+ * after the other. An entry is device, inode, size, mtime, last
+ * use, number of blocks and the hash of every block.
+ */
+#define FileHeaderSize      8
+#define EntryHeaderSize     44
+
+HashCache::HashCache(QObject* parent)
+    : QObject(parent), mMap(nullptr), mMapSize(0), mDirty(false)
+{
+#if defined (Q_OS_WIN)
+    QString dirPath = QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation);
+#else
+    QString dirPath = QFileInfo(QSettings(SETTINGS_FILE).fileName()).absolutePath();
+#endif
+    QDir().mkpath(dirPath);
+    mFilePath = dirPath + QDir::separator() + HashCacheFileName;
+
+    load();
+    connect(qApp, &QCoreApplication::aboutToQuit, this, &HashCache::save);
+}
+
+HashCache::~HashCache()
+{
+    unload();
+}
+
+HashCache* HashCache::instance()
+{
+    static HashCache* obj = new HashCache(qApp);
+    return obj;
+}
+
+bool HashCache::identify(const QString& filePath, FileKey& key, qint64& size, qint64& mtime)
+{
+    QFileInfo info(filePath);
+    if (!info.isFile())
+        return false;
+
+    size = info.size();
+    mtime = info.lastModified().toMSecsSinceEpoch();
+
+#if defined (Q_OS_UNIX)
+    struct stat st;
+    if (stat(QFile::encodeName(info.absoluteFilePath()).constData(), &st) != 0)
+        return false;
+
+    key = FileKey(static_cast<quint64>(st.st_dev), static_cast<quint64>(st.st_ino));
+#else
+    /*
+     * No inode, the path stands in for it
+     */
+    QByteArray path = info.absoluteFilePath().toUtf8();
+    key = FileKey(0, FileChecksum::hash(path.constData(), path.size()));
+#endif
+
+    return true;
+}
+
+bool HashCache::lookup(const QString& filePath, QVector<quint64>& blockHashes)
+{
+    FileKey key;
+    qint64 size, mtime;
+    if (!identify(filePath, key, size, mtime))
+        return false;
+
+    QMutexLocker locker(&mMutex);
+    auto it = mEntries.find(key);
+    if (it == mEntries.end())
+        return false;
+
+    /*
+     * The file has changed since it was hashed
+     */
+    if (it.value().size != size || it.value().mtime != mtime) {
+        mEntries.erase(it);
+        mDirty = true;
+        return false;
+    }
+
+    blockHashes = hashesOf(it.value());
+    it.value().lastUsed = QDateTime::currentMSecsSinceEpoch();
+    mDirty = true;
+    return true;
+}
+
+void HashCache::insert(const QString& filePath, const QVector<quint64>& blockHashes)
+{
+    FileKey key;
+    qint64 size, mtime;
+    if (!identify(filePath, key, size, mtime))
+        return;
+
+    Entry entry;
+    entry.size = size;
+    entry.mtime = mtime;
+    entry.lastUsed = QDateTime::currentMSecsSinceEpoch();
+    entry.mapOffset = -1;
+    entry.count = blockHashes.size();
+    entry.hashes = blockHashes;
+
+    QMutexLocker locker(&mMutex);
+    mEntries.insert(key, entry);
+    mDirty = true;
+}
+
+QVector<quint64> HashCache::hashesOf(const Entry& entry) const
+{
+    if (entry.mapOffset < 0)
+        return entry.hashes;
+
+    QVector<quint64> hashes(entry.count);
+    const uchar* p = mMap + entry.mapOffset;
+    for (int i = 0; i < entry.count; i++)
+        hashes[i] = qFromLittleEndian<quint64>(p + i * sizeof(quint64));
+
+    return hashes;
+}
+
+void HashCache::load()
+{
+    mFile.setFileName(mFilePath);
+    if (!mFile.open(QIODevice::ReadOnly))
+        return;
+
+    mMapSize = mFile.size();
+    if (mMapSize >= FileHeaderSize)
+        mMap = mFile.map(0, mMapSize);
+
+    if (!mMap || qFromLittleEndian<quint32>(mMap) != HashCacheMagic ||
+            qFromLittleEndian<quint32>(mMap + 4) != HashCacheVersion) {
+        unload();
+        return;
+    }
+
+    /*
+     * Only the entry headers are read now, the hashes
+     * when they are looked up.
+     */
+    qint64 offset = FileHeaderSize;
+    while (offset + EntryHeaderSize <= mMapSize) {
+        const uchar* p = mMap + offset;
+        FileKey key(qFromLittleEndian<quint64>(p), qFromLittleEndian<quint64>(p + 8));
+
+        Entry entry;
+        entry.size = qFromLittleEndian<qint64>(p + 16);
+        entry.mtime = qFromLittleEndian<qint64>(p + 24);
+        entry.lastUsed = qFromLittleEndian<qint64>(p + 32);
+        entry.count = qFromLittleEndian<qint32>(p + 40);
+        entry.mapOffset = offset + EntryHeaderSize;
+
+        qint64 next = entry.mapOffset + static_cast<qint64>(entry.count) * sizeof(quint64);
+        if (entry.count < 0 || next > mMapSize)
+            break;
+
+        mEntries.insert(key, entry);
+        offset = next;
+    }
+}
+
+void HashCache::unload()
+{
+    if (mMap)
+        mFile.unmap(mMap);
+
+    mMap = nullptr;
+    mMapSize = 0;
+    mFile.close();
+}
+
+/*
+ * Rewrites the cache file with the most recently used entries
+ * that fit in MaxHashCacheSize.
+ */
+void HashCache::save()
+{
+    QMutexLocker locker(&mMutex);
+    if (!mDirty)
+        return;
+
+    QVector<FileKey> keys = mEntries.keys().toVector();
+    std::sort(keys.begin(), keys.end(), [this](const FileKey& a, const FileKey& b) {
+        return mEntries.value(a).lastUsed > mEntries.value(b).lastUsed;
+    });
+
+    QSaveFile file(mFilePath);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    char header[FileHeaderSize];
+    qToLittleEndian<quint32>(HashCacheMagic, header);
+    qToLittleEndian<quint32>(HashCacheVersion, header + 4);
+    file.write(header, FileHeaderSize);
+
+    qint64 total = FileHeaderSize;
+    for (const FileKey& key : keys) {
+        const Entry entry = mEntries.value(key);
+        qint64 size = EntryHeaderSize + static_cast<qint64>(entry.count) * sizeof(quint64);
+        if (total + size > MaxHashCacheSize) {
+            mEntries.remove(key);
+            continue;
+        }
+
+        QByteArray data(static_cast<int>(size), Qt::Uninitialized);
+        char* p = data.data();
+        qToLittleEndian<quint64>(key.first, p);
+        qToLittleEndian<quint64>(key.second, p + 8);
+        qToLittleEndian<qint64>(entry.size, p + 16);
+        qToLittleEndian<qint64>(entry.mtime, p + 24);
+        qToLittleEndian<qint64>(entry.lastUsed, p + 32);
+        qToLittleEndian<qint32>(entry.count, p + 40);
+
+        const QVector<quint64> hashes = hashesOf(entry);
+        for (int i = 0; i < hashes.size(); i++)
+            qToLittleEndian<quint64>(hashes.at(i), p + EntryHeaderSize + i * sizeof(quint64));
+
+        file.write(data);
+        total += size;
+    }
+
+    /*
+     * The old file can't be replaced while it is mapped (Windows),
+     * the new one is mapped instead.
+     */
+    mEntries.clear();
+    unload();
+    file.commit();
+    load();
+    mDirty = false;
+}
@@ -0,0 +1,91 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HASHCACHE_H
+#define HASHCACHE_H
+
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QVector>
+
+/*
+ * HashCache remembers the block hashes of files (see FileChecksum)
+ * across runs, so an unchanged file is not read again to hash it.
+ * Files are identified by device and inode, an entry is only valid
+ * for the size and mtime it was made for and is dropped on the next
+ * lookup otherwise. The least recently used entries go when the
+ * cache grows beyond its size limit.
+ *
+ * The cache file lives next to the config file, it is memory mapped
+ * at startup and rewritten on exit. Thread safe.
+ */
+class HashCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    static HashCache* instance();
+    ~HashCache() override;
+
+    bool lookup(const QString& filePath, QVector<quint64>& blockHashes);
+    void insert(const QString& filePath, const QVector<quint64>& blockHashes);
+
+    void save();
+
+private:
+    /*
+     * Device and inode
+     */
+    typedef QPair<quint64, quint64> FileKey;
+
+    struct Entry
+    {
+        qint64 size;
+        qint64 mtime;
+        qint64 lastUsed;
+
+        /*
+         * Hashes are read from the mapped file ('count' of them at
+         * 'mapOffset') until the entry is replaced.
+         */
+        qint64 mapOffset;
+        int count;
+        QVector<quint64> hashes;
+    };
+
+    explicit HashCache(QObject* parent = nullptr);
+
+    static bool identify(const QString& filePath, FileKey& key, qint64& size, qint64& mtime);
+    QVector<quint64> hashesOf(const Entry& entry) const;
+    void load();
+    void unload();
+
+    QString mFilePath;
+    QFile mFile;
+    uchar* mMap;
+    qint64 mMapSize;
+
+    QHash<FileKey, Entry> mEntries;
+    bool mDirty;
+    QMutex mMutex;
+};
+
+#endif // HASHCACHE_H
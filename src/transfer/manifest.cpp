@@ -0,0 +1,59 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtEndian>
+
+#include "manifest.h"
+#include "fileheader.h"
+
+QByteArray Manifest::encode(const QVector<Entry>& entries, int first, int count)
+{
+    QByteArray data;
+    for (int i = first; i < first + count; i++) {
+        const Entry& entry = entries.at(i);
+
+        char size[sizeof(qint64)];
+        qToLittleEndian<qint64>(entry.size, size);
+        data.append(size, sizeof(size));
+        FileHeader::appendString(data, entry.folder);
+        FileHeader::appendString(data, entry.name);
+    }
+
+    return data;
+}
+
+bool Manifest::decode(const QByteArray& data, QVector<Entry>& entries)
+{
+    const char* p = data.constData();
+    const char* end = p + data.size();
+    while (p < end) {
+        Entry entry;
+        if (end - p < static_cast<int>(sizeof(qint64)))
+            return false;
+
+        entry.size = qFromLittleEndian<qint64>(p);
+        p += sizeof(qint64);
+        if (entry.size < 0 || !FileHeader::readString(p, end, entry.folder) ||
+                !FileHeader::readString(p, end, entry.name))
+            return false;
+
+        entries.push_back(entry);
+    }
+
+    return true;
+}
@@ -0,0 +1,53 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+/*
+ * Manifest lists the files of a folder job, a Manifest packet carries
+ * a batch of entries (little endian):
+ *
+ * entry --> size (8 bytes) | folder | name
+ *
+ * with both strings as in FileHeader. The contents of the listed files
+ * follow back to back in the stream's Data packets, in the same order.
+ */
+class Manifest
+{
+public:
+    struct Entry
+    {
+        QString folder;
+        QString name;
+        qint64 size;
+    };
+
+    static QByteArray encode(const QVector<Entry>& entries, int first, int count);
+
+    /*
+     * Appends the entries in 'data' to 'entries'
+     */
+    static bool decode(const QByteArray& data, QVector<Entry>& entries);
+};
+
+#endif // MANIFEST_H
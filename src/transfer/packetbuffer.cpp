@@ -0,0 +1,82 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+
+#include "packetbuffer.h"
+
+PacketBuffer::PacketBuffer(int capacity)
+    : mCapacity(qMin(capacity, MaxCapacity)), mBegin(0), mEnd(0)
+{
+}
+
+/*
+ * Make sure there are at least 'len' free bytes at the tail
+ * and return a pointer to them.
+ */
+char* PacketBuffer::reserve(int len)
+{
+    if (mBuff.size() - mEnd >= len)
+        return mBuff.data() + mEnd;
+
+    /*
+     * Move the incomplete packet to the front.
+     */
+    int remaining = size();
+    if (mBegin > 0) {
+        if (remaining > 0)
+            memmove(mBuff.data(), mBuff.constData() + mBegin, remaining);
+        mBegin = 0;
+        mEnd = remaining;
+    }
+
+    /*
+     * Packet is bigger than the buffer, grow it.
+     */
+    if (mBuff.size() - mEnd < len) {
+        if (len > MaxCapacity - mEnd)
+            return nullptr;
+
+        mBuff.resize(qMin(qMax(qMax(mBuff.size() * 2, mCapacity), mEnd + len), MaxCapacity));
+    }
+
+    return mBuff.data() + mEnd;
+}
+
+void PacketBuffer::commit(int len)
+{
+    mEnd = qMin(mEnd + len, mBuff.size());
+}
+
+void PacketBuffer::consume(int len)
+{
+    mBegin = qMin(mBegin + len, mEnd);
+    if (mBegin == mEnd)
+        mBegin = mEnd = 0;
+}
+
+void PacketBuffer::clear()
+{
+    mBegin = mEnd = 0;
+    mBuff.clear();
+}
+
+QByteArray PacketBuffer::view(int offset, int len) const
+{
+    return QByteArray::fromRawData(data() + offset, len);
+}
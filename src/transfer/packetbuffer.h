@@ -0,0 +1,79 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PACKETBUFFER_H
+#define PACKETBUFFER_H
+
+#include <QByteArray>
+
+/*
+ * PacketBuffer is the receive buffer of a connection. Socket data is read
+ * straight into its tail (reserve + commit) and packets are parsed in place.
+ *
+ * Consuming a packet only advances the read offset. The bytes not consumed
+ * yet are moved to the front when the tail runs out of room.
+ *
+ * Nothing is allocated until the first reserve(). The buffer then starts
+ * at DefaultCapacity and grows for a packet that doesn't fit, up to
+ * MaxCapacity: one packet of MaxPacketSize and one more socket read.
+ */
+class PacketBuffer
+{
+public:
+    explicit PacketBuffer(int capacity = DefaultCapacity);
+
+    inline int size() const { return mEnd - mBegin; }
+    inline int capacity() const { return mBuff.size(); }
+    inline bool isEmpty() const { return mBegin == mEnd; }
+    inline const char* data() const { return mBuff.constData() + mBegin; }
+
+    /*
+     * nullptr when 'len' more bytes would go past MaxCapacity
+     */
+    char* reserve(int len);
+    void commit(int len);
+    void consume(int len);
+    /*
+     * Also frees the memory
+     */
+    void clear();
+
+    /*
+     * Read-only view into the buffer, valid until the next
+     * reserve/consume/clear.
+     */
+    QByteArray view(int offset, int len) const;
+
+    static constexpr int DefaultCapacity = 256 * 1024;
+
+    /*
+     * Largest payload a peer may send. The biggest legal packet is a
+     * delta signature (20 MB at MaxBlockCount blocks), a longer one
+     * is a broken or hostile peer.
+     */
+    static constexpr int MaxPacketSize = 32 * 1024 * 1024;
+    static constexpr int MaxCapacity = MaxPacketSize + 1024 * 1024;
+
+private:
+    int mCapacity;
+    QByteArray mBuff;
+    int mBegin;
+    int mEnd;
+};
+
+#endif // PACKETBUFFER_H
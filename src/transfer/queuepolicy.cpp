@@ -0,0 +1,87 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "queuepolicy.h"
+
+QueuePolicy* QueuePolicy::create(Type type)
+{
+    switch (type) {
+    case Type::ShortestFirst : return new ShortestFirstPolicy;
+    case Type::FairShare : return new FairSharePolicy;
+    default : return new FifoPolicy;
+    }
+}
+
+int QueuePolicy::choose(const QVector<Candidate>& peers) const
+{
+    int best = 0;
+    for (int i = 1; i < peers.size(); i++) {
+        const Candidate& p = peers.at(i);
+        const Candidate& b = peers.at(best);
+        if (p.priority > b.priority || (p.priority == b.priority && p.order < b.order))
+            best = i;
+    }
+
+    return best;
+}
+
+qint64 FifoPolicy::order(quint64 id, qint64 size) const
+{
+    Q_UNUSED(size);
+
+    return static_cast<qint64>(id);
+}
+
+qint64 ShortestFirstPolicy::order(quint64 id, qint64 size) const
+{
+    Q_UNUSED(id);
+
+    return size;
+}
+
+qint64 FairSharePolicy::order(quint64 id, qint64 size) const
+{
+    Q_UNUSED(size);
+
+    return static_cast<qint64>(id);
+}
+
+/*
+ * Priority still comes first
+ */
+int FairSharePolicy::choose(const QVector<Candidate>& peers) const
+{
+    int best = 0;
+    for (int i = 1; i < peers.size(); i++) {
+        const Candidate& p = peers.at(i);
+        const Candidate& b = peers.at(best);
+        if (p.priority != b.priority) {
+            if (p.priority > b.priority)
+                best = i;
+        }
+        else if (p.active != b.active) {
+            if (p.active < b.active)
+                best = i;
+        }
+        else if (p.lastStarted < b.lastStarted) {
+            best = i;
+        }
+    }
+
+    return best;
+}
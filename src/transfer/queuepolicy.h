@@ -0,0 +1,105 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUEUEPOLICY_H
+#define QUEUEPOLICY_H
+
+#include <QVector>
+
+/*
+ * QueuePolicy decides in which order TransferQueue starts the files
+ * waiting in it. Every receiver has a queue of its own, ordered by
+ * priority then by order(). When a Sender may start, choose() picks
+ * the receiver among those below their limit.
+ */
+class QueuePolicy
+{
+public:
+    enum class Type {
+        Fifo,
+        ShortestFirst,
+        FairShare
+    };
+
+    struct Candidate
+    {
+        /*
+         * Of the first file in the receiver's queue
+         */
+        int priority;
+        qint64 order;
+
+        /*
+         * Senders active for the receiver and when the last
+         * one started (a count of starts)
+         */
+        int active;
+        quint64 lastStarted;
+    };
+
+    static QueuePolicy* create(Type type);
+    virtual ~QueuePolicy() = default;
+
+    virtual Type type() const = 0;
+
+    /*
+     * 'id' grows with every file queued
+     */
+    virtual qint64 order(quint64 id, qint64 size) const = 0;
+
+    /*
+     * Index in 'peers', the first file of the highest
+     * priority and lowest order by default.
+     */
+    virtual int choose(const QVector<Candidate>& peers) const;
+};
+
+/*
+ * Files start in the order they were queued
+ */
+class FifoPolicy : public QueuePolicy
+{
+public:
+    Type type() const override { return Type::Fifo; }
+    qint64 order(quint64 id, qint64 size) const override;
+};
+
+/*
+ * Smallest files first, the lowest mean time to complete
+ */
+class ShortestFirstPolicy : public QueuePolicy
+{
+public:
+    Type type() const override { return Type::ShortestFirst; }
+    qint64 order(quint64 id, qint64 size) const override;
+};
+
+/*
+ * Receivers take turns, the one with the fewest active Senders
+ * starts next. Files of a receiver start in the order they were
+ * queued.
+ */
+class FairSharePolicy : public QueuePolicy
+{
+public:
+    Type type() const override { return Type::FairShare; }
+    qint64 order(quint64 id, qint64 size) const override;
+    int choose(const QVector<Candidate>& peers) const override;
+};
+
+#endif // QUEUEPOLICY_H
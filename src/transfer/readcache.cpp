@@ -0,0 +1,155 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QFile>
+#include <QThreadStorage>
+
+#include "readcache.h"
+
+/*
+ * Blocks a file keeps for the readers behind
+ */
+#define MaxSharedBlocks     32  // 32 MB
+
+ReadCache* ReadCache::instance()
+{
+    static QThreadStorage<ReadCache*> caches;
+    if (!caches.hasLocalData())
+        caches.setLocalData(new ReadCache);
+
+    return caches.localData();
+}
+
+void ReadCache::attach(const FileReader* reader, const QString& filePath, qint64 offset, qint64 end)
+{
+    mReaders.insert(reader, { filePath, offset, end });
+    mFiles[filePath].readers.push_back(reader);
+}
+
+void ReadCache::detach(const FileReader* reader)
+{
+    auto it = mReaders.find(reader);
+    if (it == mReaders.end())
+        return;
+
+    QString filePath = it->filePath;
+    mReaders.erase(it);
+
+    SharedFile& file = mFiles[filePath];
+    file.readers.removeOne(reader);
+    if (file.readers.isEmpty())
+        mFiles.remove(filePath);
+    else
+        trim(file);
+}
+
+bool ReadCache::isShared(const FileReader* reader) const
+{
+    auto it = mReaders.constFind(reader);
+    if (it == mReaders.constEnd())
+        return false;
+
+    auto file = mFiles.constFind(it->filePath);
+    return file != mFiles.constEnd() && file->readers.size() > 1;
+}
+
+/*
+ * When the file keeps all the blocks it may, the slowest reader
+ * is detached to make room. If that is 'reader', it reads on its
+ * own from now on.
+ */
+QByteArray ReadCache::block(const FileReader* reader, QFile& file, qint64 index)
+{
+    QString filePath = mReaders.value(reader).filePath;
+    SharedFile& shared = mFiles[filePath];
+
+    auto cached = shared.blocks.constFind(index);
+    if (cached != shared.blocks.constEnd())
+        return cached.value();
+
+    QByteArray data(BlockSize, Qt::Uninitialized);
+    qint64 bytesRead = -1;
+    if (file.seek(index * BlockSize))
+        bytesRead = file.read(data.data(), BlockSize);
+    if (bytesRead <= 0)
+        return QByteArray();
+    data.resize(static_cast<int>(bytesRead));
+
+    if (shared.blocks.size() >= MaxSharedBlocks) {
+        const FileReader* slowest = slowestReader(shared);
+        detach(slowest);
+        if (slowest == reader || !mFiles.contains(filePath))
+            return data;
+    }
+
+    SharedFile& remaining = mFiles[filePath];
+    if (remaining.blocks.size() < MaxSharedBlocks && isNeeded(remaining, index))
+        remaining.blocks.insert(index, data);
+
+    return data;
+}
+
+void ReadCache::setPosition(const FileReader* reader, qint64 offset)
+{
+    auto it = mReaders.find(reader);
+    if (it == mReaders.end())
+        return;
+
+    qint64 oldIndex = it->offset / BlockSize;
+    it->offset = offset;
+    if (offset / BlockSize != oldIndex)
+        trim(mFiles[it->filePath]);
+}
+
+/*
+ * A block is needed by a reader that hasn't read past it
+ * and whose range covers it.
+ */
+bool ReadCache::isNeeded(const SharedFile& file, qint64 index) const
+{
+    qint64 start = index * BlockSize;
+    qint64 end = start + BlockSize;
+    for (const FileReader* reader : file.readers) {
+        const Reader r = mReaders.value(reader);
+        if (r.offset < end && start < r.end && r.offset < r.end)
+            return true;
+    }
+
+    return false;
+}
+
+void ReadCache::trim(SharedFile& file)
+{
+    for (auto it = file.blocks.begin(); it != file.blocks.end(); ) {
+        if (isNeeded(file, it.key()))
+            ++it;
+        else
+            it = file.blocks.erase(it);
+    }
+}
+
+const FileReader* ReadCache::slowestReader(const SharedFile& file) const
+{
+    const FileReader* slowest = file.readers.first();
+    for (const FileReader* reader : file.readers) {
+        if (mReaders.value(reader).offset < mReaders.value(slowest).offset)
+            slowest = reader;
+    }
+
+    return slowest;
+}
@@ -0,0 +1,104 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef READCACHE_H
+#define READCACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QString>
+#include <QVector>
+
+class QFile;
+class FileReader;
+
+/*
+ * ReadCache lets the FileReaders of the same file (one per receiver
+ * the file is sent to) share what they read. The file is read in
+ * blocks, a block read by one reader is kept for the others while
+ * one of them still has it ahead, so every block is read from disk
+ * once however many receivers get it. Blocks are implicitly shared,
+ * a reader copies its chunk out of them.
+ *
+ * A file keeps a bounded number of blocks. When a receiver is so slow
+ * that the others would have to keep more, it falls behind onto its
+ * own reads (the reader is detached) and the others go on sharing.
+ *
+ * Every reader thread (FileReader::readerThread()) has its own
+ * ReadCache. The readers of a file are all on the thread of its
+ * disk, so they still share one.
+ */
+class ReadCache
+{
+public:
+    static constexpr qint32 BlockSize = 1024*1024;
+
+    /*
+     * The ReadCache of the calling thread
+     */
+    static ReadCache* instance();
+
+    /*
+     * 'reader' reads the range [offset, end) of 'filePath'
+     * front to back.
+     */
+    void attach(const FileReader* reader, const QString& filePath, qint64 offset, qint64 end);
+    void detach(const FileReader* reader);
+
+    /*
+     * True while other readers read the same file
+     */
+    bool isShared(const FileReader* reader) const;
+
+    /*
+     * Block 'index' of the file of 'reader', read with 'file' if it
+     * isn't cached. Shorter at the end of the file, empty on error.
+     */
+    QByteArray block(const FileReader* reader, QFile& file, qint64 index);
+
+    /*
+     * Data before 'offset' is not needed by 'reader' anymore
+     */
+    void setPosition(const FileReader* reader, qint64 offset);
+
+private:
+    struct Reader
+    {
+        QString filePath;
+        qint64 offset;
+        qint64 end;
+    };
+
+    struct SharedFile
+    {
+        QVector<const FileReader*> readers;
+        QMap<qint64, QByteArray> blocks;
+    };
+
+    ReadCache() = default;
+
+    bool isNeeded(const SharedFile& file, qint64 index) const;
+    void trim(SharedFile& file);
+    const FileReader* slowestReader(const SharedFile& file) const;
+
+    QHash<const FileReader*, Reader> mReaders;
+    QHash<QString, SharedFile> mFiles;
+};
+
+#endif // READCACHE_H
@@ -17,28 +17,119 @@
 */
 
 #include <QJsonObject>
+#include <QJsonArray>
 #include <QJsonDocument>
+#include <QSaveFile>
+#include <QFileInfo>
 #include <QDir>
+#include <QtEndian>
 
 #include "util.h"
 #include "receiver.h"
+#include "filewriter.h"
+#include "delta.h"
+#include "checksum.h"
+#include "chunkstore.h"
+#include "session.h"
 #include "settings.h"
+#include "transferengine.h"
 
-Receiver::Receiver(const Device& sender, QTcpSocket* socket, QObject* parent)
-    : Transfer(socket, parent), mSenderDev(sender), mFileSize(0), mBytesRead(0)
+/*
+ * Reading from the sender's sessions is suspended while this much
+ * received data waits for the disk, and resumed below half of it.
+ */
+#define MaxWriteBehindSize  16*1024*1024 // 16 MB
+
+/*
+ * Delta transfer rebuilds the file here, next to its target
+ */
+#define DeltaFileSuffix     ".lanshare-delta"
+
+/*
+ * Resume record of a partial file, named after the file the sender
+ * sent. It is rewritten every ResumeRecordInterval bytes received.
+ */
+#define ResumeFileSuffix        ".lanshare-resume"
+#define ResumeRecordInterval    64*1024*1024 // 64 MB
+
+/*
+ * Verified transfer, a block hash entry is the block index and its
+ * hash (little endian). Broken blocks are asked for again at most
+ * MaxRetransmits times.
+ */
+#define BlockHashEntrySize      12
+#define MaxRetransmits          3
+
+QHash<QString, Receiver*> Receiver::sStripedFiles;
+QMultiHash<QString, Receiver*> Receiver::sPendingStripes;
+QMutex Receiver::sStripesMutex;
+
+Receiver::Receiver(const Device& sender, Session* session, quint32 streamId, QObject* parent)
+    : Transfer(parent), mSenderDev(sender), mFileSize(0), mBytesRead(0)
 {
+    mWriter = nullptr;
+    mWritesPending = 0;
+    mWriteOffset = 0;
+    mReadingSuspended = false;
+    mFinishing = false;
+
+    mChecksum = nullptr;
+    mDigest = 0;
+    mHasDigest = false;
+    mVerifying = false;
+    mDedupCheck = nullptr;
+    mAwaitingChunks = false;
+    mChunkCopies = 0;
+    mRetransmits = 0;
+    mVerify = false;
+
+    mSignatureBuilder = nullptr;
+    mBasisSize = 0;
+    mBlockSize = 0;
+    mCommitPending = false;
+
+    mRecordSavedAt = 0;
+    mSpliceOffset = 0;
+    mResumable = false;
+    mInterrupted = false;
+
+    mPrimary = nullptr;
+    mStripeCount = 1;
+    mStreamsFinished = 0;
+    mPositional = false;
+
+    setSession(session, streamId);
     mInfo->setState(TransferState::Waiting);
-    connect(mSocket, &QTcpSocket::disconnected, this, &Receiver::onDisconnected);
 
     mInfo->setTransferType(TransferType::Download);
     mInfo->setPeer(sender);
 }
 
+Receiver::~Receiver()
+{
+    stopWriter();
+    if (mSignatureBuilder)
+        mSignatureBuilder->deleteLater();
+
+    if (!mStripeToken.isEmpty()) {
+        QMutexLocker locker(&sStripesMutex);
+        if (sStripedFiles.value(mStripeToken) == this)
+            sStripedFiles.remove(mStripeToken);
+        sPendingStripes.remove(mStripeToken, this);
+    }
+}
+
+bool Receiver::isStripeHeader(const QByteArray& header)
+{
+    FileHeader fileHeader;
+    return FileHeader::parse(header, fileHeader) && fileHeader.isStripe();
+}
+
 void Receiver::resume()
 {
     if (mInfo->canResume()) {
         mInfo->setState(mInfo->getLastState());
-        writePacket(0, PacketType::Resume, QByteArray());
+        writePacket(PacketType::Resume, QByteArray());
     }
 }
 
@@ -46,7 +137,7 @@ void Receiver::pause()
 {
     if (mInfo->canPause()) {
         mInfo->setState(TransferState::Paused);
-        writePacket(0, PacketType::Pause, QByteArray());
+        writePacket(PacketType::Pause, QByteArray());
     }
 }
 
@@ -55,26 +146,75 @@ void Receiver::cancel()
     if (mInfo->canCancel()) {
         mInfo->setState(TransferState::Cancelled);
         mInfo->setProgress(0);
-        clearReadBuffer();
-        writePacket(0, PacketType::Cancel, QByteArray());
-        mFile->remove();
+        writePacket(PacketType::Cancel, QByteArray());
+        detachSession();
+
+        for (Receiver* stripe : mStripes)
+            stripe->detachSession();
+
+        removeResumeRecord();
+        discardFile();
     }
 }
 
-void Receiver::onDisconnected()
+void Receiver::onSessionDisconnected()
 {
+    mSession = nullptr;
     mInfo->setState(TransferState::Disconnected);
-    emit mInfo->errorOcurred("Sender disconnected");
+
+    /*
+     * Stripe that never got its file has nothing to report
+     */
+    if (isPendingStripe()) {
+        deleteLater();
+        return;
+    }
+
+    Receiver* rec = primary();
+    if (rec->mInfo->getState() == TransferState::Finish)
+        return;
+
+    /*
+     * Keep the partial file, the rest of it comes when the
+     * sender reconnects.
+     */
+    if (rec->mResumable) {
+        rec->mInterrupted = true;
+        rec->saveResumeRecord();
+    }
+
+    rec->mInfo->setState(TransferState::Disconnected);
+    emit rec->mInfo->errorOcurred("Sender disconnected");
 }
 
 void Receiver::processHeaderPacket(QByteArray& data)
 {
-    QJsonObject obj = QJsonDocument::fromJson(data).object();
-    mFileSize = obj.value("size").toVariant().value<qint64>();
+    FileHeader header;
+    if (!FileHeader::parse(data, header)) {
+        emit mInfo->errorOcurred(tr("Invalid data received"));
+        cancel();
+        return;
+    }
+
+    if (header.isStripe()) {
+        joinStripe(header.join);
+        return;
+    }
+
+    /*
+     * Inline files, dedup and accept all write under this path
+     */
+    if (!Util::isSafePath(header.folder, header.name)) {
+        emit mInfo->errorOcurred(tr("Invalid data received"));
+        cancel();
+        return;
+    }
+
+    mFileSize = header.size;
     mInfo->setDataSize(mFileSize);
 
-    QString fileName = obj.value("name").toString();
-    QString folderName = obj.value("folder").toString();
+    QString fileName = header.name;
+    QString folderName = header.folder;
     QString dstFolderPath = Settings::instance()->getDownloadDir();
     if (!folderName.isEmpty())
         dstFolderPath = dstFolderPath + QDir::separator() + folderName;
@@ -87,52 +227,984 @@ void Receiver::processHeaderPacket(QByteArray& data)
         dir.mkpath(dstFolderPath);
     }
 
+    if (header.has(FileHeader::Inline)) {
+        commitInlineFile(header, dstFolderPath);
+        return;
+    }
+
+    /*
+     * The sender offers the hash of its file, a file with the same
+     * content at the destination makes the transfer unnecessary.
+     */
+    QString dstFilePath = dstFolderPath + QDir::separator() + fileName;
+    QFileInfo existing(dstFilePath);
+    if (header.has(FileHeader::HasHash) && existing.isFile() && existing.size() == mFileSize) {
+        mHeader = header;
+        mDedupCheck = new FileChecksum(dstFilePath, mFileSize, this);
+        connect(mDedupCheck, &FileChecksum::finished, this, [this, dstFolderPath](bool ok, quint64 digest) {
+            onDedupChecked(dstFolderPath, ok, digest);
+        });
+        if (!mDedupCheck->loadFromCache())
+            mDedupCheck->addRange(0, mFileSize);
+        mDedupCheck->finish();
+        return;
+    }
+
+    acceptFile(header, dstFolderPath);
+}
+
+void Receiver::onDedupChecked(const QString& dstFolderPath, bool ok, quint64 digest)
+{
+    if (ok)
+        mDedupCheck->saveToCache();
+    mDedupCheck->deleteLater();
+    mDedupCheck = nullptr;
+
+    FileHeader header = mHeader;
+    mHeader = FileHeader();
+    if (!mSession || mInfo->getState() == TransferState::Cancelled)
+        return;
+
+    if (!ok || digest != header.hash) {
+        acceptFile(header, dstFolderPath);
+        return;
+    }
+
+    /*
+     * Nothing to send, the file is done
+     */
+    mInfo->setFilePath(dstFolderPath + QDir::separator() + header.name);
+    mInfo->setState(TransferState::Transfering);
+    emit mInfo->fileOpened();
+
+    QJsonObject accept;
+    accept.insert("identical", true);
+    writePacket(PacketType::Accept, QJsonDocument(accept).toJson(QJsonDocument::Compact));
+    detachSession();
+
+    mBytesRead = mFileSize;
+    mInfo->setProgress(100);
+    mInfo->setState(TransferState::Finish);
+    ChunkStore::instance()->addFile(mInfo->getFilePath());
+    emit mInfo->done();
+}
+
+/*
+ * The file came whole with its header, it is written in one step
+ * and appears complete or not at all.
+ */
+void Receiver::commitInlineFile(const FileHeader& header, const QString& dstFolderPath)
+{
+    QString dstFilePath = dstFolderPath + QDir::separator() + header.name;
+    if (!Settings::instance()->getReplaceExistingFile())
+        dstFilePath = Util::getUniqueFileName(header.name, dstFolderPath);
+
+    mInfo->setFilePath(dstFilePath);
+    mInfo->setState(TransferState::Transfering);
+    emit mInfo->fileOpened();
+    detachSession();
+
+    QSaveFile file(dstFilePath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(header.payload) != header.payload.size() ||
+            !file.commit()) {
+        mInfo->setState(TransferState::Cancelled);
+        emit mInfo->errorOcurred(tr("Failed to write ") + dstFilePath);
+        return;
+    }
+
+    mBytesRead = mFileSize;
+    mInfo->setProgress(100);
+    mInfo->setState(TransferState::Finish);
+    emit mInfo->done();
+}
+
+void Receiver::acceptFile(const FileHeader& header, const QString& dstFolderPath)
+{
+    QString fileName = header.name;
+    QString folderName = header.folder;
     QString dstFilePath = dstFolderPath + QDir::separator() + fileName;
+
+    /*
+     * The sender waits for an answer to a header with a token,
+     * its Data packets then start with their file offset.
+     */
+    bool negotiated = header.isNegotiated();
+    if (negotiated) {
+        mResumeIdentity = QJsonObject::fromVariantMap({
+                                    {"peer", mSenderDev.getId()},
+                                    {"name", fileName},
+                                    {"folder", folderName}
+                                });
+        mResumeIdentity.insert("size", header.size);
+        mResumeIdentity.insert("mtime", header.mtime);
+        mResumePath = dstFilePath + ResumeFileSuffix;
+    }
+
+    bool resumed = negotiated && resumeFile(dstFilePath);
+
+    /*
+     * The sender offers a delta transfer and there is an old copy
+     * of the file to rebuild it from.
+     */
+    QFileInfo basis(dstFilePath);
+    bool delta = !resumed && header.has(FileHeader::Delta) && Settings::instance()->getDeltaTransfer() &&
+            basis.isFile() && basis.size() > 0;
+    if (delta) {
+        mBasisPath = dstFilePath;
+        mBasisSize = basis.size();
+    }
+
     /*
      * Jika opsi overwrite tdk dicentang maka rename file agar tdk tertindih
      */
-    if (!Settings::instance()->getReplaceExistingFile()) {
+    if (!resumed && !Settings::instance()->getReplaceExistingFile()) {
         dstFilePath = Util::getUniqueFileName(fileName, dstFolderPath);
     }
 
     mInfo->setFilePath(dstFilePath);
-    mFile = new QFile(dstFilePath, this);
-    if (mFile->open(QIODevice::WriteOnly)) {
+    if (delta) {
+        mDeltaTarget = dstFilePath;
+        mFile = new QFile(dstFilePath + DeltaFileSuffix, this);
+    }
+    else {
+        mFile = new QFile(dstFilePath, this);
+    }
+
+    /*
+     * Only creates the file, the writer writes it (spliced data
+     * too). A resumed file keeps its content.
+     */
+    QIODevice::OpenMode mode = resumed ? QIODevice::ReadWrite : QIODevice::WriteOnly;
+    if (mFile->open(mode | QIODevice::Unbuffered)) {
+        mChecksum = new FileChecksum(mFile->fileName(), mFileSize, this);
+        connect(mChecksum, &FileChecksum::finished, this, &Receiver::onChecksumFinished);
+        connect(mChecksum, &FileChecksum::blockHashed, this, &Receiver::onBlockHashed);
+        mFailedBlocks = QBitArray(mChecksum->blockCount());
+
+        startWriter();
+        if (delta)
+            mWriter->setSource(mBasisPath);
         mInfo->setState(TransferState::Transfering);
         emit mInfo->fileOpened();
     }
     else {
         emit mInfo->errorOcurred(tr("Failed to write ") + dstFilePath);
+        return;
+    }
+
+    if (delta) {
+        startDelta();
+        return;
+    }
+
+    /*
+     * Not the same file, the sender waits for this
+     * before it sends anything.
+     */
+    if (!negotiated) {
+        if (header.has(FileHeader::HasHash))
+            writePacket(PacketType::Accept, QJsonDocument(QJsonObject()).toJson(QJsonDocument::Compact));
+        return;
+    }
+
+    /*
+     * The number of stripes comes with the primary's Finish
+     */
+    mPositional = true;
+    mResumable = true;
+    mVerify = header.has(FileHeader::Verify);
+    mStripeCount = 0;
+    mStripeToken = header.token;
+    saveResumeRecord();
+
+    {
+        /*
+         * Stripes come from the same peer, so they live in
+         * this thread too.
+         */
+        QMutexLocker locker(&sStripesMutex);
+        sStripedFiles.insert(mStripeToken, this);
+
+        for (Receiver* stripe : sPendingStripes.values(mStripeToken))
+            adoptStripe(stripe);
+        sPendingStripes.remove(mStripeToken);
+    }
+
+    mHeader = header;
+
+    /*
+     * A new file may share chunks with files received before,
+     * they are copied before the sender is answered. The files not
+     * indexed yet are indexed while the sender cuts its own.
+     */
+    if (!resumed && header.has(FileHeader::Chunks) && Settings::instance()->getDeltaTransfer() &&
+            !ChunkStore::instance()->isEmpty()) {
+        ChunkStore::instance()->indexPending();
+        mAwaitingChunks = true;
+        writePacket(PacketType::Chunks, QByteArray());
+        return;
+    }
+
+    sendAccept();
+}
+
+/*
+ * Tell the sender which parts are already here
+ */
+void Receiver::sendAccept()
+{
+    QJsonArray have;
+    for (auto it = mReceived.constBegin(); it != mReceived.constEnd(); ++it)
+        have.append(QJsonArray({ it.key(), it.value() }));
+
+    QJsonObject accept;
+    accept.insert("have", have);
+    accept.insert("compress", mHeader.has(FileHeader::Compress) && Settings::instance()->getCompression());
+    accept.insert("verify", mVerify);
+    writePacket(PacketType::Accept, QJsonDocument(accept).toJson(QJsonDocument::Compact));
+    mHeader = FileHeader();
+}
+
+/*
+ * Chunk list of the sender's file, the chunks found in other
+ * files are copied from there.
+ */
+void Receiver::processChunksPacket(QByteArray& data)
+{
+    if (!mAwaitingChunks || !mWriter)
+        return;
+
+    mAwaitingChunks = false;
+    QVector<Chunker::Chunk> chunks = Chunker::decode(data);
+    qint64 size = chunks.isEmpty() ? 0 : chunks.last().offset + chunks.last().size;
+    if (size != mFileSize) {
+        sendAccept();
+        return;
+    }
+
+    QVector<ChunkStore::Location> locations = ChunkStore::instance()->locate(chunks);
+    for (int i = 0; i < chunks.size(); i++) {
+        const ChunkStore::Location& location = locations.at(i);
+        if (location.filePath.isEmpty())
+            continue;
+
+        const Chunker::Chunk& chunk = chunks.at(i);
+        mWriter->copyChunk(location.filePath, location.offset, chunk.size, chunk.offset, chunk.hash);
+        addPendingWrite(chunk.size);
+        mChunkCopies++;
+    }
+
+    if (mChunkCopies == 0)
+        sendAccept();
+}
+
+void Receiver::onChunkCopied(qint64 offset, qint64 size, bool ok)
+{
+    Q_UNUSED(offset);
+
+    if (!ok) {
+        mWritesPending -= size;
+        if (mReadingSuspended && mWritesPending <= MaxWriteBehindSize / 2)
+            setReadingSuspended(false);
+    }
+
+    if (--mChunkCopies == 0 && mSession)
+        sendAccept();
+}
+
+/*
+ * Picks up the partial file of an interrupted transfer if the resume
+ * record describes the same file from the same sender.
+ */
+bool Receiver::resumeFile(QString& filePath)
+{
+    QFile recordFile(mResumePath);
+    if (!recordFile.open(QIODevice::ReadOnly))
+        return false;
+
+    QJsonObject record = QJsonDocument::fromJson(recordFile.readAll()).object();
+    recordFile.close();
+
+    QString partialPath = record.value("path").toString();
+    bool same = true;
+    for (auto it = mResumeIdentity.constBegin(); it != mResumeIdentity.constEnd(); ++it) {
+        if (record.value(it.key()) != it.value())
+            same = false;
+    }
+
+    /*
+     * The sender's file has changed since, what was received of it
+     * is of no use anymore.
+     */
+    if (!same) {
+        if (record.value("peer") == mResumeIdentity.value("peer")) {
+            QFile::remove(partialPath);
+            recordFile.remove();
+        }
+        return false;
+    }
+
+    QFileInfo partial(partialPath);
+    if (!partial.isFile()) {
+        recordFile.remove();
+        return false;
+    }
+
+    mResumable = true;
+    const QJsonArray have = record.value("have").toArray();
+    for (const QJsonValue& value : have) {
+        QJsonArray range = value.toArray();
+        qint64 start = range.at(0).toVariant().value<qint64>();
+        qint64 end = qMin(range.at(1).toVariant().value<qint64>(), partial.size());
+        if (start >= 0 && start < end) {
+            addReceivedRange(start, end - start);
+            mBytesRead += end - start;
+        }
+    }
+
+    mInfo->setProgress( (int)(mBytesRead * 100 / qMax<qint64>(1, mFileSize)) );
+    filePath = partialPath;
+    return true;
+}
+
+void Receiver::addReceivedRange(qint64 offset, qint64 size)
+{
+    if (!mResumable || size <= 0)
+        return;
+
+    qint64 start = offset;
+    qint64 end = offset + size;
+
+    /*
+     * Merge with the ranges it touches
+     */
+    auto it = mReceived.upperBound(start);
+    if (it != mReceived.begin()) {
+        auto prev = it;
+        --prev;
+        if (prev.value() >= start) {
+            start = prev.key();
+            end = qMax(end, prev.value());
+            it = mReceived.erase(prev);
+        }
+    }
+
+    while (it != mReceived.end() && it.key() <= end) {
+        end = qMax(end, it.value());
+        it = mReceived.erase(it);
+    }
+
+    mReceived.insert(start, end);
+}
+
+void Receiver::removeReceivedRange(qint64 offset, qint64 size)
+{
+    qint64 start = offset;
+    qint64 end = offset + size;
+
+    /*
+     * Cut the range out of the ones it overlaps
+     */
+    auto it = mReceived.upperBound(start);
+    if (it != mReceived.begin()) {
+        auto prev = it;
+        --prev;
+        qint64 prevEnd = prev.value();
+        if (prevEnd > start) {
+            if (prev.key() < start)
+                prev.value() = start;
+            else
+                mReceived.erase(prev);
+
+            if (prevEnd > end) {
+                mReceived.insert(end, prevEnd);
+                return;
+            }
+        }
+    }
+
+    while (it != mReceived.end() && it.key() < end) {
+        qint64 itEnd = it.value();
+        it = mReceived.erase(it);
+        if (itEnd > end) {
+            mReceived.insert(end, itEnd);
+            break;
+        }
+    }
+}
+
+void Receiver::saveResumeRecord()
+{
+    if (!mResumable || !mFile)
+        return;
+
+    QJsonArray have;
+    for (auto it = mReceived.constBegin(); it != mReceived.constEnd(); ++it)
+        have.append(QJsonArray({ it.key(), it.value() }));
+
+    QJsonObject record = mResumeIdentity;
+    record.insert("path", mFile->fileName());
+    record.insert("have", have);
+
+    /*
+     * Replaced in one step, a crash never leaves half a record
+     */
+    QSaveFile file(mResumePath);
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(record).toJson(QJsonDocument::Compact));
+        file.commit();
+    }
+
+    mRecordSavedAt = mBytesRead;
+}
+
+void Receiver::removeResumeRecord()
+{
+    if (mResumable) {
+        mResumable = false;
+        QFile::remove(mResumePath);
+    }
+}
+
+void Receiver::startDelta()
+{
+    mBlockSize = DeltaSignature::blockSizeFor(mBasisSize);
+    mSignatureBuilder = new SignatureBuilder(mBasisPath, mBlockSize,
+                                             TransferEngine::instance()->namedThread("Delta"));
+    connect(mSignatureBuilder, &SignatureBuilder::built, this, &Receiver::onSignatureBuilt);
+    mSignatureBuilder->start();
+}
+
+void Receiver::onSignatureBuilt(QByteArray signature)
+{
+    mSignatureBuilder->deleteLater();
+    mSignatureBuilder = nullptr;
+
+    /*
+     * Old copy can't be read, a signature without blocks makes
+     * the sender send everything as literal data.
+     */
+    if (signature.isEmpty()) {
+        signature = QByteArray(sizeof(mBlockSize), Qt::Uninitialized);
+        qToLittleEndian<qint32>(mBlockSize, signature.data());
+    }
+
+    writePacket(PacketType::Signature, signature);
+}
+
+void Receiver::joinStripe(const QString& token)
+{
+    mPositional = true;
+    mStripeToken = token;
+
+    QMutexLocker locker(&sStripesMutex);
+    Receiver* rec = sStripedFiles.value(token);
+    if (rec)
+        rec->adoptStripe(this);
+    else
+        sPendingStripes.insert(token, this);
+}
+
+void Receiver::adoptStripe(Receiver* stripe)
+{
+    if (!stripe->mSession)
+        return;
+
+    stripe->mPrimary = this;
+    stripe->mFileSize = mFileSize;
+    stripe->setParent(this);
+    mStripes.push_back(stripe);
+
+    /*
+     * Tell the stripe's sender it can start sending
+     */
+    stripe->mInfo->setState(TransferState::Transfering);
+    stripe->writePacket(PacketType::Resume, QByteArray());
+}
+
+bool Receiver::writeAt(qint64 offset, const char* data, qint64 size)
+{
+    Receiver* rec = primary();
+    if (!rec->mWriter || offset < 0 || offset + size > mFileSize)
+        return false;
+
+    /*
+     * 'data' points into the session's receive buffer,
+     * the writer thread gets its own copy.
+     */
+    rec->mWriter->write(offset, QByteArray(data, static_cast<int>(size)));
+    rec->addPendingWrite(size);
+    return true;
+}
+
+void Receiver::addPendingWrite(qint64 bytes)
+{
+    mWritesPending += bytes;
+    if (mWritesPending >= MaxWriteBehindSize && !mReadingSuspended)
+        setReadingSuspended(true);
+}
+
+void Receiver::addBytesReceived(qint64 bytes)
+{
+    Receiver* rec = primary();
+    rec->mBytesRead += bytes;
+    rec->mInfo->setProgress( (int)(rec->mBytesRead * 100 / rec->mFileSize) );
+
+    if (rec->mResumable && rec->mBytesRead - rec->mRecordSavedAt >= ResumeRecordInterval)
+        rec->saveResumeRecord();
+}
+
+void Receiver::startWriter()
+{
+    mWriter = new FileWriter(mFile->fileName());
+    connect(mWriter, &FileWriter::bytesWritten, this, &Receiver::onBytesWritten);
+    connect(mWriter, &FileWriter::committed, this, &Receiver::onCommitted);
+    connect(mWriter, &FileWriter::chunkCopied, this, &Receiver::onChunkCopied);
+    /*
+     * The failed write never comes back through bytesWritten(), the
+     * write-behind would not drain and the session, shared with every
+     * other transfer from the peer, would stay suspended.
+     */
+    connect(mWriter, &FileWriter::errorOcurred, this, [this]() {
+        emit mInfo->errorOcurred(tr("Failed to write ") + mInfo->getFilePath());
+        mWritesPending = 0;
+        cancel();
+        stopWriter();
+    });
+}
+
+void Receiver::stopWriter()
+{
+    if (mWriter) {
+        mWriter->deleteLater();
+        mWriter = nullptr;
+    }
+
+    if (mReadingSuspended)
+        setReadingSuspended(false);
+}
+
+/*
+ * The writer removes the file after the writes it has queued,
+ * they would create it again otherwise.
+ */
+void Receiver::discardFile()
+{
+    if (mFile)
+        mFile->close();
+
+    if (mWriter)
+        mWriter->discard();
+    else if (mFile)
+        mFile->remove();
+
+    stopWriter();
+}
+
+void Receiver::onBytesWritten(qint64 offset, qint64 bytes)
+{
+    mWritesPending -= bytes;
+    mChecksum->addRange(offset, bytes);
+    addReceivedRange(offset, bytes);
+    addBytesReceived(bytes);
+
+    /*
+     * Interrupted, record everything that made it to the disk
+     */
+    if (mInterrupted && mWritesPending == 0)
+        saveResumeRecord();
+
+    if (mReadingSuspended && mWritesPending <= MaxWriteBehindSize / 2)
+        setReadingSuspended(false);
+
+    /*
+     * The writer has taken spliced data out of its pipe
+     */
+    if (mSession)
+        mSession->resumeSplice();
+    for (Receiver* stripe : mStripes) {
+        if (stripe->mSession)
+            stripe->mSession->resumeSplice();
+    }
+
+    completeIfDone();
+}
+
+void Receiver::setReadingSuspended(bool suspended)
+{
+    mReadingSuspended = suspended;
+
+    QVector<Receiver*> streams = mStripes;
+    streams.push_back(this);
+    for (Receiver* rec : streams) {
+        if (!rec->mSession)
+            continue;
+
+        if (suspended)
+            rec->mSession->suspendReading(rec->mStreamId);
+        else
+            rec->mSession->resumeReading(rec->mStreamId);
     }
 }
 
 void Receiver::processDataPacket(QByteArray& data)
 {
-    if (mFile && mBytesRead + data.size() <= mFileSize) {
-        mFile->write(data);
-        mBytesRead += data.size();
+    if (mPositional) {
+        qint64 offset;
+        if (data.size() < static_cast<int>(sizeof(offset)))
+            return;
 
-        mInfo->setProgress( (int)(mBytesRead * 100 / mFileSize) );
+        offset = qFromLittleEndian<qint64>(data.constData());
+        writeAt(offset, data.constData() + sizeof(offset), data.size() - sizeof(offset));
+        return;
     }
+
+    if (writeAt(mWriteOffset, data.constData(), data.size()))
+        mWriteOffset += data.size();
 }
 
-void Receiver::processFinishPacket(QByteArray& data)
+/*
+ * File offset followed by qCompress() output, which starts with
+ * the uncompressed size (big endian). The writer uncompresses it.
+ */
+void Receiver::processCompressedPacket(QByteArray& data)
 {
-    Q_UNUSED(data);
+    Receiver* rec = primary();
+    qint64 offset;
+    quint32 size;
+    if (!mPositional || !rec->mWriter || data.size() < static_cast<int>(sizeof(offset) + sizeof(size)))
+        return;
+
+    offset = qFromLittleEndian<qint64>(data.constData());
+    size = qFromBigEndian<quint32>(data.constData() + sizeof(offset));
+    if (offset < 0 || offset + size > mFileSize) {
+        emit rec->mInfo->errorOcurred(tr("Invalid data received"));
+        rec->cancel();
+        return;
+    }
+
+    rec->mWriter->writeCompressed(offset, data.mid(sizeof(offset)), size);
+    rec->addPendingWrite(size);
+}
+
+/*
+ * Hashes of blocks the sender has read
+ */
+void Receiver::processChecksumPacket(QByteArray& data)
+{
+    if (!mVerify)
+        return;
+
+    for (int i = 0; i + BlockHashEntrySize <= data.size(); i += BlockHashEntrySize) {
+        int block = qFromLittleEndian<qint32>(data.constData() + i);
+        if (block < 0 || block >= mFailedBlocks.size())
+            continue;
+
+        mSenderHashes.insert(block, qFromLittleEndian<quint64>(data.constData() + i + sizeof(qint32)));
+        checkBlock(block);
+    }
+}
+
+void Receiver::onBlockHashed(int block, quint64 blockHash)
+{
+    Q_UNUSED(blockHash);
+
+    if (mVerify)
+        checkBlock(block);
+}
+
+void Receiver::checkBlock(int block)
+{
+    quint64 blockHash;
+    if (mSenderHashes.contains(block) && mChecksum->blockHash(block, blockHash))
+        mFailedBlocks.setBit(block, blockHash != mSenderHashes.value(block));
+}
+
+void Receiver::processDeltaPacket(QByteArray& data)
+{
+    if (mDeltaTarget.isEmpty() || !mWriter)
+        return;
+
+    DeltaReader reader(data);
+    DeltaReader::Op op;
+    while (reader.next(op)) {
+        if (!op.copy) {
+            if (!writeAt(mWriteOffset, op.data, op.size))
+                break;
+
+            mWriteOffset += op.size;
+            continue;
+        }
 
+        qint64 sourceOffset = static_cast<qint64>(op.first) * mBlockSize;
+        qint64 length = static_cast<qint64>(op.count) * mBlockSize;
+        if (sourceOffset + length > mBasisSize || mWriteOffset + length > mFileSize)
+            break;
+
+        mWriter->copy(sourceOffset, length, mWriteOffset);
+        addPendingWrite(length);
+        mWriteOffset += length;
+    }
+
+    if (reader.atEnd())
+        return;
+
+    emit mInfo->errorOcurred(tr("Invalid data received"));
+    cancel();
+}
+
+/*
+ * Spliced data goes through the file writer like the rest, at an
+ * explicit offset as the writer may be writing other parts.
+ */
+bool Receiver::startSplice(const QByteArray& buffered, qint32 packetDataSize)
+{
+#if defined (Q_OS_LINUX)
+    Receiver* rec = primary();
+    if (!rec->mWriter || !rec->mDeltaTarget.isEmpty())
+        return false;
+
+    qint64 fileOffset = mWriteOffset;
+    int prefixSize = 0;
+    if (mPositional) {
+        prefixSize = sizeof(fileOffset);
+        if (buffered.size() < prefixSize)
+            return false;
+
+        fileOffset = qFromLittleEndian<qint64>(buffered.constData());
+    }
+
+    qint64 size = buffered.size() - prefixSize;
+    if (fileOffset < 0 || fileOffset + packetDataSize - prefixSize > mFileSize)
+        return false;
+
+    if (size > 0 && !writeAt(fileOffset, buffered.constData() + prefixSize, size))
+        return false;
+
+    if (!mPositional)
+        mWriteOffset += packetDataSize;
+
+    mSpliceOffset = fileOffset + size;
+    return true;
+#else
+    Q_UNUSED(buffered);
+    Q_UNUSED(packetDataSize);
+    return false;
+#endif
+}
+
+void Receiver::processSplicedData(const QByteArray& data)
+{
+    writeAt(mSpliceOffset, data.constData(), data.size());
+    mSpliceOffset += data.size();
+}
+
+qint64 Receiver::spliceFrom(int socketDescriptor, qint64 size)
+{
+    Receiver* rec = primary();
+    if (!rec->mWriter)
+        return -1;
+
+    qint64 len = rec->mWriter->spliceFrom(socketDescriptor, mSpliceOffset, size);
+    if (len > 0) {
+        mSpliceOffset += len;
+        rec->addPendingWrite(len);
+    }
+
+    return len;
+}
+
+/*
+ * The primary stream and every stripe send their own Finish,
+ * the file is complete after the last one and once the writer
+ * has caught up.
+ */
+void Receiver::onStreamFinished()
+{
+    mStreamsFinished++;
+    if (mStripeCount == 0 || mStreamsFinished < mStripeCount)
+        return;
+
+    mFinishing = true;
+    completeIfDone();
+}
+
+void Receiver::completeIfDone()
+{
+    if (!mFinishing || mWritesPending > 0 || mVerifying || mCommitPending)
+        return;
+
+    /*
+     * Everything is on disk, check it against the
+     * sender's checksum first.
+     */
+    mVerifying = true;
+    mChecksum->finish();
+}
+
+void Receiver::onChecksumFinished(bool ok, quint64 digest)
+{
+    mVerifying = false;
+    if (!mFinishing || mInfo->getState() != TransferState::Transfering)
+        return;
+
+    if (!ok || (mHasDigest && digest != mDigest)) {
+        if (ok && retransmit())
+            return;
+
+        mFinishing = false;
+        removeResumeRecord();
+        if (!mDeltaTarget.isEmpty())
+            discardFile();
+        else
+            stopWriter();
+
+        if (mVerify) {
+            writePacket(PacketType::Cancel, QByteArray());
+            detachSession();
+        }
+
+        mInfo->setState(TransferState::Disconnected);
+        emit mInfo->errorOcurred(ok ? tr("Checksum mismatch, received file is corrupt")
+                                    : tr("Failed to verify ") + mInfo->getFilePath());
+        return;
+    }
+
+    /*
+     * Rebuilt file replaces its target on the writer thread
+     */
+    if (!mDeltaTarget.isEmpty()) {
+        mCommitPending = true;
+        mFile->close();
+        mWriter->commit(mDeltaTarget);
+        return;
+    }
+
+    if (mVerify) {
+        writePacket(PacketType::Verify, QByteArray());
+        detachSession();
+    }
+
+    mFinishing = false;
+    stopWriter();
+    removeResumeRecord();
+    mInfo->setState(TransferState::Finish);
+    if (mFile)
+        mFile->close();
+
+    /*
+     * Sending it back or receiving it again won't hash it again,
+     * later files can be built from its chunks.
+     */
+    mChecksum->saveToCache();
+    ChunkStore::instance()->addFile(mInfo->getFilePath());
+    emit mInfo->done();
+}
+
+/*
+ * Ask the sender for the blocks that didn't match their hash, the
+ * file is checked again after its next Finish.
+ */
+bool Receiver::retransmit()
+{
+    if (!mVerify || !mSession || mRetransmits >= MaxRetransmits || mFailedBlocks.count(true) == 0)
+        return false;
+
+    mRetransmits++;
+    for (int block = 0; block < mFailedBlocks.size(); block++) {
+        if (!mFailedBlocks.testBit(block))
+            continue;
+
+        qint64 offset, size;
+        mChecksum->blockBounds(block, offset, size);
+        mChecksum->invalidate(block);
+        removeReceivedRange(offset, size);
+        mBytesRead -= size;
+    }
+
+    saveResumeRecord();
+    writePacket(PacketType::Verify, QByteArray(mFailedBlocks.bits(), (mFailedBlocks.size() + 7) / 8));
+    mFailedBlocks.fill(false);
+
+    /*
+     * Stripes are done, only the primary stream finishes again
+     */
+    mFinishing = false;
+    mStreamsFinished--;
+    return true;
+}
+
+void Receiver::onCommitted(bool ok)
+{
+    mFinishing = false;
+    mCommitPending = false;
+
+    if (!ok) {
+        discardFile();
+        mInfo->setState(TransferState::Disconnected);
+        emit mInfo->errorOcurred(tr("Failed to write ") + mDeltaTarget);
+        return;
+    }
+
+    stopWriter();
     mInfo->setState(TransferState::Finish);
-    mFile->close();
-    mSocket->disconnectFromHost();
+    ChunkStore::instance()->addFile(mDeltaTarget);
     emit mInfo->done();
 }
 
+void Receiver::processFinishPacket(QByteArray& data)
+{
+    /*
+     * Verified file, the primary stream stays open
+     * for the verdict.
+     */
+    if (!mVerify || mPrimary)
+        detachSession();
+
+    if (isPendingStripe())
+        return;
+
+    if (mPrimary) {
+        mInfo->setState(TransferState::Finish);
+    }
+    else {
+        QJsonObject obj = QJsonDocument::fromJson(data).object();
+        if (mPositional)
+            mStripeCount = obj.value("stripes").toInt(1);
+        mDigest = obj.value("checksum").toString().toULongLong(&mHasDigest, 16);
+    }
+
+    primary()->onStreamFinished();
+}
+
 void Receiver::processCancelPacket(QByteArray& data)
 {
     Q_UNUSED(data);
 
     mInfo->setState(TransferState::Cancelled);
+    detachSession();
+
+    if (isPendingStripe()) {
+        deleteLater();
+        return;
+    }
+
+    if (mPrimary)
+        return;
+
+    for (Receiver* stripe : mStripes)
+        stripe->detachSession();
+
+    /*
+     * Stopped by the sender, what arrived is kept for when
+     * it sends the file again.
+     */
+    if (mResumable) {
+        mInterrupted = true;
+        saveResumeRecord();
+        return;
+    }
+
     mInfo->setProgress(0);
-    clearReadBuffer();
-    mFile->remove();
-    mSocket->disconnectFromHost();
+    discardFile();
 }
@@ -19,35 +19,186 @@
 #ifndef RECEIVER_H
 #define RECEIVER_H
 
+#include <QBitArray>
+#include <QHash>
+#include <QJsonObject>
+#include <QMap>
+#include <QMutex>
+#include <QVector>
+
 #include "transfer.h"
+#include "fileheader.h"
 #include "model/device.h"
 
+class FileWriter;
+class FileChecksum;
+class SignatureBuilder;
+
 class Receiver : public Transfer
 {
 public:
-    Receiver(const Device& sender, QTcpSocket* socket, QObject* parent = nullptr);
+    Receiver(const Device& sender, Session* session, quint32 streamId, QObject* parent = nullptr);
+    ~Receiver() override;
 
     inline Device getSender() const { return mSenderDev; }
     inline qint64 getReceivedFileSize() const { return mFileSize; }
     inline qint64 getBytesWritten() const { return mBytesRead; }
 
+    /*
+     * True if the header opens a stripe of another file
+     * instead of a new file.
+     */
+    static bool isStripeHeader(const QByteArray& header);
+
     void resume() override;
     void pause() override;
     void cancel() override;
 
-private Q_SLOTS:
-    void onDisconnected();
-
 private:
+    void onSessionDisconnected() override;
+
     void processHeaderPacket(QByteArray& data) override;
+    void onDedupChecked(const QString& dstFolderPath, bool ok, quint64 digest);
+    void acceptFile(const FileHeader& header, const QString& dstFolderPath);
+    void commitInlineFile(const FileHeader& header, const QString& dstFolderPath);
+    void sendAccept();
     void processDataPacket(QByteArray& data) override;
     void processFinishPacket(QByteArray& data) override;
     void processCancelPacket(QByteArray& data) override;
+    void processDeltaPacket(QByteArray& data) override;
+    void processCompressedPacket(QByteArray& data) override;
+    void processChecksumPacket(QByteArray& data) override;
+    void processChunksPacket(QByteArray& data) override;
+
+    bool startSplice(const QByteArray& buffered, qint32 packetDataSize) override;
+    void processSplicedData(const QByteArray& data) override;
+    qint64 spliceFrom(int socketDescriptor, qint64 size) override;
+
+    void joinStripe(const QString& token);
+    void adoptStripe(Receiver* stripe);
+    void onStreamFinished();
+    void completeIfDone();
+    void addBytesReceived(qint64 bytes);
+    bool writeAt(qint64 offset, const char* data, qint64 size);
+
+    bool resumeFile(QString& filePath);
+    void addReceivedRange(qint64 offset, qint64 size);
+    void removeReceivedRange(qint64 offset, qint64 size);
+    void saveResumeRecord();
+    void removeResumeRecord();
+
+    void startWriter();
+    void stopWriter();
+    void discardFile();
+    void addPendingWrite(qint64 bytes);
+    void onBytesWritten(qint64 offset, qint64 bytes);
+    void onCommitted(bool ok);
+    void onChunkCopied(qint64 offset, qint64 size, bool ok);
+    void onChecksumFinished(bool ok, quint64 digest);
+    void onBlockHashed(int block, quint64 blockHash);
+    void checkBlock(int block);
+    bool retransmit();
+    void setReadingSuspended(bool suspended);
+
+    void startDelta();
+    void onSignatureBuilt(QByteArray signature);
+
+    /*
+     * Negotiated file, Data packets start with their file offset and
+     * may arrive from the primary stream or any of its stripes.
+     */
+    inline Receiver* primary() { return mPrimary ? mPrimary : this; }
+    inline bool isPendingStripe() const { return mPositional && !mPrimary && !mFile; }
 
     Device mSenderDev;
 
+    /*
+     * Header of the file, held until the sender is answered. The
+     * file may already be here (mDedupCheck hashes the copy at the
+     * destination) or be partly built from local chunks.
+     */
+    FileHeader mHeader;
+    FileChecksum* mDedupCheck;
+
+    /*
+     * Content-defined chunks of a new file found in files received
+     * before, the sender is answered once they are copied.
+     */
+    bool mAwaitingChunks;
+    int mChunkCopies;
+
     qint64 mFileSize;
     qint64 mBytesRead;
+
+    /*
+     * Write-behind, data is written by mWriter on the disk's writer
+     * thread. mWriteOffset is where the next Data packet of an
+     * unstriped file goes.
+     */
+    FileWriter* mWriter;
+    qint64 mWritesPending;
+    qint64 mWriteOffset;
+    bool mReadingSuspended;
+    bool mFinishing;
+
+    /*
+     * End-to-end checksum, built as data reaches the disk and
+     * compared with the one in the sender's Finish.
+     */
+    FileChecksum* mChecksum;
+    quint64 mDigest;
+    bool mHasDigest;
+    bool mVerifying;
+
+    /*
+     * Verified transfer, every block is checked against the sender's
+     * hash as soon as it is on disk. Blocks that don't match are asked
+     * for again after Finish, up to a few times.
+     */
+    QHash<int, quint64> mSenderHashes;
+    QBitArray mFailedBlocks;
+    int mRetransmits;
+    bool mVerify;
+
+    /*
+     * Delta transfer, the file is rebuilt from mBasisPath (the old
+     * copy) and Delta packets into a temporary file that replaces
+     * mDeltaTarget when done.
+     */
+    SignatureBuilder* mSignatureBuilder;
+    QString mBasisPath;
+    QString mDeltaTarget;
+    qint64 mBasisSize;
+    int mBlockSize;
+    bool mCommitPending;
+
+    /*
+     * Resume, the parts of the file on disk (start -> end) are recorded
+     * in a sidecar file next to it until the file is complete, so an
+     * interrupted transfer of the same file can continue from there.
+     */
+    QMap<qint64, qint64> mReceived;
+    QJsonObject mResumeIdentity;
+    QString mResumePath;
+    qint64 mRecordSavedAt;
+    qint64 mSpliceOffset;
+    bool mResumable;
+    bool mInterrupted;
+
+    Receiver* mPrimary;
+    QVector<Receiver*> mStripes;
+    QString mStripeToken;
+    int mStripeCount;
+    int mStreamsFinished;
+    bool mPositional;
+
+    /*
+     * Striped files waiting for their stripes, and stripes
+     * that arrived before their file, by token.
+     */
+    static QHash<QString, Receiver*> sStripedFiles;
+    static QMultiHash<QString, Receiver*> sPendingStripes;
+    static QMutex sStripesMutex;
 };
 
 #endif // RECEIVER_H
@@ -18,20 +18,124 @@
 
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QJsonArray>
+#include <QBitArray>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QTimer>
+#include <QUuid>
 #include <QDir>
+#include <QtEndian>
 #include <QtDebug>
 
 #include "settings.h"
 #include "sender.h"
+#include "sessionpool.h"
+#include "filereader.h"
+#include "delta.h"
+#include "checksum.h"
+#include "fileheader.h"
+#include "chunker.h"
+
+#if defined (Q_OS_LINUX)
+#include <fcntl.h>
+#endif
+
+/*
+ * Initial payload size of each Data packet on the zero-copy
+ * path, there is no user space buffer to bound it.
+ */
+#define ZeroCopyPacketSize  1024*1024
+
+/*
+ * A file gets one stripe (connection) per MinStripeSize bytes,
+ * up to Settings::getStripeCount(). Stripe boundaries are aligned
+ * to StripeAlignment.
+ */
+#define MinStripeSize       64*1024*1024  // 64 MB
+#define StripeAlignment     1024*1024
+
+/*
+ * Files from this size on are negotiated (delta transfer, resume and
+ * striping), every Delta packet covers about DeltaSliceSize bytes
+ * of the file.
+ */
+#define MinNegotiatedFileSize   1024*1024
+#define DeltaSliceSize          1024*1024
+
+/*
+ * Chunk list offered for files up to this size (about 12 bytes
+ * for every 64 KB of the file).
+ */
+#define MaxChunkedFileSize      Q_INT64_C(16)*1024*1024*1024
+
+/*
+ * Files up to this size go inside the Header packet, they are
+ * neither hashed for deduplication nor read ahead.
+ */
+#define MaxInlineFileSize       64*1024
+
+/*
+ * Reconnecting after the connection is lost, the delay doubles
+ * from ReconnectDelay up to MaxReconnectDelay (ms).
+ */
+#define ReconnectDelay          1000
+#define MaxReconnectDelay       30000
+#define MaxReconnectAttempts    10
+
+/*
+ * Block hashes of a verified transfer are sent in batches
+ * of this many (block index and hash, little endian).
+ */
+#define BlockHashBatch          64
+#define BlockHashEntrySize      12
+
+QHash<QString, int> Sender::sSendingFiles;
+QMutex Sender::sSendingMutex;
 
 Sender::Sender(const Device& receiver, const QString& folderName, const QString& filePath, QObject* parent)
-    : Transfer(nullptr, parent), mReceiverDev(receiver), mFilePath(filePath), mFolderName(folderName)
+    : Transfer(parent), mReceiverDev(receiver), mFilePath(filePath), mFolderName(folderName)
 {
     mFileSize = -1;
     mBytesRemaining = -1;
+    mBytesSent = 0;
 
     mFileBuffSize = Settings::instance()->getFileBufferSize();
-    mFileBuff.resize(mFileBuffSize);
+    mChecksum = nullptr;
+    mVerify = false;
+    mAwaitingVerdict = false;
+    mContentHash = 0;
+    mHasContentHash = false;
+    mChunker = nullptr;
+
+    mReader = nullptr;
+    mReadAheadChunks = 0;
+    mChunksRequested = 0;
+    mAdvisedOffset = 0;
+
+    mZeroCopy = false;
+    mCanZeroCopy = false;
+    mSending = false;
+    mFileOffset = 0;
+    mFinishPending = false;
+
+    mCompressor = nullptr;
+    mCompress = false;
+    mReadOffset = -1;
+    mQueuedOffset = -1;
+
+    mPrimary = nullptr;
+    mLane = 0;
+    mStripesFinished = 0;
+    mAwaitingJoin = false;
+    mRangeDone = false;
+
+    mNegotiated = false;
+    mAwaitingReply = false;
+    mPositional = false;
+    mEncoder = nullptr;
+
+    mReconnectAttempts = 0;
 
     mCancelled = false;
     mPaused = false;
@@ -40,32 +144,180 @@ Sender::Sender(const Device& receiver, const QString& folderName, const QString&
 
     mInfo->setTransferType(TransferType::Upload);
     mInfo->setPeer(receiver);
+
+    connect(mInfo, &TransferInfo::stateChanged, this, [this](TransferState state) {
+        if (state == TransferState::Finish || state == TransferState::Cancelled)
+            setSending(false);
+    });
+}
+
+Sender::Sender(Sender* primary, int lane, const QVector<Range>& ranges)
+    : Sender(primary->mReceiverDev, primary->mFolderName, primary->mFilePath, primary)
+{
+    mPrimary = primary;
+    mLane = lane;
+    mStripeToken = primary->mStripeToken;
+    mNegotiated = true;
+    mPositional = true;
+    mCompress = primary->mCompress;
+    mRanges = ranges;
+    nextRange();
+
+    /*
+     * Don't send data until the receiver has attached
+     * this stripe to its file (it answers with Resume).
+     */
+    mAwaitingJoin = true;
+}
+
+Sender::~Sender()
+{
+    setSending(false);
+    stopReader();
+    delete mEncoder;
+}
+
+bool Sender::openFile()
+{
+    mFile = new QFile(mFilePath, this);
+    if (!mFile->open(QIODevice::ReadOnly))
+        return false;
+
+#if defined (Q_OS_LINUX)
+    /*
+     * Regular files can be pushed from the page cache
+     * straight to the socket with sendfile().
+     */
+    mCanZeroCopy = QFileInfo(mFilePath).isFile() && mFile->handle() != -1;
+    if (mCanZeroCopy)
+        mFileBuffSize = qMax(mFileBuffSize, ZeroCopyPacketSize);
+#endif
+
+    /*
+     * Compressed chunks need the data in user space
+     */
+    mZeroCopy = mCanZeroCopy && !mCompress;
+
+    mChunkSize.reset(mFileBuffSize);
+    mFileBuffSize = mChunkSize.chunkSize();
+    mInfo->setChunkSize(mFileBuffSize);
+
+    mAdvisedOffset = mFileOffset;
+    return true;
 }
 
 bool Sender::start()
 {
     mInfo->setFilePath(mFilePath);
-    mFile = new QFile(mFilePath, this);
-    bool ok = mFile->open(QIODevice::ReadOnly);
+    bool ok = openFile();
     if (ok) {
         mFileSize = mFile->size();
         mInfo->setDataSize(mFileSize);
         mBytesRemaining = mFileSize;
         emit mInfo->fileOpened();
+
+        mChecksum = new FileChecksum(mFilePath, mFileSize, this);
+        connect(mChecksum, &FileChecksum::finished, this, &Sender::onChecksumFinished);
+        connect(mChecksum, &FileChecksum::blockHashed, this, &Sender::onBlockHashed);
+
+        mNegotiated = mFileSize >= MinNegotiatedFileSize;
+        mAwaitingReply = mNegotiated;
+        if (mNegotiated)
+            mStripeToken = QUuid::createUuid().toString();
+
+        setSending(true);
     }
 
-    if (mFileSize > 0) {
-        QHostAddress receiverAddress = mReceiverDev.getAddress();
-        setSocket(new QTcpSocket(this));
-        mSocket->connectToHost(receiverAddress, Settings::instance()->getTransferPort(), QAbstractSocket::ReadWrite);
+    /*
+     * Empty files are sent too, the receiver creates them
+     */
+    if (ok) {
+        /*
+         * Every Sender to the same receiver shares one connection
+         */
+        setSession(SessionPool::instance()->session(mReceiverDev));
         mInfo->setState(TransferState::Waiting);
 
-        connect(mSocket, &QTcpSocket::bytesWritten, this, &Sender::onBytesWritten);
-        connect(mSocket, &QTcpSocket::connected, this, &Sender::onConnected);
-        connect(mSocket, &QTcpSocket::disconnected, this, &Sender::onDisconnected);
+        if (mSession->isReady())
+            onSessionConnected();
+    }
+
+    return ok && mSession;
+}
+
+/*
+ * Split what is missing of a large file into even shares, this Sender
+ * keeps the first one and every other share is sent by a stripe over
+ * its own connection.
+ */
+void Sender::startStripes(const QVector<Range>& missing)
+{
+    qint64 missingBytes = 0;
+    for (const Range& range : missing)
+        missingBytes += range.second;
+
+    int maxCount = mSession->peerSupports(Session::CapStriping) ? Settings::instance()->getStripeCount() : 1;
+    qint64 count = qBound<qint64>(1, missingBytes / MinStripeSize, maxCount);
+    qint64 share = (missingBytes / count + StripeAlignment - 1) / StripeAlignment * StripeAlignment;
+
+    QVector< QVector<Range> > lanes(static_cast<int>(count));
+    int lane = 0;
+    qint64 room = share;
+    for (Range range : missing) {
+        while (range.second > 0) {
+            qint64 length = (lane < count - 1) ? qMin(range.second, room) : range.second;
+            lanes[lane].push_back(Range(range.first, length));
+            range.first += length;
+            range.second -= length;
+            room -= length;
+
+            if (room == 0 && lane < count - 1) {
+                lane++;
+                room = share;
+            }
+        }
+    }
+
+    mRanges = lanes.at(0);
+    for (int i = 1; i < lanes.size() && !lanes.at(i).isEmpty(); i++) {
+        Sender* stripe = new Sender(this, i, lanes.at(i));
+        mStripes.push_back(stripe);
+        stripe->startStripe();
+    }
+}
+
+bool Sender::startStripe()
+{
+    if (!openFile()) {
+        mPrimary->mInfo->setState(TransferState::Disconnected);
+        emit mPrimary->mInfo->errorOcurred(tr("Error while reading file."));
+        return false;
     }
 
-    return ok && mSocket;
+    mFileSize = mPrimary->mFileSize;
+    setSession(SessionPool::instance()->session(mReceiverDev, mLane));
+    mInfo->setState(TransferState::Waiting);
+
+    if (mSession->isReady())
+        onSessionConnected();
+
+    return true;
+}
+
+/*
+ * Move on to the next range of this lane, false if there is none
+ */
+bool Sender::nextRange()
+{
+    if (mRanges.isEmpty())
+        return false;
+
+    Range range = mRanges.takeFirst();
+    mFileOffset = range.first;
+    mBytesRemaining = range.second;
+    mAdvisedOffset = mFileOffset;
+    stopReader();
+    return true;
 }
 
 void Sender::resume()
@@ -73,7 +325,11 @@ void Sender::resume()
     if (mInfo->canResume()) {
         mInfo->setState(mInfo->getLastState());
         mPaused = false;
+        mChunkSize.restartWindow();
         sendData();
+
+        for (Sender* stripe : mStripes)
+            stripe->resume();
     }
 }
 
@@ -82,102 +338,613 @@ void Sender::pause()
     if (mInfo->canPause()) {
         mInfo->setState(TransferState::Paused);
         mPaused = true;
+
+        for (Sender* stripe : mStripes)
+            stripe->pause();
     }
 }
 
 void Sender::cancel()
 {
     if (mInfo->canCancel()) {
-        writePacket(0, PacketType::Cancel, QByteArray());
+        writePacket(PacketType::Cancel, QByteArray());
         mInfo->setState(TransferState::Cancelled);
         mInfo->setProgress(0);
         mCancelled = true;
+        detachSession();
+        stopReader();
+
+        for (Sender* stripe : mStripes)
+            stripe->cancel();
     }
 }
 
-void Sender::onConnected()
+void Sender::onSessionConnected()
 {
     mInfo->setState(TransferState::Transfering);
     sendHeader();
 }
 
-void Sender::onDisconnected()
+void Sender::onSessionWritable()
+{
+    if (mFinishPending)
+        finish();
+    else
+        sendData();
+}
+
+void Sender::onSessionDisconnected()
+{
+    mSession = nullptr;
+    if (mPrimary) {
+        mInfo->setState(TransferState::Disconnected);
+        mPrimary->interrupt();
+    }
+    else {
+        interrupt();
+    }
+}
+
+/*
+ * Connection to the receiver lost, every lane is torn down and the
+ * file is offered again after a while. The receiver answers with
+ * the parts it already has.
+ */
+void Sender::interrupt()
 {
+    TransferState state = mInfo->getState();
+    if (mCancelled || state == TransferState::Finish || state == TransferState::Disconnected)
+        return;
+
+    for (Sender* stripe : mStripes)
+        stripe->abandon();
+    mStripes.clear();
+    mStripesFinished = 0;
+
+    writePacket(PacketType::Cancel, QByteArray());
+    detachSession();
+    stopReader();
+    delete mEncoder;
+    mEncoder = nullptr;
+
     mInfo->setState(TransferState::Disconnected);
-    emit mInfo->errorOcurred(tr("Receiver disconnected"));
+    if (!mNegotiated || mReconnectAttempts >= MaxReconnectAttempts) {
+        emit mInfo->errorOcurred(tr("Receiver disconnected"));
+        return;
+    }
+
+    mIsHeaderSent = false;
+    mAwaitingReply = true;
+    mPositional = false;
+    mCompress = false;
+    mRanges.clear();
+    mFileOffset = 0;
+    mBytesRemaining = mFileSize;
+    mFinishPending = false;
+    mRangeDone = false;
+    mVerify = false;
+    mAwaitingVerdict = false;
+    mBlockHashes.clear();
+    mPaused = false;
+    mPausedByReceiver = false;
+
+    int delay = qMin(MaxReconnectDelay, ReconnectDelay << mReconnectAttempts);
+    mReconnectAttempts++;
+    QTimer::singleShot(delay, this, &Sender::reconnect);
 }
 
-void Sender::onBytesWritten(qint64 bytes)
+void Sender::reconnect()
 {
-    Q_UNUSED(bytes);
+    if (mCancelled)
+        return;
 
-    if (!mSocket->bytesToWrite()) {
-        sendData();
+    if (!mFile->isOpen() && !mFile->open(QIODevice::ReadOnly)) {
+        emit mInfo->errorOcurred(tr("Error while reading file."));
+        return;
     }
+
+    mInfo->setState(TransferState::Waiting);
+    setSession(SessionPool::instance()->session(mReceiverDev));
+    if (mSession->isReady())
+        onSessionConnected();
+}
+
+/*
+ * Stripe no longer needed, it never sent any data
+ */
+void Sender::abandon()
+{
+    mCancelled = true;
+    writePacket(PacketType::Cancel, QByteArray());
+    detachSession();
+    stopReader();
+    deleteLater();
 }
 
+/*
+ * This Sender's range is done, the file is done once every
+ * stripe is done too.
+ */
 void Sender::finish()
 {
+    mFinishPending = false;
+    mRangeDone = true;
     mFile->close();
+    stopReader();
+
+    delete mEncoder;
+    mEncoder = nullptr;
+
+    if (mPrimary) {
+        writePacket(PacketType::Finish, QByteArray());
+        detachSession();
+        mInfo->setState(TransferState::Finish);
+        mPrimary->onStripeFinished();
+    }
+    else {
+        completeIfDone();
+    }
+}
+
+void Sender::setSending(bool sending)
+{
+    if (sending == mSending)
+        return;
+
+    mSending = sending;
+    QMutexLocker locker(&sSendingMutex);
+    if (sending) {
+        sSendingFiles[mFilePath]++;
+    }
+    else if (--sSendingFiles[mFilePath] == 0) {
+        sSendingFiles.remove(mFilePath);
+    }
+}
+
+bool Sender::isFileShared() const
+{
+    QMutexLocker locker(&sSendingMutex);
+    return sSendingFiles.value(mFilePath) > 1;
+}
+
+void Sender::completeIfDone()
+{
+    if (mRangeDone && mStripesFinished == mStripes.size())
+        mChecksum->finish();
+}
+
+/*
+ * The primary's Finish tells the receiver how many lanes
+ * to wait for and what the file must hash to.
+ */
+void Sender::onChecksumFinished(bool ok, quint64 digest)
+{
+    if (mCancelled || !mRangeDone || mStripesFinished != mStripes.size())
+        return;
+
+    QJsonObject obj;
+    if (mPositional)
+        obj.insert("stripes", mStripes.size() + 1);
+
+    /*
+     * Sending it again offers its content hash
+     */
+    if (ok) {
+        obj.insert("checksum", QString::number(digest, 16));
+        mChecksum->saveToCache();
+    }
+    else
+        emit mInfo->errorOcurred(tr("Error while reading file."));
+
+    flushBlockHashes();
+    writePacket(PacketType::Finish, QJsonDocument(obj).toJson(QJsonDocument::Compact));
+
+    /*
+     * Not done until the receiver has checked every block
+     */
+    if (mVerify && ok) {
+        mAwaitingVerdict = true;
+        return;
+    }
+
+    detachSession();
+
     mInfo->setState(TransferState::Finish);
     emit mInfo->done();
+}
+
+void Sender::onBlockHashed(int block, quint64 blockHash)
+{
+    if (mVerify && !mAwaitingReply && mSession)
+        addBlockHash(block, blockHash);
+}
+
+void Sender::addBlockHash(int block, quint64 blockHash)
+{
+    char entry[BlockHashEntrySize];
+    qToLittleEndian<qint32>(block, entry);
+    qToLittleEndian<quint64>(blockHash, entry + sizeof(qint32));
+    mBlockHashes.append(entry, BlockHashEntrySize);
 
-    writePacket(0, PacketType::Finish, QByteArray());
+    if (mBlockHashes.size() >= BlockHashBatch * BlockHashEntrySize)
+        flushBlockHashes();
+}
+
+void Sender::flushBlockHashes()
+{
+    if (mBlockHashes.isEmpty())
+        return;
+
+    writePacket(PacketType::Checksum, mBlockHashes);
+    mBlockHashes.clear();
+}
+
+void Sender::onStripeFinished()
+{
+    mStripesFinished++;
+    completeIfDone();
+}
+
+void Sender::addBytesSent(qint64 bytes)
+{
+    if (mPrimary) {
+        mPrimary->addBytesSent(bytes);
+        return;
+    }
+
+    mBytesSent += bytes;
+    mInfo->setProgress(mFileSize ? (int) (mBytesSent * 100 / mFileSize) : 100);
+}
+
+void Sender::setPausedByReceiver(bool paused)
+{
+    mPausedByReceiver = paused;
+    if (!paused) {
+        mChunkSize.restartWindow();
+        sendData();
+    }
 }
 
 void Sender::sendData()
 {
-    if (!mBytesRemaining || mCancelled || mPausedByReceiver || mPaused)
+    if (!mIsHeaderSent || !mBytesRemaining || mCancelled || mPausedByReceiver ||
+            mPaused || mAwaitingJoin || mAwaitingReply || !mSession)
         return;
 
-    if (mBytesRemaining < mFileBuffSize) {
-        mFileBuff.resize(mBytesRemaining);
-        mFileBuffSize = mFileBuff.size();
+    if (!mSession->canWrite()) {
+        mCompression.setLinkBusy();
+        return;
     }
 
-    qint64 bytesRead = mFile->read(mFileBuff.data(), mFileBuffSize);
-    if (bytesRead == -1) {
-        emit mInfo->errorOcurred(tr("Error while reading file."));
+    if (mEncoder) {
+        qint64 consumed;
+        QByteArray ops = mEncoder->next(DeltaSliceSize, consumed);
+        if (mEncoder->hasError()) {
+            emit mInfo->errorOcurred(tr("Error while reading file."));
+            return;
+        }
+
+        checksum()->addRange(mFileSize - mBytesRemaining, consumed);
+        mBytesRemaining -= consumed;
+        addBytesSent(consumed);
+
+        if (!ops.isEmpty())
+            writePacket(PacketType::Delta, ops);
+
+        if (mEncoder->atEnd()) {
+            mBytesRemaining = 0;
+            finish();
+        }
+        return;
+    }
+
+    /*
+     * Another receiver gets the same file, the rest of it is read
+     * once for both through the shared blocks (ReadCache) instead
+     * of once per receiver by sendfile().
+     */
+    if (mZeroCopy && isFileShared())
+        mZeroCopy = false;
+
+    if (mZeroCopy) {
+        qint32 chunkSize = static_cast<qint32>(qMin<qint64>(mBytesRemaining, mFileBuffSize));
+
+        /*
+         * Payload is moved by the kernel once the session gets to it,
+         * finish() waits until the session is drained.
+         */
+        QByteArray prefix;
+        if (mPositional) {
+            prefix = QByteArray(sizeof(mFileOffset), Qt::Uninitialized);
+            qToLittleEndian<qint64>(mFileOffset, prefix.data());
+        }
+
+        adviseReadAhead();
+        mSession->writeFilePacket(mStreamId, mFile->handle(), mFileOffset, chunkSize, prefix);
+        checksum()->addRange(mFileOffset, chunkSize);
+        mFileOffset += chunkSize;
+        mBytesRemaining -= chunkSize;
+        addBytesSent(chunkSize);
+        addChunkSent(chunkSize);
+
+        if (!mBytesRemaining && !nextRange())
+            mFinishPending = true;
         return;
     }
 
-    mBytesRemaining -= bytesRead;
+    if (!mReader)
+        startReader();
+
+    /*
+     * Nothing read yet, onChunkRead() comes back
+     */
+    if (mReadyChunks.isEmpty())
+        return;
+
+    Chunk chunk = mReadyChunks.dequeue();
+    mChunksRequested--;
+    requestChunks();
+
+    mFileOffset += chunk.size;
+    mBytesRemaining -= chunk.size;
     if (mBytesRemaining < 0)
         mBytesRemaining = 0;
 
-    mInfo->setProgress( (int) ((mFileSize-mBytesRemaining) * 100 / mFileSize) );
+    addBytesSent(chunk.size);
 
-    writePacket(mFileBuffSize, PacketType::Data, mFileBuff);
+    writePacket(chunk.type, chunk.data);
+    addChunkSent(chunk.data.size());
 
-    if (!mBytesRemaining) {
+    if (!mBytesRemaining && !nextRange()) {
         finish();
     }
 }
 
+/*
+ * The next chunks are read with the size the
+ * link calls for.
+ */
+void Sender::addChunkSent(qint64 bytes)
+{
+    if (!mChunkSize.addSent(bytes) || !mChunkSize.adjust(mSession->roundTripTime()))
+        return;
+
+    mFileBuffSize = mChunkSize.chunkSize();
+    mInfo->setChunkSize(mFileBuffSize);
+    if (mReader) {
+        mReadAheadChunks = qMax(2, Settings::instance()->getReadAheadSize() / mFileBuffSize);
+        QMetaObject::invokeMethod(mReader, "setChunkSize", Qt::QueuedConnection, Q_ARG(qint32, mFileBuffSize));
+    }
+}
+
+void Sender::startReader()
+{
+    int headroom = mPositional ? sizeof(mFileOffset) : 0;
+    mReader = new FileReader(mFilePath, mFileOffset, mBytesRemaining, mFileBuffSize, headroom);
+    mReadAheadChunks = qMax(2, Settings::instance()->getReadAheadSize() / mFileBuffSize);
+    mChunksRequested = 0;
+    mReadOffset = mFileOffset;
+    mQueuedOffset = mFileOffset;
+
+    if (mCompress && !mCompressor) {
+        mCompressor = new Compressor(headroom, this);
+        connect(mCompressor, &Compressor::compressed, this, &Sender::onChunkCompressed);
+    }
+
+    connect(mReader, &FileReader::chunkRead, this, &Sender::onChunkRead);
+    connect(mReader, &FileReader::errorOcurred, this, [this]() {
+        Sender* primary = mPrimary ? mPrimary : this;
+        emit primary->mInfo->errorOcurred(tr("Error while reading file."));
+    });
+
+    requestChunks();
+}
+
+void Sender::stopReader()
+{
+    if (mReader) {
+        mReader->deleteLater();
+        mReader = nullptr;
+    }
+
+    mReadyChunks.clear();
+    mReadOffset = -1;
+    mQueuedOffset = -1;
+}
+
+void Sender::requestChunks()
+{
+    int chunks = mReadAheadChunks - mChunksRequested;
+    if (chunks <= 0)
+        return;
+
+    mChunksRequested += chunks;
+    QMetaObject::invokeMethod(mReader, "read", Qt::QueuedConnection, Q_ARG(int, chunks));
+}
+
+void Sender::onChunkRead(qint64 offset, QByteArray chunk)
+{
+    /*
+     * Left over from a reader that has been stopped
+     */
+    if (offset != mReadOffset)
+        return;
+
+    qint64 size = chunk.size() - (mPositional ? sizeof(offset) : 0);
+    mReadOffset += size;
+
+    if (mPositional)
+        qToLittleEndian<qint64>(offset, chunk.data());
+
+    checksum()->addData(offset, chunk, chunk.size() - size);
+
+    if (mCompress) {
+        mCompressor->compress(offset, chunk, mCompression.level(), mCompression.nextIsProbe());
+        return;
+    }
+
+    enqueueChunk(offset, PacketType::Data, chunk, size);
+}
+
+void Sender::onChunkCompressed(qint64 offset, QByteArray chunk, qint32 rawSize,
+                               bool isCompressed, bool probe, qint64 nsecs)
+{
+    if (offset != mQueuedOffset)
+        return;
+
+    if (probe)
+        mCompression.addProbeResult(isCompressed);
+    mCompression.addChunk(rawSize, nsecs);
+
+    /*
+     * The file doesn't compress (media, archives), the rest of it
+     * is read again and sent raw, zero-copy where possible.
+     */
+    if (mCompress && !mCompression.isEnabled()) {
+        mCompress = false;
+        stopReader();
+        mZeroCopy = mCanZeroCopy;
+        sendData();
+        return;
+    }
+
+    enqueueChunk(offset, isCompressed ? PacketType::Compressed : PacketType::Data, chunk, rawSize);
+}
+
+void Sender::enqueueChunk(qint64 offset, PacketType type, const QByteArray& data, qint64 size)
+{
+    if (offset != mQueuedOffset)
+        return;
+
+    mQueuedOffset += size;
+    mReadyChunks.enqueue({ type, data, size });
+    sendData();
+}
+
+/*
+ * sendfile() reads the page cache synchronously, ask the kernel
+ * to read the next part of the file while this one is sent.
+ */
+void Sender::adviseReadAhead()
+{
+#if defined (Q_OS_LINUX)
+    qint64 readAhead = Settings::instance()->getReadAheadSize();
+    qint64 end = mFileOffset + qMin(mBytesRemaining, readAhead);
+    if (mAdvisedOffset - mFileOffset > readAhead / 2 || mAdvisedOffset >= end)
+        return;
+
+    posix_fadvise(mFile->handle(), mAdvisedOffset, end - mAdvisedOffset, POSIX_FADV_WILLNEED);
+    mAdvisedOffset = end;
+#endif
+}
+
 void Sender::sendHeader()
 {
-    QString fName = QDir(mFile->fileName()).dirName();
+    /*
+     * Only a hash the HashCache has (the file was sent or received
+     * before) is offered, the file is not read just to make one.
+     */
+    if (!mPrimary && !mHasContentHash && mFileSize > MaxInlineFileSize &&
+            mSession->peerSupports(Session::CapDedup) && mChecksum->loadFromCache()) {
+        mContentHash = mChecksum->digest();
+        mHasContentHash = true;
+    }
+
+    FileHeader header;
+    if (mPrimary) {
+        header.join = mStripeToken;
+        header.stripe = mLane;
+    }
+    else {
+        header.name = QDir(mFile->fileName()).dirName();
+        header.folder = mFolderName;
+        header.size = mFileSize;
+
+        if (mNegotiated && !mSession->peerSupports(Session::CapResume)) {
+            mNegotiated = false;
+            mAwaitingReply = false;
+        }
+
+        /*
+         * The token names the file for its stripes and for
+         * resuming, the receiver must answer a header with it.
+         */
+        if (mNegotiated) {
+            header.token = mStripeToken;
+            header.mtime = QFileInfo(mFilePath).lastModified().toMSecsSinceEpoch();
+            if (mSession->peerSupports(Session::CapDelta))
+                header.flags |= FileHeader::Delta;
+            if (mSession->peerSupports(Session::CapChecksums))
+                header.flags |= FileHeader::Verify;
+            if (mFileSize <= MaxChunkedFileSize && mSession->peerSupports(Session::CapChunks))
+                header.flags |= FileHeader::Chunks;
+            if (Settings::instance()->getCompression() && mSession->peerSupports(Session::CapCompression))
+                header.flags |= FileHeader::Compress;
+        }
 
-    QJsonObject obj( QJsonObject::fromVariantMap({
-                                    {"name", fName},
-                                    {"folder", mFolderName },
-                                    {"size", mFileSize}
-                                }));
+        if (mHasContentHash && mSession->peerSupports(Session::CapDedup)) {
+            header.hash = mContentHash;
+            header.flags |= FileHeader::HasHash;
+            mAwaitingReply = true;
+        }
 
-    QByteArray headerData( QJsonDocument(obj).toJson() );
+        if (mFileSize <= MaxInlineFileSize && mSession->peerSupports(Session::CapInline)) {
+            sendInline(header);
+            return;
+        }
+    }
 
-    writePacket(headerData.size(), PacketType::Header, headerData);
+    writeHeader(header);
     mIsHeaderSent = true;
+
+    /*
+     * An empty file has no data, sendData() never gets to finish()
+     */
+    if (!mPrimary && mFileSize == 0 && !mAwaitingReply)
+        finish();
+}
+
+/*
+ * The whole file goes with the header, the receiver
+ * doesn't answer.
+ */
+void Sender::sendInline(FileHeader& header)
+{
+    header.payload = mFile->read(mFileSize);
+    if (header.payload.size() != mFileSize) {
+        emit mInfo->errorOcurred(tr("Error while reading file."));
+        return;
+    }
+
+    header.flags |= FileHeader::Inline;
+    writeHeader(header);
+    mIsHeaderSent = true;
+    mBytesRemaining = 0;
+    mFile->close();
+    detachSession();
+
+    addBytesSent(mFileSize);
+    mInfo->setState(TransferState::Finish);
+    emit mInfo->done();
 }
 
 void Sender::processCancelPacket(QByteArray& data)
 {
     Q_UNUSED(data);
 
+    if (mAwaitingVerdict) {
+        mAwaitingVerdict = false;
+        emit mInfo->errorOcurred(tr("Receiver could not verify the file"));
+    }
+
     mInfo->setState(TransferState::Cancelled);
     mInfo->setProgress(0);
-    mSocket->disconnectFromHost();
     mCancelled = true;
+    detachSession();
+    stopReader();
+
+    for (Sender* stripe : mStripes)
+        stripe->cancel();
 }
 
 void Sender::processPausePacket(QByteArray& data)
@@ -185,16 +952,213 @@ void Sender::processPausePacket(QByteArray& data)
     Q_UNUSED(data);
 
     mPausedByReceiver = true;
+    for (Sender* stripe : mStripes)
+        stripe->setPausedByReceiver(true);
 }
 
 void Sender::processResumePacket(QByteArray& data)
 {
     Q_UNUSED(data);
-    
+
+    /*
+     * Stripe has been attached by the receiver
+     */
+    if (mAwaitingJoin) {
+        mAwaitingJoin = false;
+        mChunkSize.restartWindow();
+        sendData();
+        return;
+    }
+
     mPausedByReceiver = false;
+    mChunkSize.restartWindow();
     if (mIsHeaderSent)
         sendData();
     else
         sendHeader();
+
+    for (Sender* stripe : mStripes)
+        stripe->setPausedByReceiver(false);
+}
+
+/*
+ * The receiver rebuilds the whole file from its own copy
+ * over this stream, stripes are not used.
+ */
+void Sender::processSignaturePacket(QByteArray& data)
+{
+    if (!mAwaitingReply)
+        return;
+
+    mAwaitingReply = false;
+    mReconnectAttempts = 0;
+    mFileOffset = 0;
+    mBytesRemaining = mFileSize;
+    mBytesSent = 0;
+    addBytesSent(0);
+
+    DeltaSignature signature;
+    if (signature.parse(data)) {
+        stopReader();
+        mZeroCopy = false;
+        mFile->seek(0);
+        mEncoder = new DeltaEncoder(mFile, signature);
+    }
+
+    sendData();
+}
+
+/*
+ * The receiver takes the file as sent, minus the ranges it kept
+ * from an interrupted transfer, or has an identical copy of it.
+ */
+void Sender::processAcceptPacket(QByteArray& data)
+{
+    if (!mAwaitingReply)
+        return;
+
+    mAwaitingReply = false;
+    mReconnectAttempts = 0;
+
+    /*
+     * Receiver has the same file already
+     */
+    QJsonObject obj = QJsonDocument::fromJson(data).object();
+    if (obj.value("identical").toBool()) {
+        mRangeDone = true;
+        mBytesRemaining = 0;
+        mBytesSent = mFileSize;
+        addBytesSent(0);
+        stopReader();
+        mFile->close();
+        detachSession();
+        mInfo->setState(TransferState::Finish);
+        emit mInfo->done();
+        return;
+    }
+
+    if (!mNegotiated) {
+        sendData();
+        return;
+    }
+
+    mPositional = true;
+    mCompress = obj.value("compress").toBool();
+    mZeroCopy = mCanZeroCopy && !mCompress;
+    mCompression.reset();
+
+    /*
+     * A new receiver, it gets the hashes of the blocks
+     * read before too.
+     */
+    mVerify = obj.value("verify").toBool();
+    mBlockHashes.clear();
+    for (int block = 0; mVerify && block < mChecksum->blockCount(); block++) {
+        quint64 blockHash;
+        if (mChecksum->blockHash(block, blockHash))
+            addBlockHash(block, blockHash);
+    }
+
+    QVector<Range> missing;
+    qint64 offset = 0;
+    const QJsonArray have = obj.value("have").toArray();
+    for (const QJsonValue& value : have) {
+        QJsonArray range = value.toArray();
+        qint64 start = qBound<qint64>(0, range.at(0).toVariant().value<qint64>(), mFileSize);
+        qint64 end = qBound<qint64>(0, range.at(1).toVariant().value<qint64>(), mFileSize);
+        if (start > offset)
+            missing.push_back(Range(offset, start - offset));
+        offset = qMax(offset, end);
+    }
+
+    if (offset < mFileSize)
+        missing.push_back(Range(offset, mFileSize - offset));
+
+    mBytesSent = mFileSize;
+    for (const Range& range : missing)
+        mBytesSent -= range.second;
+    addBytesSent(0);
+
+    mChunkSize.restartWindow();
+    startStripes(missing);
+    if (nextRange())
+        sendData();
+    else
+        finish();
+}
+
+/*
+ * The receiver's answer to Finish, a bitmap of the blocks that
+ * didn't match their hash. Empty if the whole file did.
+ */
+void Sender::processVerifyPacket(QByteArray& data)
+{
+    if (!mAwaitingVerdict)
+        return;
+
+    mAwaitingVerdict = false;
+    QBitArray failed = QBitArray::fromBits(data.constData(), qMin<qint64>(data.size() * 8, mChecksum->blockCount()));
+
+    QVector<Range> ranges;
+    for (int block = 0; block < failed.size(); block++) {
+        if (!failed.testBit(block))
+            continue;
+
+        qint64 offset, size;
+        mChecksum->blockBounds(block, offset, size);
+        if (!ranges.isEmpty() && ranges.last().first + ranges.last().second == offset)
+            ranges.last().second += size;
+        else
+            ranges.push_back(Range(offset, size));
+
+        mBytesSent -= size;
+    }
+
+    if (ranges.isEmpty()) {
+        detachSession();
+        mInfo->setState(TransferState::Finish);
+        emit mInfo->done();
+        return;
+    }
+
+    /*
+     * Only the broken blocks are sent again, by this lane
+     */
+    if (!mFile->open(QIODevice::ReadOnly)) {
+        emit mInfo->errorOcurred(tr("Error while reading file."));
+        cancel();
+        return;
+    }
+
+    addBytesSent(0);
+    mRangeDone = false;
+    mZeroCopy = mCanZeroCopy && !mCompress;
+    mRanges = ranges;
+    nextRange();
+    mChunkSize.restartWindow();
+    sendData();
 }
 
+/*
+ * The receiver asks for the chunk list of the file
+ */
+void Sender::processChunksPacket(QByteArray& data)
+{
+    Q_UNUSED(data);
+
+    if (!mAwaitingReply || mChunker)
+        return;
+
+    mChunker = new Chunker(this);
+    connect(mChunker, &Chunker::chunked, this, [this](bool ok, QVector<Chunker::Chunk> chunks) {
+        mChunker->deleteLater();
+        mChunker = nullptr;
+
+        /*
+         * An empty list makes the receiver take the whole file
+         */
+        if (mAwaitingReply && mSession)
+            writePacket(PacketType::Chunks, ok ? Chunker::encode(chunks) : QByteArray());
+    });
+    mChunker->start(mFilePath);
+}
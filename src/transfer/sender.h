@@ -19,13 +19,28 @@
 #ifndef SENDER_H
 #define SENDER_H
 
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QQueue>
+#include <QVector>
+
 #include "transfer.h"
+#include "compressor.h"
+#include "chunksizecontrol.h"
 #include "model/device.h"
 
+class FileReader;
+class FileChecksum;
+class Chunker;
+class DeltaEncoder;
+class FileHeader;
+
 class Sender : public Transfer
 {
 public:
     Sender(const Device& receiver, const QString& folderName, const QString& filePath, QObject* parent = nullptr);
+    ~Sender() override;
 
     bool start();
 
@@ -35,28 +50,189 @@ public:
     void pause() override;
     void cancel() override;
 
-private Q_SLOTS:
-    void onBytesWritten(qint64 bytes);
-    void onConnected();
-    void onDisconnected();
-
 private:
+    /*
+     * Byte range of the file, offset and length
+     */
+    typedef QPair<qint64, qint64> Range;
+
+    /*
+     * Chunk ready to go out as a 'type' packet,
+     * it covers 'size' bytes of the file.
+     */
+    struct Chunk
+    {
+        PacketType type;
+        QByteArray data;
+        qint64 size;
+    };
+
+    /*
+     * Stripe of a large file, sends 'ranges' over its own
+     * connection ('lane') on behalf of 'primary'.
+     */
+    Sender(Sender* primary, int lane, const QVector<Range>& ranges);
+
+    bool openFile();
+    void startStripes(const QVector<Range>& missing);
+    bool startStripe();
+    bool nextRange();
+    void abandon();
+    void interrupt();
+    void reconnect();
+
+    void onSessionConnected() override;
+    void onSessionWritable() override;
+    void onSessionDisconnected() override;
+
     void finish();
+    void completeIfDone();
+    void addBytesSent(qint64 bytes);
+    void onStripeFinished();
+    void onChecksumFinished(bool ok, quint64 digest);
+    void onBlockHashed(int block, quint64 blockHash);
+    void addBlockHash(int block, quint64 blockHash);
+    void flushBlockHashes();
+    void setPausedByReceiver(bool paused);
     void sendData();
+    void startReader();
+    void stopReader();
+    void requestChunks();
+    void onChunkRead(qint64 offset, QByteArray chunk);
+    void onChunkCompressed(qint64 offset, QByteArray chunk, qint32 rawSize,
+                           bool isCompressed, bool probe, qint64 nsecs);
+    void enqueueChunk(qint64 offset, PacketType type, const QByteArray& data, qint64 size);
+    void adviseReadAhead();
+    void addChunkSent(qint64 bytes);
     void sendHeader();
+    void setSending(bool sending);
+    bool isFileShared() const;
+    void sendInline(FileHeader& header);
 
     void processCancelPacket(QByteArray& data) override;
     void processPausePacket(QByteArray& data) override;
     void processResumePacket(QByteArray& data) override;
+    void processSignaturePacket(QByteArray& data) override;
+    void processAcceptPacket(QByteArray& data) override;
+    void processVerifyPacket(QByteArray& data) override;
+    void processChunksPacket(QByteArray& data) override;
 
     Device mReceiverDev;
     QString mFilePath;
     QString mFolderName;
     qint64 mFileSize;
     qint64 mBytesRemaining;
+    qint64 mBytesSent;
 
-    QByteArray mFileBuff;
+    /*
+     * Size of the chunks read and sent, tuned to the link
+     * while the file is sent.
+     */
     qint32 mFileBuffSize;
+    ChunkSizeControl mChunkSize;
+
+    /*
+     * Checksum of the whole file (primary only), sent in the Finish
+     * packet once every lane is done.
+     */
+    FileChecksum* mChecksum;
+    inline FileChecksum* checksum() const { return mPrimary ? mPrimary->mChecksum : mChecksum; }
+
+    /*
+     * Verified transfer, the hash of every block goes to the receiver
+     * (batched in mBlockHashes). After Finish the receiver answers
+     * with the blocks that didn't match, which are sent again.
+     */
+    bool mVerify;
+    bool mAwaitingVerdict;
+    QByteArray mBlockHashes;
+
+    /*
+     * Deduplication, the header offers the content hash of the file
+     * (mContentHash) when it is in the HashCache. The receiver may
+     * answer that it has the file already.
+     */
+    quint64 mContentHash;
+    bool mHasContentHash;
+
+    /*
+     * Content-defined chunks of the file, the receiver asks for
+     * them to build the file from chunks it has already.
+     */
+    Chunker* mChunker;
+
+    /*
+     * Read-ahead, FileReader keeps up to mReadAheadChunks chunks
+     * read or being read on its own thread.
+     */
+    FileReader* mReader;
+    QQueue<Chunk> mReadyChunks;
+    int mReadAheadChunks;
+    int mChunksRequested;
+    qint64 mAdvisedOffset;
+
+    /*
+     * Kernel zero-copy (sendfile) on Linux, the file must stay
+     * open until the session has sent the last payload.
+     */
+    bool mZeroCopy;
+    bool mCanZeroCopy;
+
+    /*
+     * Files being sent and how many receivers get each one, a file
+     * sent to more than one is read through the shared blocks of
+     * ReadCache and not zero-copy.
+     */
+    bool mSending;
+    static QHash<QString, int> sSendingFiles;
+    static QMutex sSendingMutex;
+    qint64 mFileOffset;
+    bool mFinishPending;
+
+    /*
+     * Compression, negotiated with the receiver. Chunks go from the
+     * reader through mCompressor, mReadOffset and mQueuedOffset are
+     * the offsets of the next chunk expected from either of them.
+     */
+    Compressor* mCompressor;
+    CompressionControl mCompression;
+    bool mCompress;
+    qint64 mReadOffset;
+    qint64 mQueuedOffset;
+
+    /*
+     * Ranges still to send after the current one
+     * (mFileOffset, mBytesRemaining).
+     */
+    QVector<Range> mRanges;
+
+    /*
+     * Striping, every lane sends its own ranges of the file
+     */
+    Sender* mPrimary;
+    QVector<Sender*> mStripes;
+    QString mStripeToken;
+    int mLane;
+    int mStripesFinished;
+    bool mAwaitingJoin;
+    bool mRangeDone;
+
+    /*
+     * Negotiated files wait for the receiver's answer to the header:
+     * the signature of its old copy (delta transfer) or the parts it
+     * already has (Accept). Data packets then start with their
+     * file offset.
+     */
+    bool mNegotiated;
+    bool mAwaitingReply;
+    bool mPositional;
+    DeltaEncoder* mEncoder;
+
+    /*
+     * Reconnecting after the connection is lost, the receiver
+     * keeps what it got so far.
+     */
+    int mReconnectAttempts;
 
     bool mCancelled;
     bool mPaused;
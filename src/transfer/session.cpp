@@ -0,0 +1,729 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtEndian>
+
+#include "session.h"
+#include "settings.h"
+
+#if defined (Q_OS_LINUX)
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+/*
+ * Max bytes pulled from the socket per read() call
+ */
+#define SocketReadSize          256*1024
+
+/*
+ * Bound on what Qt buffers from the socket, so suspended
+ * reading pushes back on the sender.
+ */
+#define SocketReadBufferSize    1024*1024
+
+/*
+ * While a stream is spliced, Qt only pulls this much into its own
+ * buffer per notification, the rest stays in the kernel for splice().
+ */
+#define SpliceReadBufferSize    16*1024
+
+/*
+ * Outgoing session with no stream is closed after this
+ */
+#define SessionIdleTimeout      30000   // 30 secs
+
+/*
+ * A peer that doesn't say Hello for this long is dropped
+ */
+#define HelloTimeout            3000    // 3 secs
+#define HelloMagic              0x534e414c  // "LANS"
+#define HelloSize               10
+
+Session::Session(QTcpSocket* socket, QObject* parent)
+    : QObject(parent), mSocket(socket), mIncoming(true)
+{
+    mSocket->setParent(this);
+    setupSocket();
+    sendHello();
+    mHelloTimer.start();
+
+    /*
+     * The socket may have been moved from the server's thread,
+     * data that came in meanwhile didn't reach onReadyRead().
+     */
+    if (mSocket->bytesAvailable() > 0)
+        QTimer::singleShot(0, this, &Session::onReadyRead);
+}
+
+Session::Session(const QHostAddress& address, quint16 port, QObject* parent)
+    : QObject(parent), mSocket(new QTcpSocket(this)), mIncoming(false)
+{
+    setupSocket();
+    mSocket->connectToHost(address, port, QAbstractSocket::ReadWrite);
+}
+
+Session::~Session()
+{
+    while (!mWriteQueue.isEmpty())
+        dequeueWrite();
+}
+
+void Session::setupSocket()
+{
+    mNextStreamId = 1;
+    mWriteNotifier = nullptr;
+    mWriteCount = 0;
+    mQueuedBytes = 0;
+    mWriteBudget = Settings::instance()->getReadAheadSize();
+    mSendFileSupported = true;
+
+    mSpliceStream = nullptr;
+    mSpliceStalled = false;
+    mSplicePending = 0;
+    mSkipPending = 0;
+
+    mIdleTimer.setSingleShot(true);
+    mIdleTimer.setInterval(SessionIdleTimeout);
+    connect(&mIdleTimer, &QTimer::timeout, this, &Session::onIdleTimeout);
+
+    mHandshakeDone = false;
+    mPeerVersion = 0;
+    mPeerCapabilities = 0;
+    mHelloTimer.setSingleShot(true);
+    mHelloTimer.setInterval(HelloTimeout);
+    connect(&mHelloTimer, &QTimer::timeout, this, &Session::onHelloTimeout);
+
+    mSocket->setReadBufferSize(SocketReadBufferSize);
+
+    connect(mSocket, &QTcpSocket::readyRead, this, &Session::onReadyRead);
+    connect(mSocket, &QTcpSocket::bytesWritten, this, &Session::onBytesWritten);
+    connect(mSocket, &QTcpSocket::stateChanged, this, &Session::onStateChanged);
+}
+
+quint32 Session::attach(Transfer* stream)
+{
+    quint32 streamId = mNextStreamId++;
+    attach(stream, streamId);
+    return streamId;
+}
+
+void Session::attach(Transfer* stream, quint32 streamId)
+{
+    mStreams.insert(streamId, stream);
+    mIdleTimer.stop();
+}
+
+void Session::detach(quint32 streamId)
+{
+    Transfer* stream = mStreams.take(streamId);
+    resumeReading(streamId);
+
+    /*
+     * Drop the rest of a payload that was being spliced for this stream
+     */
+    if (stream && stream == mSpliceStream) {
+        mSkipPending = mSplicePending;
+        mSplicePending = 0;
+        mSpliceStream = nullptr;
+        resumeSplice();
+    }
+
+    if (mSplicingStreams.remove(streamId) && mSplicingStreams.isEmpty())
+        mSocket->setReadBufferSize(SocketReadBufferSize);
+
+    if (mStreams.isEmpty() && !mIncoming)
+        mIdleTimer.start();
+}
+
+qint64 Session::roundTripTime() const
+{
+#if defined (Q_OS_LINUX)
+    struct tcp_info info;
+    socklen_t length = sizeof(info);
+    if (getsockopt(static_cast<int>(mSocket->socketDescriptor()), IPPROTO_TCP, TCP_INFO, &info, &length) == 0)
+        return info.tcpi_rtt;
+#endif
+
+    return -1;
+}
+
+QByteArray Session::packetHeader(quint32 streamId, PacketType type, qint32 size) const
+{
+    QByteArray header(HeaderSize, Qt::Uninitialized);
+    char* p = header.data();
+
+    qToLittleEndian<qint32>(size, p);
+    p += sizeof(size);
+    *p++ = static_cast<char>(type);
+    qToLittleEndian<quint32>(streamId, p);
+
+    return header;
+}
+
+void Session::sendHello()
+{
+    QByteArray data(HelloSize, Qt::Uninitialized);
+    char* p = data.data();
+    qToLittleEndian<quint32>(HelloMagic, p);
+    qToLittleEndian<quint16>(ProtocolVersion, p + 4);
+    qToLittleEndian<quint32>(Capabilities, p + 6);
+
+    writePacket(0, PacketType::Hello, data);
+}
+
+/*
+ * Only what both ends support is used, bytes after
+ * the capabilities are left for later versions.
+ */
+void Session::processHelloPacket(const QByteArray& data)
+{
+    if (data.size() < HelloSize || qFromLittleEndian<quint32>(data.constData()) != HelloMagic) {
+        mSocket->abort();
+        return;
+    }
+
+    mPeerVersion = qFromLittleEndian<quint16>(data.constData() + 4);
+    mPeerCapabilities = qFromLittleEndian<quint32>(data.constData() + 6) & Capabilities;
+    finishHandshake();
+}
+
+void Session::onHelloTimeout()
+{
+    mSocket->abort();
+}
+
+void Session::finishHandshake()
+{
+    if (mHandshakeDone)
+        return;
+
+    mHandshakeDone = true;
+    mHelloTimer.stop();
+
+    const QList<quint32> ids = mStreams.keys();
+    for (quint32 id : ids) {
+        Transfer* stream = mStreams.value(id);
+        if (stream)
+            stream->onSessionConnected();
+    }
+}
+
+void Session::writePacket(quint32 streamId, PacketType type, const QByteArray& data)
+{
+    QByteArray header = packetHeader(streamId, type, data.size());
+    if (mWriteQueue.isEmpty()) {
+        mSocket->write(header);
+        mSocket->write(data);
+    }
+    else {
+        PendingWrite write;
+        write.bytes = header + data;
+        mWriteQueue.enqueue(write);
+        mQueuedBytes += write.bytes.size();
+    }
+
+    mWriteCount++;
+}
+
+/*
+ * Queue a Data packet whose payload is moved by the kernel (sendfile)
+ * straight from 'fileDescriptor' to the socket. Linux only.
+ */
+void Session::writeFilePacket(quint32 streamId, int fileDescriptor, qint64 offset, qint32 size,
+                              const QByteArray& prefix)
+{
+#if defined (Q_OS_LINUX)
+    PendingWrite write;
+    write.bytes = packetHeader(streamId, PacketType::Data, prefix.size() + size) + prefix;
+    write.fd = ::dup(fileDescriptor);
+    write.offset = offset;
+    write.size = size;
+    if (write.fd == -1) {
+        mSocket->abort();
+        return;
+    }
+
+    mWriteQueue.enqueue(write);
+    mQueuedBytes += write.bytes.size() + write.size;
+    mWriteCount++;
+    flushWriteQueue();
+#else
+    Q_UNUSED(streamId);
+    Q_UNUSED(fileDescriptor);
+    Q_UNUSED(offset);
+    Q_UNUSED(size);
+    Q_UNUSED(prefix);
+#endif
+}
+
+void Session::dequeueWrite()
+{
+    PendingWrite write = mWriteQueue.dequeue();
+    mQueuedBytes -= write.bytes.size() + write.size;
+#if defined (Q_OS_LINUX)
+    if (write.fd != -1)
+        ::close(write.fd);
+#endif
+}
+
+/*
+ * return true when every queued write has been handed to the socket
+ */
+bool Session::flushWriteQueue()
+{
+    while (!mWriteQueue.isEmpty()) {
+        PendingWrite& write = mWriteQueue.head();
+        if (write.fd == -1) {
+            mSocket->write(write.bytes);
+            dequeueWrite();
+            continue;
+        }
+
+        /*
+         * File payload bypasses the socket write buffer,
+         * everything before it must be out first.
+         */
+        if (mSocket->bytesToWrite())
+            return false;
+
+        if (!sendFilePayload(write))
+            return false;
+
+        dequeueWrite();
+    }
+
+    return true;
+}
+
+bool Session::sendFilePayload(PendingWrite& write)
+{
+#if defined (Q_OS_LINUX)
+    if (mSocket->state() != QAbstractSocket::ConnectedState)
+        return false;
+
+    int sockFd = static_cast<int>(mSocket->socketDescriptor());
+    while (!write.bytes.isEmpty()) {
+        ssize_t sent = ::send(sockFd, write.bytes.constData(), static_cast<size_t>(write.bytes.size()),
+                              MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                waitForWritable();
+            else
+                mSocket->abort();
+            return false;
+        }
+
+        write.bytes.remove(0, static_cast<int>(sent));
+        mQueuedBytes -= sent;
+    }
+
+    while (write.size > 0) {
+        if (!mSendFileSupported) {
+            /*
+             * sendfile() is not supported for this file/socket pair,
+             * finish the payload through the socket write buffer.
+             */
+            QByteArray rest(static_cast<int>(write.size), Qt::Uninitialized);
+            if (::pread(write.fd, rest.data(), static_cast<size_t>(write.size), write.offset) != write.size) {
+                mSocket->abort();
+                return false;
+            }
+
+            mSocket->write(rest);
+            mQueuedBytes -= write.size;
+            write.size = 0;
+            break;
+        }
+
+        off_t offset = write.offset;
+        ssize_t sent = ::sendfile(sockFd, write.fd, &offset, static_cast<size_t>(write.size));
+        if (sent < 0 && errno == EINTR)
+            continue;
+
+        if (sent < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            mSendFileSupported = false;
+            continue;
+        }
+
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            waitForWritable();
+            return false;
+        }
+
+        /*
+         * Read error or the file has been truncated
+         */
+        if (sent <= 0) {
+            mSocket->abort();
+            return false;
+        }
+
+        write.offset = offset;
+        write.size -= sent;
+        mQueuedBytes -= sent;
+    }
+
+    return true;
+#else
+    Q_UNUSED(write);
+    return false;
+#endif
+}
+
+void Session::waitForWritable()
+{
+    if (!mWriteNotifier) {
+        mWriteNotifier = new QSocketNotifier(mSocket->socketDescriptor(), QSocketNotifier::Write, this);
+        connect(mWriteNotifier, &QSocketNotifier::activated, this, [this]() {
+            mWriteNotifier->setEnabled(false);
+            pump();
+        });
+    }
+
+    mWriteNotifier->setEnabled(true);
+}
+
+/*
+ * Flush queued writes, and once less than half of the write budget
+ * is pending let the streams refill it. Streams are served round
+ * robin, one packet each per round, so they share the connection
+ * fairly.
+ */
+void Session::pump()
+{
+    flushWriteQueue();
+    if (bytesPending() > mWriteBudget / 2)
+        return;
+
+    quint64 writeCount = mWriteCount;
+    quint64 roundCount;
+
+    const QList<quint32> ids = mStreams.keys();
+    do {
+        roundCount = mWriteCount;
+        for (quint32 id : ids) {
+            if (!canWrite())
+                break;
+
+            Transfer* stream = mStreams.value(id);
+            if (stream)
+                stream->onSessionWritable();
+        }
+    } while (canWrite() && roundCount != mWriteCount);
+
+    /*
+     * Payloads moved by sendfile() never emit bytesWritten(),
+     * come back on the next event loop iteration.
+     */
+    if (flushWriteQueue() && writeCount != mWriteCount && !mSocket->bytesToWrite())
+        QTimer::singleShot(0, this, &Session::pump);
+}
+
+void Session::onBytesWritten(qint64 bytes)
+{
+    Q_UNUSED(bytes);
+
+    pump();
+}
+
+void Session::onStateChanged(QAbstractSocket::SocketState state)
+{
+    /*
+     * Streams are told once the peer's Hello is in
+     */
+    if (state == QAbstractSocket::ConnectedState) {
+        sendHello();
+        mHelloTimer.start();
+    }
+    else if (state == QAbstractSocket::UnconnectedState) {
+        mBuff.clear();
+        mSplicePending = 0;
+        mSkipPending = 0;
+        mSpliceStream = nullptr;
+        mSpliceStalled = false;
+        mSplicingStreams.clear();
+        mReadSuspended.clear();
+        mHelloTimer.stop();
+
+        QHash<quint32, Transfer*> streams;
+        streams.swap(mStreams);
+        for (Transfer* stream : streams)
+            stream->onSessionDisconnected();
+
+        emit closed(this);
+        deleteLater();
+    }
+}
+
+void Session::onIdleTimeout()
+{
+    if (mStreams.isEmpty())
+        mSocket->disconnectFromHost();
+}
+
+void Session::resumeSplice()
+{
+    if (mSpliceStalled) {
+        mSpliceStalled = false;
+        QTimer::singleShot(0, this, &Session::onReadyRead);
+    }
+}
+
+void Session::suspendReading(quint32 streamId)
+{
+    mReadSuspended.insert(streamId);
+}
+
+void Session::resumeReading(quint32 streamId)
+{
+    if (mReadSuspended.remove(streamId) && mReadSuspended.isEmpty())
+        QTimer::singleShot(0, this, &Session::onReadyRead);
+}
+
+void Session::onReadyRead()
+{
+    /*
+     * Read straight into the tail of the receive buffer,
+     * no intermediate QByteArray from readAll().
+     */
+    forever {
+        if (!mReadSuspended.isEmpty())
+            return;
+
+        if (mSkipPending > 0 && !skipData())
+            return;
+
+        if (mSplicePending > 0 && !spliceData())
+            return;
+
+        /*
+         * Packets left in the buffer when reading was suspended
+         */
+        processReadBuffer();
+        if (!mReadSuspended.isEmpty())
+            return;
+
+        qint64 available = mSocket->bytesAvailable();
+        if (available <= 0)
+            break;
+
+        int len = static_cast<int>(qMin<qint64>(available, SocketReadSize));
+        char* dst = mBuff.reserve(len);
+        if (!dst) {
+            mBuff.clear();
+            mSocket->abort();
+            return;
+        }
+
+        qint64 bytesRead = mSocket->read(dst, len);
+        if (bytesRead <= 0)
+            break;
+
+        mBuff.commit(static_cast<int>(bytesRead));
+        processReadBuffer();
+    }
+}
+
+/*
+ * Parse every complete packet in the buffer in place and
+ * dispatch it to its stream.
+ */
+void Session::processReadBuffer()
+{
+    while (mReadSuspended.isEmpty() && mBuff.size() >= HeaderSize) {
+        const char* header = mBuff.data();
+
+        qint32 packetSize = qFromLittleEndian<qint32>(header);
+        PacketType type = static_cast<PacketType>(header[sizeof(packetSize)]);
+        quint32 streamId = qFromLittleEndian<quint32>(header + sizeof(packetSize) + sizeof(PacketType));
+
+        if (packetSize < 0 || packetSize > PacketBuffer::MaxPacketSize) {
+            mBuff.clear();
+            mSocket->abort();
+            return;
+        }
+
+        int buffered = mBuff.size() - HeaderSize;
+        if (streamId == 0 && type == PacketType::Hello) {
+            if (buffered < packetSize)
+                break;
+
+            QByteArray hello(mBuff.data() + HeaderSize, packetSize);
+            mBuff.consume(HeaderSize + packetSize);
+            processHelloPacket(hello);
+            continue;
+        }
+
+        if (!mHandshakeDone) {
+            mBuff.clear();
+            mSocket->abort();
+            return;
+        }
+
+        Transfer* stream = mStreams.value(streamId);
+        if (!stream && type == PacketType::Header) {
+            if (buffered < packetSize)
+                break;
+
+            QByteArray header = mBuff.view(HeaderSize, packetSize);
+            emit streamRequested(this, streamId, header);
+            stream = mStreams.value(streamId);
+        }
+
+        /*
+         * Abaikan data utk stream yg tdk dikenal atau yg sudah 'Cancelled'
+         */
+        bool ignored = !stream ||
+                stream->getTransferInfo()->getState() == TransferState::Cancelled;
+
+        if (buffered < packetSize) {
+            if (ignored) {
+                mBuff.consume(HeaderSize + buffered);
+                mSkipPending = packetSize - buffered;
+                break;
+            }
+
+            /*
+             * The stream takes whatever part of the payload is already
+             * buffered, the rest is spliced by spliceData().
+             */
+            if (type == PacketType::Data) {
+                QByteArray data = mBuff.view(HeaderSize, buffered);
+                if (stream->startSplice(data, packetSize)) {
+                    mBuff.consume(HeaderSize + buffered);
+                    if (mSplicingStreams.isEmpty())
+                        mSocket->setReadBufferSize(SpliceReadBufferSize);
+                    mSplicingStreams.insert(streamId);
+
+                    mSpliceStream = stream;
+                    mSplicePending = packetSize - buffered;
+                }
+            }
+            break;
+        }
+
+        /*
+         * 'data' is a view into mBuff, it must not be kept
+         * after processPacket() returns.
+         */
+        if (!ignored) {
+            QByteArray data = mBuff.view(HeaderSize, packetSize);
+            stream->processPacket(data, type);
+        }
+
+        mBuff.consume(HeaderSize + packetSize);
+    }
+}
+
+/*
+ * Drop the rest of a payload nobody wants.
+ * return true when it has been skipped entirely.
+ */
+bool Session::skipData()
+{
+    while (mSkipPending > 0 && mSocket->bytesAvailable() > 0) {
+        int len = static_cast<int>(qMin<qint64>(qMin<qint64>(mSkipPending, mSocket->bytesAvailable()),
+                                                SocketReadSize));
+        char* dst = mBuff.reserve(len);
+        if (!dst)
+            return false;
+
+        qint64 bytesRead = mSocket->read(dst, len);
+        if (bytesRead <= 0)
+            return false;
+
+        mSkipPending -= bytesRead;
+    }
+
+    return mSkipPending == 0;
+}
+
+/*
+ * Hand the pending Data payload over to its stream, the bytes
+ * still in the socket are spliced into the stream's file writer.
+ * return true when the whole payload has been handed over.
+ */
+bool Session::spliceData()
+{
+#if defined (Q_OS_LINUX)
+    /*
+     * Bytes Qt already pulled into its own buffer come first.
+     */
+    while (mSplicePending > 0 && mSocket->bytesAvailable() > 0) {
+        if (!mReadSuspended.isEmpty())
+            return false;
+
+        int len = static_cast<int>(qMin<qint64>(qMin<qint64>(mSplicePending, mSocket->bytesAvailable()),
+                                                SocketReadSize));
+        char* dst = mBuff.reserve(len);
+        if (!dst)
+            return false;
+
+        qint64 bytesRead = mSocket->read(dst, len);
+        if (bytesRead <= 0)
+            return false;
+
+        mSplicePending -= bytesRead;
+        mSpliceStream->processSplicedData(QByteArray::fromRawData(dst, static_cast<int>(bytesRead)));
+    }
+
+    int sockFd = static_cast<int>(mSocket->socketDescriptor());
+    while (mSplicePending > 0) {
+        /*
+         * The write-behind is full, reading resumes once it drains
+         */
+        if (!mReadSuspended.isEmpty())
+            return false;
+
+        qint64 len = mSpliceStream->spliceFrom(sockFd, mSplicePending);
+        if (len < 0) {
+            emit mSpliceStream->getTransferInfo()->errorOcurred(tr("Error while writing file."));
+            mSocket->abort();
+            return false;
+        }
+
+        /*
+         * Nothing more in the socket (wait for next readyRead), or the
+         * writer's pipe is full and resumeSplice() follows once the
+         * writer has taken some of it.
+         */
+        if (len == 0) {
+            int queued = 0;
+            mSpliceStalled = ::ioctl(sockFd, FIONREAD, &queued) == 0 && queued > 0;
+            return false;
+        }
+
+        mSplicePending -= len;
+    }
+
+    mSpliceStream = nullptr;
+    return true;
+#else
+    return true;
+#endif
+}
@@ -0,0 +1,205 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <QTcpSocket>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QQueue>
+#include <QHash>
+#include <QSet>
+#include <QObject>
+
+#include "packetbuffer.h"
+#include "transfer.h"
+
+/*
+ * Session is one TCP connection to a peer that carries many transfers.
+ * Every Transfer is a logical stream inside the session and every packet
+ * is tagged with the stream id:
+ *
+ * packet --> size (4 bytes) | type (1 byte) | stream id (4 bytes) | data
+ *
+ * Packet headers and file offsets are little endian. Both ends open with a
+ * Hello packet on stream 0, it carries the protocol version and the
+ * Capabilities of the peer:
+ *
+ * Hello --> magic (4 bytes) | version (2 bytes) | capabilities (4 bytes)
+ *
+ * Streams are started once the peer's Hello is in. The framing above is
+ * not the one of LAN Share 1.2.1 and before, a peer that opens with
+ * anything else, or says nothing for a while, is dropped.
+ */
+class Session : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Capability : quint32
+    {
+        CapBinaryHeader = 0x0001,
+        CapResume       = 0x0002,
+        CapStriping     = 0x0004,
+        CapDelta        = 0x0008,
+        CapCompression  = 0x0010,
+        CapChecksums    = 0x0020,
+        CapDedup        = 0x0040,
+        CapChunks       = 0x0080,
+        CapManifest     = 0x0100,
+        CapInline       = 0x0200
+    };
+
+    static constexpr quint16 ProtocolVersion = 1;
+    static constexpr quint32 Capabilities = CapBinaryHeader | CapResume | CapStriping | CapDelta |
+            CapCompression | CapChecksums | CapDedup | CapChunks | CapManifest | CapInline;
+
+    /*
+     * Incoming session, accepted by TransferServer
+     */
+    explicit Session(QTcpSocket* socket, QObject* parent = nullptr);
+
+    /*
+     * Outgoing session, connects to the peer
+     */
+    Session(const QHostAddress& address, quint16 port, QObject* parent = nullptr);
+    ~Session() override;
+
+    inline QTcpSocket* getSocket() const { return mSocket; }
+    inline bool isConnected() const { return mSocket->state() == QAbstractSocket::ConnectedState; }
+
+    /*
+     * Connected and the peer's Hello is known,
+     * streams are told with onSessionConnected().
+     */
+    inline bool isReady() const { return isConnected() && mHandshakeDone; }
+    inline quint16 peerVersion() const { return mPeerVersion; }
+    inline quint32 peerCapabilities() const { return mPeerCapabilities; }
+    inline bool peerSupports(Capability cap) const { return mPeerCapabilities & cap; }
+    inline int streamCount() const { return mStreams.size(); }
+    inline bool isWriteQueueEmpty() const { return mWriteQueue.isEmpty() && !mSocket->bytesToWrite(); }
+
+    /*
+     * Bytes written by the streams but not yet handed to the kernel.
+     * Streams keep queueing packets while canWrite(), so the next
+     * chunk is ready before the socket drains.
+     */
+    inline qint64 bytesPending() const { return mSocket->bytesToWrite() + mQueuedBytes; }
+    inline bool canWrite() const { return bytesPending() < mWriteBudget; }
+
+    /*
+     * Smoothed round trip time of the connection as measured by
+     * the kernel, in microseconds. -1 if it isn't available.
+     */
+    qint64 roundTripTime() const;
+
+    quint32 attach(Transfer* stream);
+    void attach(Transfer* stream, quint32 streamId);
+    void detach(quint32 streamId);
+
+    void writePacket(quint32 streamId, PacketType type, const QByteArray& data);
+    void writeFilePacket(quint32 streamId, int fileDescriptor, qint64 offset, qint32 size,
+                         const QByteArray& prefix = QByteArray());
+
+    /*
+     * The writer of the stream being spliced has room again
+     */
+    void resumeSplice();
+
+    /*
+     * Backpressure, no packet is read while any stream has reading
+     * suspended, so the peer is throttled by TCP flow control.
+     */
+    void suspendReading(quint32 streamId);
+    void resumeReading(quint32 streamId);
+
+    static constexpr int HeaderSize = sizeof(qint32) + sizeof(PacketType) + sizeof(quint32);
+
+Q_SIGNALS:
+    /*
+     * A Header packet arrived for a stream nobody attached to yet.
+     * Must be connected directly, the packet is dropped if no stream
+     * is attached when the signal returns.
+     */
+    void streamRequested(Session* session, quint32 streamId, const QByteArray& header);
+    void closed(Session* session);
+
+private Q_SLOTS:
+    void onReadyRead();
+    void onBytesWritten(qint64 bytes);
+    void onStateChanged(QAbstractSocket::SocketState state);
+    void onIdleTimeout();
+    void onHelloTimeout();
+
+private:
+    struct PendingWrite
+    {
+        QByteArray bytes;
+        int fd{-1};
+        qint64 offset{0};
+        qint64 size{0};
+    };
+
+    void setupSocket();
+    void sendHello();
+    void processHelloPacket(const QByteArray& data);
+    void finishHandshake();
+    void dequeueWrite();
+    void processReadBuffer();
+    bool spliceData();
+    bool skipData();
+    bool flushWriteQueue();
+    bool sendFilePayload(PendingWrite& write);
+    void waitForWritable();
+    void pump();
+
+    QByteArray packetHeader(quint32 streamId, PacketType type, qint32 size) const;
+
+    QTcpSocket* mSocket;
+    bool mIncoming;
+    quint32 mNextStreamId;
+    QHash<quint32, Transfer*> mStreams;
+
+    PacketBuffer mBuff;
+    QQueue<PendingWrite> mWriteQueue;
+    QSocketNotifier* mWriteNotifier;
+    QTimer mIdleTimer;
+    QTimer mHelloTimer;
+    bool mHandshakeDone;
+    quint16 mPeerVersion;
+    quint32 mPeerCapabilities;
+    quint64 mWriteCount;
+    qint64 mQueuedBytes;
+    qint64 mWriteBudget;
+    bool mSendFileSupported;
+
+    Transfer* mSpliceStream;
+    bool mSpliceStalled;
+
+    /*
+     * Streams that had a payload spliced, the read buffer is
+     * small until they are all gone.
+     */
+    QSet<quint32> mSplicingStreams;
+    qint64 mSplicePending;
+    qint64 mSkipPending;
+    QSet<quint32> mReadSuspended;
+};
+
+#endif // SESSION_H
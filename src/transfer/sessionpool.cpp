@@ -0,0 +1,65 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QCoreApplication>
+
+#include "sessionpool.h"
+#include "transferengine.h"
+#include "settings.h"
+
+SessionPool::SessionPool(QObject* parent) : QObject(parent)
+{
+}
+
+SessionPool* SessionPool::instance()
+{
+    static SessionPool* obj = new SessionPool(qApp);
+    return obj;
+}
+
+Session* SessionPool::session(const Device& peer, int lane)
+{
+    QString key = TransferEngine::peerKey(peer) + "/" + QString::number(lane);
+
+    QMutexLocker locker(&mMutex);
+    Session* s = mSessions.value(key);
+
+    /*
+     * Don't hand out a session that is going down after being idle
+     */
+    if (s && s->getSocket()->state() == QAbstractSocket::ClosingState) {
+        mSessions.remove(key);
+        s = nullptr;
+    }
+
+    if (!s) {
+        s = new Session(peer.getAddress(), Settings::instance()->getTransferPort());
+        connect(s, &Session::closed, this, &SessionPool::onSessionClosed, Qt::DirectConnection);
+        mSessions.insert(key, s);
+    }
+
+    return s;
+}
+
+void SessionPool::onSessionClosed(Session* session)
+{
+    QMutexLocker locker(&mMutex);
+    QString key = mSessions.key(session);
+    if (!key.isNull())
+        mSessions.remove(key);
+}
@@ -0,0 +1,57 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SESSIONPOOL_H
+#define SESSIONPOOL_H
+
+#include <QHash>
+#include <QMutex>
+#include <QPointer>
+#include <QObject>
+
+#include "session.h"
+#include "model/device.h"
+
+/*
+ * SessionPool keeps the outgoing Sessions to every receiver Device,
+ * every Sender to the same Device shares them. Lane 0 carries all
+ * transfers, the other lanes carry stripes of large files.
+ *
+ * Sessions live in the worker thread of their peer and must only be
+ * requested from that thread (see TransferEngine).
+ */
+class SessionPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    static SessionPool* instance();
+
+    Session* session(const Device& peer, int lane = 0);
+
+private Q_SLOTS:
+    void onSessionClosed(Session* session);
+
+private:
+    explicit SessionPool(QObject* parent = nullptr);
+
+    QHash<QString, QPointer<Session> > mSessions;
+    QMutex mMutex;
+};
+
+#endif // SESSIONPOOL_H
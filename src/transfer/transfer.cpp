@@ -17,14 +17,18 @@
 */
 
 #include "transfer.h"
+#include "fileheader.h"
+#include "session.h"
 
-Transfer::Transfer(QTcpSocket* socket, QObject* parent)
-    : QObject(parent), mFile(nullptr), mSocket(nullptr),
-      mPacketSize(-1)
+Transfer::Transfer(QObject* parent)
+    : QObject(parent), mFile(nullptr), mStreamId(0)
 {
     mInfo = new TransferInfo(this, this);
-    setSocket(socket);
-    mHeaderSize = sizeof(PacketType) + sizeof(mPacketSize);
+}
+
+Transfer::~Transfer()
+{
+    detachSession();
 }
 
 void Transfer::resume()
@@ -42,49 +46,22 @@ void Transfer::cancel()
     
 }
 
-void Transfer::onReadyRead()
+void Transfer::writePacket(PacketType type, const QByteArray &data)
 {
-    /*
-     * Abaikan data yg diterima jika state transfer 'Cancelled' (Dibatalkan)
-     */
-    if (mInfo->getState() == TransferState::Cancelled)
-        return;
-
-    mBuff.append(mSocket->readAll());
-
-    /*
-     * Jika ukuran buffer sudah >= ukuran header, maka pda buffer tsb
-     * terdapat data header yg dpt kita extrak
-     * dt header --> packet size (4 bytes) & packet type (1 byte)
-     */
-    while (mBuff.size() >= mHeaderSize) {
-        if (mPacketSize < 0) {
-            memcpy(&mPacketSize, mBuff.constData(), sizeof(mPacketSize));
-            mBuff.remove(0, sizeof(mPacketSize));
-        }
-
-        if (mBuff.size() > mPacketSize) {
-            PacketType type = static_cast<PacketType>(mBuff.at(0));
-            QByteArray data = mBuff.mid(1, mPacketSize);
-
-            processPacket(data, type);
-            mBuff.remove(0, mPacketSize + 1);
-
-            mPacketSize = -1;
-        }
-        else {
-            break;
-        }
+    if (mSession) {
+        mSession->writePacket(mStreamId, type, data);
     }
 }
 
-void Transfer::writePacket(qint32 packetDataSize, PacketType type, const QByteArray &data)
+void Transfer::writeHeader(const FileHeader& header)
 {
-    if (mSocket) {
-        mSocket->write(reinterpret_cast<const char*>(&packetDataSize), sizeof(packetDataSize));
-        mSocket->write(reinterpret_cast<const char*>(&type), sizeof(type));
-        mSocket->write(data);
-    }
+    if (!mSession)
+        return;
+
+    if (mSession->peerSupports(Session::CapBinaryHeader))
+        writePacket(PacketType::Header, header.toBinary());
+    else
+        writePacket(PacketType::Header, header.toJson());
 }
 
 void Transfer::processPacket(QByteArray &data, PacketType type)
@@ -96,6 +73,15 @@ void Transfer::processPacket(QByteArray &data, PacketType type)
     case PacketType::Cancel : processCancelPacket(data); break;
     case PacketType::Pause : processPausePacket(data); break;
     case PacketType::Resume : processResumePacket(data); break;
+    case PacketType::Signature : processSignaturePacket(data); break;
+    case PacketType::Delta : processDeltaPacket(data); break;
+    case PacketType::Accept : processAcceptPacket(data); break;
+    case PacketType::Compressed : processCompressedPacket(data); break;
+    case PacketType::Checksum : processChecksumPacket(data); break;
+    case PacketType::Verify : processVerifyPacket(data); break;
+    case PacketType::Chunks : processChunksPacket(data); break;
+    case PacketType::Hello : break; // Session's own
+    case PacketType::Manifest : processManifestPacket(data); break;
     }
 }
 
@@ -129,18 +115,99 @@ void Transfer::processResumePacket(QByteArray& data)
     Q_UNUSED(data);
 }
 
+void Transfer::processSignaturePacket(QByteArray& data)
+{
+    Q_UNUSED(data);
+}
+
+void Transfer::processDeltaPacket(QByteArray& data)
+{
+    Q_UNUSED(data);
+}
+
+void Transfer::processAcceptPacket(QByteArray& data)
+{
+    Q_UNUSED(data);
+}
+
+void Transfer::processCompressedPacket(QByteArray& data)
+{
+    Q_UNUSED(data);
+}
+
+void Transfer::processChecksumPacket(QByteArray& data)
+{
+    Q_UNUSED(data);
+}
+
+void Transfer::processVerifyPacket(QByteArray& data)
+{
+    Q_UNUSED(data);
+}
+
+void Transfer::processChunksPacket(QByteArray& data)
+{
+    Q_UNUSED(data);
+}
+
+void Transfer::processManifestPacket(QByteArray& data)
+{
+    Q_UNUSED(data);
+}
+
+bool Transfer::startSplice(const QByteArray& buffered, qint32 packetDataSize)
+{
+    Q_UNUSED(buffered);
+    Q_UNUSED(packetDataSize);
+    return false;
+}
+
+void Transfer::processSplicedData(const QByteArray& data)
+{
+    Q_UNUSED(data);
+}
 
-void Transfer::clearReadBuffer()
+qint64 Transfer::spliceFrom(int socketDescriptor, qint64 size)
 {
-    mBuff.clear();
-    mPacketSize = -1;
+    Q_UNUSED(socketDescriptor);
+    Q_UNUSED(size);
+    return -1;
 }
 
-void Transfer::setSocket(QTcpSocket *socket)
+void Transfer::onSessionConnected()
 {
-    if (socket) {
-        mSocket = socket;
-        connect(mSocket, &QTcpSocket::readyRead, this, &Transfer::onReadyRead);
+
+}
+
+void Transfer::onSessionWritable()
+{
+
+}
+
+void Transfer::onSessionDisconnected()
+{
+
+}
+
+/*
+ * streamId 0 --> allocate a new stream in the session
+ */
+void Transfer::setSession(Session* session, quint32 streamId)
+{
+    if (session) {
+        mSession = session;
+        if (streamId)
+            mSession->attach(this, streamId);
+        else
+            streamId = mSession->attach(this);
+        mStreamId = streamId;
     }
 }
 
+void Transfer::detachSession()
+{
+    if (mSession) {
+        mSession->detach(mStreamId);
+        mSession = nullptr;
+    }
+}
@@ -20,7 +20,7 @@
 #define TRANSFER_H
 
 #include <QFile>
-#include <QTcpSocket>
+#include <QPointer>
 #include <QObject>
 
 #include "model/device.h"
@@ -34,18 +34,38 @@ enum class PacketType : char
     Finish,
     Cancel,
     Pause,
-    Resume
+    Resume,
+    Signature,
+    Delta,
+    Accept,
+    Compressed,
+    Checksum,
+    Verify,
+    Chunks,
+    Hello,
+    Manifest
 };
 
+class FileHeader;
+class Session;
+
+/*
+ * Transfer is one file going through a Session, identified
+ * by its stream id inside that session.
+ */
 class Transfer : public QObject
 {
     Q_OBJECT
 
+    friend class Session;
+
 public:
-    Transfer(QTcpSocket* socket, QObject* parent = nullptr);
+    explicit Transfer(QObject* parent = nullptr);
+    ~Transfer() override;
 
     inline QFile* getFile() const { return mFile; }
-    inline QTcpSocket* getSocket() const { return mSocket; }
+    inline Session* getSession() const { return mSession; }
+    inline quint32 getStreamId() const { return mStreamId; }
     inline TransferInfo* getTransferInfo() const { return mInfo; }
 
     virtual void resume();
@@ -53,8 +73,12 @@ public:
     virtual void cancel();
 
 protected:
-    void clearReadBuffer();
-    void setSocket(QTcpSocket* socket);
+    void setSession(Session* session, quint32 streamId = 0);
+    void detachSession();
+
+    virtual void onSessionConnected();
+    virtual void onSessionWritable();
+    virtual void onSessionDisconnected();
 
     virtual void processPacket(QByteArray& data, PacketType type);
     virtual void processHeaderPacket(QByteArray& data);
@@ -63,23 +87,40 @@ protected:
     virtual void processCancelPacket(QByteArray& data);
     virtual void processPausePacket(QByteArray& data);
     virtual void processResumePacket(QByteArray& data);
-
-    virtual void writePacket(qint32 packetDataSize, PacketType type, const QByteArray& data);
+    virtual void processSignaturePacket(QByteArray& data);
+    virtual void processDeltaPacket(QByteArray& data);
+    virtual void processAcceptPacket(QByteArray& data);
+    virtual void processCompressedPacket(QByteArray& data);
+    virtual void processChecksumPacket(QByteArray& data);
+    virtual void processVerifyPacket(QByteArray& data);
+    virtual void processChunksPacket(QByteArray& data);
+    virtual void processManifestPacket(QByteArray& data);
+
+    virtual void writePacket(PacketType type, const QByteArray& data);
+
+    /*
+     * Binary if the peer announced Session::CapBinaryHeader,
+     * JSON otherwise.
+     */
+    void writeHeader(const FileHeader& header);
+
+    /*
+     * Zero-copy receive (Linux only). When a Data packet is only partly
+     * buffered, startSplice() gets the buffered part of the payload and
+     * tells if the rest is spliced. Returning false means nothing was
+     * consumed and the packet is delivered the normal way. The session
+     * then hands the rest over block by block: processSplicedData() for
+     * what Qt had already read, spliceFrom() to move up to 'size' bytes
+     * out of the socket (0 when it would block, -1 on error).
+     */
+    virtual bool startSplice(const QByteArray& buffered, qint32 packetDataSize);
+    virtual void processSplicedData(const QByteArray& data);
+    virtual qint64 spliceFrom(int socketDescriptor, qint64 size);
 
     QFile* mFile;
-    QTcpSocket* mSocket;
+    QPointer<Session> mSession;
+    quint32 mStreamId;
     TransferInfo* mInfo;
-
-private Q_SLOTS:
-    void onReadyRead();
-
-private:
-
-    //
-    QByteArray mBuff;
-    qint32 mPacketSize;
-
-    int mHeaderSize;
 };
 
 #endif // TRANSFER_H
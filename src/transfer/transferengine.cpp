@@ -0,0 +1,157 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QThreadPool>
+
+#include "transferengine.h"
+#include "dirwalker.h"
+#include "sessionpool.h"
+#include "hashcache.h"
+#include "chunkstore.h"
+#include "transferqueue.h"
+#include "settings.h"
+#include "model/transferinfo.h"
+
+/*
+ * Directories listed at the same time, the disk (or the
+ * file server) is kept busy, not the CPU.
+ */
+#define IoThreadCount   8
+
+TransferEngine::TransferEngine(QObject* parent) : QObject(parent)
+{
+    /*
+     * TransferInfo signals reach the GUI queued,
+     * DirWalker signals reach the workers queued.
+     */
+    qRegisterMetaType<TransferState>("TransferState");
+    qRegisterMetaType< QVector<DirWalker::Entry> >("QVector<DirWalker::Entry>");
+
+    /*
+     * SessionPool, the caches and the queue must belong
+     * to the GUI thread too, make sure they are not created by a worker.
+     */
+    SessionPool::instance();
+    HashCache::instance();
+    ChunkStore::instance();
+    TransferQueue::instance();
+
+    int count = Settings::instance()->getWorkerThreadCount();
+    for (int i = 0; i < count; i++) {
+        QThread* thread = startThread(QString("TransferWorker %1").arg(i));
+        QObject* context = new QObject;
+        context->moveToThread(thread);
+
+        mWorkers.push_back(thread);
+        mContexts.push_back(context);
+        mPeerCount.push_back(0);
+    }
+
+    mComputePool = new QThreadPool(this);
+    mComputePool->setMaxThreadCount(QThread::idealThreadCount());
+
+    mIoPool = new QThreadPool(this);
+    mIoPool->setMaxThreadCount(IoThreadCount);
+
+    connect(qApp, &QCoreApplication::aboutToQuit, this, &TransferEngine::onAboutToQuit);
+}
+
+TransferEngine* TransferEngine::instance()
+{
+    static TransferEngine* obj = new TransferEngine(qApp);
+    return obj;
+}
+
+QThread* TransferEngine::startThread(const QString& name)
+{
+    QThread* thread = new QThread;
+    thread->setObjectName(name);
+    thread->start();
+    return thread;
+}
+
+int TransferEngine::peerWorker(const QString& peerKey)
+{
+    QMutexLocker locker(&mMutex);
+
+    int idx = mPeerWorkers.value(peerKey, -1);
+    if (idx == -1) {
+        idx = 0;
+        for (int i = 1; i < mPeerCount.size(); i++) {
+            if (mPeerCount.at(i) < mPeerCount.at(idx))
+                idx = i;
+        }
+
+        mPeerCount[idx]++;
+        mPeerWorkers.insert(peerKey, idx);
+    }
+
+    return idx;
+}
+
+QString TransferEngine::peerKey(const Device& peer)
+{
+    if (!peer.getId().isEmpty())
+        return peer.getId();
+
+    return peer.getAddress().toString();
+}
+
+QThread* TransferEngine::peerThread(const QString& peerKey)
+{
+    return mWorkers.at(peerWorker(peerKey));
+}
+
+QObject* TransferEngine::peerContext(const QString& peerKey)
+{
+    return mContexts.at(peerWorker(peerKey));
+}
+
+QThread* TransferEngine::namedThread(const QString& name)
+{
+    QMutexLocker locker(&mMutex);
+
+    QThread* thread = mNamedThreads.value(name);
+    if (!thread) {
+        thread = startThread(name);
+        mNamedThreads.insert(name, thread);
+    }
+
+    return thread;
+}
+
+void TransferEngine::onAboutToQuit()
+{
+    mComputePool->waitForDone();
+    mIoPool->waitForDone();
+
+    QVector<QThread*> threads = mWorkers;
+    {
+        QMutexLocker locker(&mMutex);
+        for (QThread* thread : mNamedThreads)
+            threads.push_back(thread);
+    }
+
+    for (QThread* thread : threads)
+        thread->quit();
+
+    for (QThread* thread : threads)
+        thread->wait();
+}
@@ -0,0 +1,105 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRANSFERENGINE_H
+#define TRANSFERENGINE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+#include <QObject>
+
+#include "model/device.h"
+
+class QThread;
+class QThreadPool;
+
+/*
+ * TransferEngine owns the threads the transfers run on, so a busy GUI
+ * doesn't throttle the network. Every peer is assigned to one of the
+ * worker threads (one event loop each), its Sessions and every Sender
+ * and Receiver using them live there. File I/O has its own threads,
+ * CPU bound work (compression) runs on the compute pool, blocking file
+ * system work (folder walks) on the I/O pool.
+ *
+ * Must be created on the GUI thread, MainWindow does it at startup.
+ */
+class TransferEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    static TransferEngine* instance();
+
+    inline int workerCount() const { return mWorkers.size(); }
+
+    /*
+     * Key of 'peer' for peerThread() and peerContext(), the same
+     * for what we send and what we receive. A peer that has not
+     * announced itself yet goes by its address.
+     */
+    static QString peerKey(const Device& peer);
+
+    /*
+     * Worker thread of 'peerKey', new peers go to the
+     * worker with the fewest peers.
+     */
+    QThread* peerThread(const QString& peerKey);
+
+    /*
+     * Object living in the worker thread of 'peerKey', to queue
+     * calls on it with QMetaObject::invokeMethod().
+     */
+    QObject* peerContext(const QString& peerKey);
+
+    /*
+     * Auxiliary thread by name (file reader, disk writers),
+     * started on first use.
+     */
+    QThread* namedThread(const QString& name);
+
+    /*
+     * One thread per core, shared by every transfer
+     */
+    inline QThreadPool* computePool() const { return mComputePool; }
+
+    /*
+     * Threads that block on the file system
+     */
+    inline QThreadPool* ioPool() const { return mIoPool; }
+
+private Q_SLOTS:
+    void onAboutToQuit();
+
+private:
+    explicit TransferEngine(QObject* parent = nullptr);
+
+    QThread* startThread(const QString& name);
+    int peerWorker(const QString& peerKey);
+
+    QVector<QThread*> mWorkers;
+    QVector<QObject*> mContexts;
+    QVector<int> mPeerCount;
+    QHash<QString, int> mPeerWorkers;
+    QHash<QString, QThread*> mNamedThreads;
+    QThreadPool* mComputePool;
+    QThreadPool* mIoPool;
+    QMutex mMutex;
+};
+
+#endif // TRANSFERENGINE_H
@@ -0,0 +1,236 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QCoreApplication>
+
+#include "transferqueue.h"
+#include "transferengine.h"
+#include "sender.h"
+#include "settings.h"
+
+bool TransferQueue::Key::operator<(const Key& other) const
+{
+    if (priority != other.priority)
+        return priority > other.priority;
+    if (order != other.order)
+        return order < other.order;
+    return id < other.id;
+}
+
+TransferQueue::TransferQueue(QObject* parent)
+    : QObject(parent), mPolicy(nullptr), mNextId(0), mStarted(0)
+{
+    setPolicy(static_cast<QueuePolicy::Type>(Settings::instance()->getQueuePolicy()));
+}
+
+TransferQueue::~TransferQueue()
+{
+    delete mPolicy;
+}
+
+TransferQueue* TransferQueue::instance()
+{
+    static TransferQueue* obj = new TransferQueue(qApp);
+    return obj;
+}
+
+quint64 TransferQueue::enqueue(const Device& receiver, const QString& folderName, const QString& filePath,
+                               qint64 size)
+{
+    quint64 id = mNextId++;
+    Key key{ 0, mPolicy->order(id, size), id };
+
+    QString peerKey = TransferEngine::peerKey(receiver);
+    auto peer = mPeers.find(peerKey);
+    if (peer == mPeers.end())
+        peer = mPeers.insert(peerKey, Peer{ QMap<Key, Item>(), 0, 0 });
+
+    Sender* sender = new Sender(receiver, folderName, filePath);
+    TransferInfo* info = sender->getTransferInfo();
+    info->setFilePath(filePath);
+    info->setDataSize(size);
+    info->setState(TransferState::Queued);
+
+    /*
+     * Both come queued from the worker thread once the Sender is
+     * started, directly while it is queued.
+     */
+    connect(info, &TransferInfo::stateChanged, this, [this, id, peerKey](TransferState state) {
+        onStateChanged(id, peerKey, state);
+    });
+    connect(sender, &QObject::destroyed, this, [this, id]() {
+        unqueue(id);
+        release(id);
+    });
+
+    peer->queue.insert(key, { sender, size });
+    mQueued.insert(id, qMakePair(peerKey, key));
+    emit enqueued(id, sender);
+    dispatch();
+
+    return id;
+}
+
+bool TransferQueue::setPriority(quint64 id, int priority)
+{
+    auto queued = mQueued.find(id);
+    if (queued == mQueued.end())
+        return false;
+
+    QMap<Key, Item>& queue = mPeers[queued->first].queue;
+    Item item = queue.take(queued->second);
+    queued->second.priority = priority;
+    queue.insert(queued->second, item);
+    dispatch();
+
+    return true;
+}
+
+int TransferQueue::priority(quint64 id) const
+{
+    auto queued = mQueued.constFind(id);
+    return queued != mQueued.constEnd() ? queued->second.priority : 0;
+}
+
+void TransferQueue::applySettings()
+{
+    setPolicy(static_cast<QueuePolicy::Type>(Settings::instance()->getQueuePolicy()));
+    dispatch();
+}
+
+/*
+ * The queued files are sorted again
+ */
+void TransferQueue::setPolicy(QueuePolicy::Type type)
+{
+    if (mPolicy && mPolicy->type() == type)
+        return;
+
+    delete mPolicy;
+    mPolicy = QueuePolicy::create(type);
+
+    for (Peer& peer : mPeers) {
+        QMap<Key, Item> queue;
+        for (auto it = peer.queue.constBegin(); it != peer.queue.constEnd(); ++it) {
+            Key key{ it.key().priority, mPolicy->order(it.key().id, it.value().size), it.key().id };
+            queue.insert(key, it.value());
+            mQueued[key.id].second = key;
+        }
+
+        peer.queue = queue;
+    }
+}
+
+void TransferQueue::dispatch()
+{
+    Settings* settings = Settings::instance();
+    int maxActive = settings->getMaxActiveTransfers();
+    int maxPeerActive = settings->getMaxPeerTransfers();
+
+    while (!mQueued.isEmpty() && mActive.size() < maxActive) {
+        QVector<QString> peerIds;
+        QVector<QueuePolicy::Candidate> candidates;
+        for (auto it = mPeers.constBegin(); it != mPeers.constEnd(); ++it) {
+            const Peer& peer = it.value();
+            if (peer.queue.isEmpty() || peer.active >= maxPeerActive)
+                continue;
+
+            const Key& first = peer.queue.firstKey();
+            peerIds.push_back(it.key());
+            candidates.push_back({ first.priority, first.order, peer.active, peer.lastStarted });
+        }
+
+        if (candidates.isEmpty())
+            return;
+
+        start(peerIds.at(mPolicy->choose(candidates)));
+    }
+}
+
+void TransferQueue::start(const QString& peerId)
+{
+    Peer& peer = mPeers[peerId];
+    Key key = peer.queue.firstKey();
+    Item item = peer.queue.take(key);
+    mQueued.remove(key.id);
+
+    peer.active++;
+    peer.lastStarted = ++mStarted;
+
+    Sender* sender = item.sender;
+    mActive.insert(key.id, peerId);
+
+    /*
+     * A file that can't be opened (deleted since it was queued,
+     * unreadable) gives its slot back. So does a cancel that was
+     * posted before the Sender moved and runs before start().
+     */
+    sender->moveToThread(TransferEngine::instance()->peerThread(peerId));
+    QMetaObject::invokeMethod(sender, [sender]() {
+        TransferInfo* info = sender->getTransferInfo();
+        if (info->getState() == TransferState::Cancelled || sender->start())
+            return;
+
+        info->setState(TransferState::Cancelled);
+        emit info->errorOcurred(tr("Could not open ") + info->getFilePath());
+    }, Qt::QueuedConnection);
+}
+
+void TransferQueue::unqueue(quint64 id)
+{
+    auto queued = mQueued.find(id);
+    if (queued == mQueued.end())
+        return;
+
+    mPeers[queued->first].queue.remove(queued->second);
+    mQueued.erase(queued);
+}
+
+/*
+ * A Sender resumed after a disconnection is active again,
+ * even above the limits.
+ */
+void TransferQueue::onStateChanged(quint64 id, const QString& peerId, TransferState state)
+{
+    if (mQueued.contains(id)) {
+        if (state == TransferState::Cancelled)
+            unqueue(id);
+        return;
+    }
+
+    if (state == TransferState::Finish ||
+            state == TransferState::Cancelled ||
+            state == TransferState::Disconnected) {
+        release(id);
+    }
+    else if (!mActive.contains(id)) {
+        mActive.insert(id, peerId);
+        mPeers[peerId].active++;
+    }
+}
+
+void TransferQueue::release(quint64 id)
+{
+    auto active = mActive.find(id);
+    if (active == mActive.end())
+        return;
+
+    mPeers[active.value()].active--;
+    mActive.erase(active);
+    dispatch();
+}
@@ -0,0 +1,138 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRANSFERQUEUE_H
+#define TRANSFERQUEUE_H
+
+#include <QHash>
+#include <QMap>
+#include <QObject>
+
+#include "queuepolicy.h"
+#include "model/device.h"
+#include "model/transferinfo.h"
+
+class Sender;
+class Transfer;
+
+/*
+ * TransferQueue holds the files to send until their turn comes. A file
+ * waits as a Sender in the Queued state, which stays in the GUI thread
+ * and holds nothing but its path. It is started (file opened, buffers
+ * allocated, session joined) only while fewer than
+ * Settings::getMaxActiveTransfers() Senders are active, and fewer than
+ * Settings::getMaxPeerTransfers() for its receiver. A Sender stops being
+ * active when it finishes, is cancelled, gets disconnected or is
+ * deleted. A queued Sender that is cancelled or deleted leaves the
+ * queue.
+ *
+ * The order files start in is up to the QueuePolicy, files given a
+ * higher priority with setPriority() start first.
+ *
+ * Lives in the GUI thread.
+ */
+class TransferQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    static TransferQueue* instance();
+    ~TransferQueue() override;
+
+    /*
+     * Returns the id of the file for setPriority()
+     */
+    quint64 enqueue(const Device& receiver, const QString& folderName, const QString& filePath, qint64 size);
+
+    /*
+     * False if the file is not queued anymore
+     */
+    bool setPriority(quint64 id, int priority);
+
+    /*
+     * 0 if the file is not queued anymore
+     */
+    int priority(quint64 id) const;
+
+    /*
+     * Takes the limits and the policy from Settings
+     */
+    void applySettings();
+
+    inline int queuedCount() const { return mQueued.size(); }
+    inline int activeCount() const { return mActive.size(); }
+
+Q_SIGNALS:
+    /*
+     * A Sender has been created for the file, it starts when
+     * the queue gets to it.
+     */
+    void enqueued(quint64 id, Transfer* sender);
+
+private:
+    struct Item
+    {
+        Sender* sender;
+        qint64 size;
+    };
+
+    struct Key
+    {
+        int priority;
+        qint64 order;
+        quint64 id;
+
+        bool operator<(const Key& other) const;
+    };
+
+    struct Peer
+    {
+        QMap<Key, Item> queue;
+        int active;
+        quint64 lastStarted;
+    };
+
+    explicit TransferQueue(QObject* parent = nullptr);
+
+    void setPolicy(QueuePolicy::Type type);
+    void dispatch();
+    void start(const QString& peerId);
+    void unqueue(quint64 id);
+    void onStateChanged(quint64 id, const QString& peerId, TransferState state);
+    void release(quint64 id);
+
+    QueuePolicy* mPolicy;
+    QHash<QString, Peer> mPeers;
+
+    /*
+     * Queued files by id, with the id of their receiver
+     */
+    QHash<quint64, QPair<QString, Key> > mQueued;
+
+    /*
+     * Ids of the active Senders, with the id of their receiver. Not
+     * the Senders themselves, the address of one that is gone may be
+     * taken by a new one before its destroyed() signal gets here.
+     */
+    QHash<quint64, QString> mActive;
+
+    quint64 mNextId;
+    quint64 mStarted;
+};
+
+#endif // TRANSFERQUEUE_H
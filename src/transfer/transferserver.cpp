@@ -19,6 +19,7 @@
 #include "transferserver.h"
 
 #include "settings.h"
+#include "transferengine.h"
 
 TransferServer::TransferServer(DeviceListModel* devList, QObject *parent) : QObject(parent)
 {
@@ -37,8 +38,49 @@ void TransferServer::onNewConnection()
     QTcpSocket* socket = mServer->nextPendingConnection();
     if (socket) {
         Device dev = mDevList->device(socket->peerAddress());
-        Receiver* rec = new Receiver(dev, socket);
+
+        /*
+         * One session per sender, every file it sends is a stream
+         * inside that session. The session runs on the worker
+         * thread of its peer, the one our Senders to it use.
+         */
+        QString peerKey = dev.isValid() ? TransferEngine::peerKey(dev)
+                                        : socket->peerAddress().toString();
+        socket->setParent(nullptr);
+        socket->moveToThread(TransferEngine::instance()->peerThread(peerKey));
+
+        QMetaObject::invokeMethod(TransferEngine::instance()->peerContext(peerKey), [this, socket, dev]() {
+            Session* session = new Session(socket);
+            connect(session, &Session::streamRequested, session,
+                    [this, dev](Session* s, quint32 streamId, const QByteArray& header) {
+                onStreamRequested(dev, s, streamId, header);
+            }, Qt::DirectConnection);
+        }, Qt::QueuedConnection);
+    }
+}
+
+/*
+ * Called on the session's worker thread
+ */
+void TransferServer::onStreamRequested(const Device& dev, Session* session, quint32 streamId,
+                                       const QByteArray& header)
+{
+    /*
+     * Stripes are owned by the Receiver of their file, not listed
+     */
+    if (Receiver::isStripeHeader(header)) {
+        new Receiver(dev, session, streamId);
+        return;
+    }
+
+    Transfer* rec;
+    if (FolderReceiver::isFolderHeader(header))
+        rec = new FolderReceiver(dev, session, streamId);
+    else
+        rec = new Receiver(dev, session, streamId);
+
+    QMetaObject::invokeMethod(this, [this, rec]() {
         mReceivers.push_back(rec);
         emit newReceiverAdded(rec);
-    }
+    }, Qt::QueuedConnection);
 }
@@ -23,6 +23,8 @@
 #include <QObject>
 
 #include "receiver.h"
+#include "folderreceiver.h"
+#include "session.h"
 #include "model/devicelistmodel.h"
 
 class TransferServer : public QObject
@@ -35,15 +37,18 @@ public:
     bool listen(const QHostAddress& addr = QHostAddress::Any);
 
 Q_SIGNALS:
-    void newReceiverAdded(Receiver* receiver);
+    void newReceiverAdded(Transfer* receiver);
 
 private Q_SLOTS:
     void onNewConnection();
 
 private:
+    void onStreamRequested(const Device& dev, Session* session, quint32 streamId,
+                           const QByteArray& header);
+
     DeviceListModel* mDevList;
     QTcpServer* mServer;
-    QVector<Receiver*> mReceivers;
+    QVector<Transfer*> mReceivers;
 };
 
 #endif // TRANSFERSERVER_H
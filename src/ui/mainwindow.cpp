@@ -36,7 +36,11 @@
 #include "aboutdialog.h"
 #include "util.h"
 #include "transfer/sender.h"
+#include "transfer/foldersender.h"
+#include "transfer/dirwalker.h"
 #include "transfer/receiver.h"
+#include "transfer/transferengine.h"
+#include "transfer/transferqueue.h"
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -48,6 +52,11 @@ MainWindow::MainWindow(QWidget *parent) :
     setupSystrayIcon();
     setWindowTitle(PROGRAM_NAME);
 
+    /*
+     * Transfers run on the engine's worker threads
+     */
+    TransferEngine::instance();
+
     mBroadcaster = new DeviceBroadcaster(this);
     mBroadcaster->start();
     mSenderModel = new TransferTableModel(this);
@@ -94,7 +103,8 @@ void MainWindow::closeEvent(QCloseEvent *event)
         TransferState state = t->getTransferInfo()->getState();
         return state == TransferState::Paused ||
                 state == TransferState::Transfering ||
-                state == TransferState::Waiting;
+                state == TransferState::Waiting ||
+                state == TransferState::Queued;
     };
 
     auto checkTransferModel = [&](TransferTableModel* model) {
@@ -147,6 +157,20 @@ void MainWindow::setMainWindowVisibility(bool visible)
 void MainWindow::connectSignals()
 {
     connect(mTransServer, &TransferServer::newReceiverAdded, this, &MainWindow::onNewReceiverAdded);
+    connect(TransferQueue::instance(), &TransferQueue::enqueued, this, [this](quint64 id, Transfer* sender) {
+        mQueueIds.insert(sender, id);
+        insertSender(sender);
+    });
+
+    /*
+     * Rows only go away while their Transfer is still alive
+     */
+    connect(mSenderModel, &QAbstractItemModel::rowsAboutToBeRemoved, this,
+            [this](const QModelIndex& parent, int first, int last) {
+        Q_UNUSED(parent);
+        for (int i = first; i <= last; i++)
+            mQueueIds.remove(mSenderModel->getTransfer(i));
+    });
 
     QItemSelectionModel* senderSel = ui->senderTableView->selectionModel();
     connect(senderSel, &QItemSelectionModel::selectionChanged,
@@ -157,10 +181,45 @@ void MainWindow::connectSignals()
             this, &MainWindow::onReceiverTableSelectionChanged);
 }
 
-void MainWindow::sendFile(const QString& folderName, const QString &filePath, const Device &receiver)
+/*
+ * The Sender shows up queued in the table (TransferQueue::enqueued)
+ * and starts when the queue gets to it.
+ */
+void MainWindow::sendFile(const QString& folderName, const QString &filePath, qint64 size,
+                          const Device &receiver)
+{
+    TransferQueue::instance()->enqueue(receiver, folderName, filePath, size);
+}
+
+/*
+ * The small files of the folder go as one job for every receiver,
+ * the others one by one, as the walker finds them.
+ */
+void MainWindow::sendFolder(const QString& dirPath, const QVector<Device>& receivers)
+{
+    DirWalker* walker = new DirWalker(dirPath, this);
+    for (const Device& receiver : receivers) {
+        FolderSender* sender = new FolderSender(receiver, dirPath, walker);
+        sender->moveToThread(TransferEngine::instance()->peerThread(TransferEngine::peerKey(receiver)));
+        QMetaObject::invokeMethod(sender, [sender]() { sender->start(); }, Qt::QueuedConnection);
+        insertSender(sender);
+    }
+
+    connect(walker, &DirWalker::filesFound, this, [this, receivers](const QVector<DirWalker::Entry>& files) {
+        for (const DirWalker::Entry& file : files) {
+            if (file.size < FolderSender::MaxFileSize)
+                continue;
+
+            for (const Device& receiver : receivers)
+                sendFile(file.folder, file.filePath, file.size, receiver);
+        }
+    });
+
+    walker->start();
+}
+
+void MainWindow::insertSender(Transfer* sender)
 {
-    Sender* sender = new Sender(receiver, folderName, filePath, this);
-    sender->start();
     mSenderModel->insertTransfer(sender);
     QModelIndex progressIdx = mSenderModel->index(0, (int)TransferTableModel::Column::Progress);
 
@@ -174,26 +233,35 @@ void MainWindow::sendFile(const QString& folderName, const QString &filePath, co
     ui->senderTableView->scrollToTop();
 }
 
-void MainWindow::selectReceiversAndSendTheFiles(QVector<QPair<QString, QString> > dirNameAndFullPath)
+QVector<Device> MainWindow::selectReceivers()
 {
+    QVector<Device> receivers;
     ReceiverSelectorDialog dialog(mDeviceModel);
     if (dialog.exec() == QDialog::Accepted) {
-        QVector<Device> receivers = dialog.getSelectedDevices();
-        for (const Device& receiver : receivers) {
-            if (receiver.isValid()) {
-
-                /*
-                 * Memastikan bahwa device/kompuer ini terdaftar di penerima
-                 * Just to make sure.
-                 */
-                mBroadcaster->sendBroadcast();
-                for (const auto& p : dirNameAndFullPath) {
-                    sendFile(p.first, p.second, receiver);
-                }
-
-            }
+        for (const Device& receiver : dialog.getSelectedDevices()) {
+            if (receiver.isValid())
+                receivers.push_back(receiver);
         }
     }
+
+    /*
+     * Memastikan bahwa device/kompuer ini terdaftar di penerima
+     * Just to make sure.
+     */
+    if (!receivers.isEmpty())
+        mBroadcaster->sendBroadcast();
+
+    return receivers;
+}
+
+void MainWindow::selectReceiversAndSendTheFiles(QVector<QPair<QString, QString> > dirNameAndFullPath)
+{
+    const QVector<Device> receivers = selectReceivers();
+    for (const auto& p : dirNameAndFullPath) {
+        qint64 size = QFileInfo(p.second).size();
+        for (const Device& receiver : receivers)
+            sendFile(p.first, p.second, size, receiver);
+    }
 }
 
 void MainWindow::onShowMainWindowTriggered()
@@ -236,26 +304,23 @@ void MainWindow::onSendFolderActionTriggered()
         return;
     }
 
+    const QVector<Device> receivers = selectReceivers();
+    if (receivers.isEmpty())
+        return;
+
     /*
-     * Iterate through all selected folders
+     * Iterate through all selected folders, each one is a job
      */
-    QVector< QPair<QString, QString> > pairs;
     dirs = fDialog.selectedFiles();
-    for (const auto& dirName : dirs) {
-
-        QDir dir(dirName);
-        QVector< QPair<QString, QString> > ps =
-                Util::getInnerDirNameAndFullFilePath(dir, dir.dirName());
-        pairs.append(ps);
-    }
-
-    selectReceiversAndSendTheFiles(pairs);
+    for (const auto& dirName : dirs)
+        sendFolder(dirName, receivers);
 }
 
 void MainWindow::onSettingsActionTriggered()
 {
     SettingsDialog dialog;
-    dialog.exec();
+    if (dialog.exec() == QDialog::Accepted)
+        TransferQueue::instance()->applySettings();
 }
 
 void MainWindow::onAboutActionTriggered()
@@ -264,7 +329,7 @@ void MainWindow::onAboutActionTriggered()
     dialog.exec();
 }
 
-void MainWindow::onNewReceiverAdded(Receiver *rec)
+void MainWindow::onNewReceiverAdded(Transfer *rec)
 {
     QProgressBar* progress = new QProgressBar();
     connect(rec->getTransferInfo(), &TransferInfo::progressChanged, progress, &QProgressBar::setValue);
@@ -318,7 +383,7 @@ void MainWindow::onSenderCancelClicked()
     QModelIndex currIndex = ui->senderTableView->currentIndex();
     if (currIndex.isValid()) {
         Transfer* sender = mSenderModel->getTransfer(currIndex.row());
-        sender->cancel();
+        QMetaObject::invokeMethod(sender, &Transfer::cancel);
     }
 }
 
@@ -327,7 +392,7 @@ void MainWindow::onSenderPauseClicked()
     QModelIndex currIndex = ui->senderTableView->currentIndex();
     if (currIndex.isValid()) {
         Transfer* sender = mSenderModel->getTransfer(currIndex.row());
-        sender->pause();
+        QMetaObject::invokeMethod(sender, &Transfer::pause);
     }
 }
 
@@ -336,7 +401,7 @@ void MainWindow::onSenderResumeClicked()
     QModelIndex currIndex = ui->senderTableView->currentIndex();
     if (currIndex.isValid()) {
         Transfer* sender = mSenderModel->getTransfer(currIndex.row());
-        sender->resume();
+        QMetaObject::invokeMethod(sender, &Transfer::resume);
     }
 }
 
@@ -387,7 +452,7 @@ void MainWindow::onReceiverCancelClicked()
     QModelIndex currIndex = ui->receiverTableView->currentIndex();
     if (currIndex.isValid()) {
         Transfer* rec = mReceiverModel->getTransfer(currIndex.row());
-        rec->cancel();
+        QMetaObject::invokeMethod(rec, &Transfer::cancel);
     }
 }
 
@@ -396,7 +461,7 @@ void MainWindow::onReceiverPauseClicked()
     QModelIndex currIndex = ui->receiverTableView->currentIndex();
     if (currIndex.isValid()) {
         Transfer* rec = mReceiverModel->getTransfer(currIndex.row());
-        rec->pause();
+        QMetaObject::invokeMethod(rec, &Transfer::pause);
     }
 }
 
@@ -405,7 +470,7 @@ void MainWindow::onReceiverResumeClicked()
     QModelIndex currIndex = ui->receiverTableView->currentIndex();
     if (currIndex.isValid()) {
         Transfer* rec = mReceiverModel->getTransfer(currIndex.row());
-        rec->resume();
+        QMetaObject::invokeMethod(rec, &Transfer::resume);
     }
 }
 
@@ -427,6 +492,11 @@ void MainWindow::onSenderTableContextMenuRequested(const QPoint& pos)
         mSenderResumeAction->setEnabled(ti->canResume());
         mSenderCancelAction->setEnabled(ti->canCancel());
 
+        bool queued = state == TransferState::Queued &&
+                      mQueueIds.contains(mSenderModel->getTransfer(currIndex.row()));
+        mSenderRaisePriorityAction->setEnabled(queued);
+        mSenderLowerPriorityAction->setEnabled(queued);
+
         contextMenu.addAction(mSenderOpenAction);
         contextMenu.addAction(mSenderOpenFolderAction);
         contextMenu.addSeparator();
@@ -439,6 +509,9 @@ void MainWindow::onSenderTableContextMenuRequested(const QPoint& pos)
         contextMenu.addAction(mSenderPauseAction);
         contextMenu.addAction(mSenderResumeAction);
         contextMenu.addAction(mSenderCancelAction);
+        contextMenu.addSeparator();
+        contextMenu.addAction(mSenderRaisePriorityAction);
+        contextMenu.addAction(mSenderLowerPriorityAction);
     }
     else {
         contextMenu.addAction(mSendFilesAction);
@@ -515,6 +588,33 @@ void MainWindow::removeSenderItemInCurrentIndex()
     mSenderModel->removeTransfer(currIndex.row());
 }
 
+void MainWindow::raiseSenderPriorityInCurrentIndex()
+{
+    changeSenderPriority(1);
+}
+
+void MainWindow::lowerSenderPriorityInCurrentIndex()
+{
+    changeSenderPriority(-1);
+}
+
+/*
+ * Only moves the file within the queue of its receiver
+ */
+void MainWindow::changeSenderPriority(int delta)
+{
+    QModelIndex currIndex = ui->senderTableView->currentIndex();
+    if (!currIndex.isValid())
+        return;
+
+    auto queueId = mQueueIds.constFind(mSenderModel->getTransfer(currIndex.row()));
+    if (queueId == mQueueIds.constEnd())
+        return;
+
+    TransferQueue* queue = TransferQueue::instance();
+    queue->setPriority(queueId.value(), queue->priority(queueId.value()) + delta);
+}
+
 void MainWindow::openReceiverFileInCurrentIndex()
 {
     QModelIndex currIndex = ui->receiverTableView->currentIndex();
@@ -558,7 +658,7 @@ void MainWindow::onSelectedSenderStateChanged(TransferState state)
     ui->resumeSenderBtn->setEnabled(state == TransferState::Paused);
     ui->pauseSenderBtn->setEnabled(state == TransferState::Transfering || state == TransferState::Waiting);
     ui->cancelSenderBtn->setEnabled(state == TransferState::Transfering || state == TransferState::Waiting ||
-                                    state == TransferState::Paused);
+                                    state == TransferState::Paused || state == TransferState::Queued);
 }
 
 void MainWindow::onSelectedReceiverStateChanged(TransferState state)
@@ -642,6 +742,10 @@ void MainWindow::setupActions()
     connect(mSenderResumeAction, &QAction::triggered, this, &MainWindow::onSenderResumeClicked);
     mSenderCancelAction = new QAction(QIcon(":/img/cancel.png"), tr("Cancel"), this);
     connect(mSenderCancelAction, &QAction::triggered, this, &MainWindow::onSenderCancelClicked);
+    mSenderRaisePriorityAction = new QAction(tr("Increase priority"), this);
+    connect(mSenderRaisePriorityAction, &QAction::triggered, this, &MainWindow::raiseSenderPriorityInCurrentIndex);
+    mSenderLowerPriorityAction = new QAction(tr("Decrease priority"), this);
+    connect(mSenderLowerPriorityAction, &QAction::triggered, this, &MainWindow::lowerSenderPriorityInCurrentIndex);
 
     mRecOpenAction = new QAction(tr("Open"), this);
     connect(mRecOpenAction, &QAction::triggered, this, &MainWindow::openReceiverFileInCurrentIndex);
@@ -19,6 +19,7 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include <QHash>
 #include <QMainWindow>
 #include <QSystemTrayIcon>
 
@@ -52,7 +53,7 @@ private Q_SLOTS:
     void onSettingsActionTriggered();
     void onAboutActionTriggered();
 
-    void onNewReceiverAdded(Receiver* rec);
+    void onNewReceiverAdded(Transfer* rec);
 
     void onSenderTableDoubleClicked(const QModelIndex& index);
     void onSenderClearClicked();
@@ -77,6 +78,8 @@ private Q_SLOTS:
     void openSenderFileInCurrentIndex();
     void openSenderFolderInCurrentIndex();
     void removeSenderItemInCurrentIndex();
+    void raiseSenderPriorityInCurrentIndex();
+    void lowerSenderPriorityInCurrentIndex();
 
     void openReceiverFileInCurrentIndex();
     void openReceiverFolderInCurrentIndex();
@@ -93,8 +96,12 @@ private:
     void setupToolbar();
     void setupSystrayIcon();
     void connectSignals();
-    void sendFile(const QString& folderName, const QString& fileName, const Device& receiver);
+    void sendFile(const QString& folderName, const QString& fileName, qint64 size, const Device& receiver);
+    void sendFolder(const QString& dirPath, const QVector<Device>& receivers);
+    void insertSender(Transfer* sender);
+    void changeSenderPriority(int delta);
     void selectReceiversAndSendTheFiles(QVector<QPair<QString, QString> > dirNameAndFullPath);
+    QVector<Device> selectReceivers();
 
     bool anyActiveSender();
     bool anyActiveReceiver();
@@ -111,6 +118,12 @@ private:
     DeviceBroadcaster* mBroadcaster;
     TransferServer* mTransServer;
 
+    /*
+     * Queue ids of the Senders in the sender table, for
+     * TransferQueue::setPriority()
+     */
+    QHash<Transfer*, quint64> mQueueIds;
+
     QAction* mShowMainWindowAction;
     QAction* mSendFilesAction;
     QAction* mSendFolderAction;
@@ -126,6 +139,8 @@ private:
     QAction* mSenderPauseAction;
     QAction* mSenderResumeAction;
     QAction* mSenderCancelAction;
+    QAction* mSenderRaisePriorityAction;
+    QAction* mSenderLowerPriorityAction;
 
     QAction* mRecOpenAction;
     QAction* mRecOpenFolderAction;
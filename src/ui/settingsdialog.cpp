@@ -52,10 +52,18 @@ void SettingsDialog::onSaveClicked()
     set->setBroadcastPort(ui->bcPortSpinBox->value());
     set->setTransferPort(ui->transferPortSpinBox->value());
     set->setFileBufferSize(ui->buffSizeSpinBox->value() * 1024);
+    set->setStripeCount(ui->stripeCountSpinBox->value());
+    set->setReadAheadSize(ui->readAheadSpinBox->value() * 1024 * 1024);
+    set->setWorkerThreadCount(ui->workerCountSpinBox->value());
+    set->setMaxActiveTransfers(ui->maxTransfersSpinBox->value());
+    set->setMaxPeerTransfers(ui->maxPeerTransfersSpinBox->value());
+    set->setQueuePolicy(ui->queuePolicyComboBox->currentIndex());
     set->setDeviceName(ui->deviceNameLineEdit->text());
     set->setDownloadDir(ui->downDirlineEdit->text());
     set->setBroadcastInterval(ui->bcIntervalSpinBox->value());
     set->setReplaceExistingFile(ui->overwriteCheckBox->isChecked());
+    set->setDeltaTransfer(ui->deltaCheckBox->isChecked());
+    set->setCompression(ui->compressionCheckBox->isChecked());
 
     set->saveSettings();
 
@@ -91,6 +99,14 @@ void SettingsDialog::assign()
     ui->bcPortSpinBox->setValue(sets->getBroadcastPort());
     ui->transferPortSpinBox->setValue(sets->getTransferPort());
     ui->buffSizeSpinBox->setValue(sets->getFileBufferSize() / 1024);
+    ui->stripeCountSpinBox->setValue(sets->getStripeCount());
+    ui->readAheadSpinBox->setValue(sets->getReadAheadSize() / (1024 * 1024));
+    ui->workerCountSpinBox->setValue(sets->getWorkerThreadCount());
+    ui->maxTransfersSpinBox->setValue(sets->getMaxActiveTransfers());
+    ui->maxPeerTransfersSpinBox->setValue(sets->getMaxPeerTransfers());
+    ui->queuePolicyComboBox->setCurrentIndex(sets->getQueuePolicy());
     ui->bcIntervalSpinBox->setValue(sets->getBroadcastInterval());
     ui->overwriteCheckBox->setChecked(sets->getReplaceExistingFile());
+    ui->deltaCheckBox->setChecked(sets->getDeltaTransfer());
+    ui->compressionCheckBox->setChecked(sets->getCompression());
 }
@@ -42,32 +42,6 @@ QString Util::sizeToString(qint64 size)
     return QString::number(f_size, 'f', 2).append(suffix);
 }
 
-QVector< QPair<QString, QString> >
-    Util::getInnerDirNameAndFullFilePath(const QDir& startingDir, const QString& innerDirName)
-{
-    QVector< QPair<QString, QString> > pairs;
-
-    QFileInfoList fiList = startingDir.entryInfoList(QDir::NoDotAndDotDot | QDir::Files);
-    for (const auto& fi : fiList)
-        pairs.push_back( QPair<QString, QString>(innerDirName, fi.filePath()) );
-
-    fiList = startingDir.entryInfoList(QDir::NoDotAndDotDot | QDir::Dirs);
-    for (const auto& fi : fiList) {
-        QString newInnerDirName;
-        if (innerDirName.isEmpty())
-            newInnerDirName = fi.fileName();
-        else
-            newInnerDirName = innerDirName + QDir::separator() + fi.fileName();
-
-        QVector< QPair<QString, QString> > otherPairs =
-                getInnerDirNameAndFullFilePath( QDir(fi.filePath()), newInnerDirName );
-
-        pairs.append(otherPairs);
-    }
-
-    return pairs;
-}
-
 QString Util::parseAppVersion(bool onlyVerNum)
 {
     if (onlyVerNum) {
@@ -102,3 +76,13 @@ QString Util::getUniqueFileName(const QString& fileName, const QString& folderPa
 
     return fPath;
 }
+
+bool Util::isSafePath(const QString& folderName, const QString& fileName)
+{
+    if (fileName.isEmpty() || fileName == "." || fileName == ".." ||
+            fileName.contains('/') || fileName.contains('\\'))
+        return false;
+
+    QString folder = QDir::fromNativeSeparators(folderName);
+    return !QDir::isAbsolutePath(folder) && !folder.split('/').contains("..");
+}
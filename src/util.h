@@ -29,18 +29,15 @@ class Util
 public:
     static QString sizeToString(qint64 size);
 
-    /*
-     *  relative dir name
-     *          |        +------> full path to file inside relative dir name
-     *          |        |
-     * QPair<QString, QString>
-     */
-    static QVector< QPair<QString, QString> >
-        getInnerDirNameAndFullFilePath(const QDir& startingDir, const QString& innerDirName);
-
     static QString parseAppVersion(bool onlyVerNum = true);
 
     static QString getUniqueFileName(const QString& fileName, const QString& folderPath);
+
+    /*
+     * A file name and a relative folder that come from a peer,
+     * false if they would leave the download folder.
+     */
+    static bool isSafePath(const QString& folderName, const QString& fileName);
 };
 
 #endif // UTIL_H
@@ -0,0 +1,9 @@
+include(../tests.pri)
+
+TARGET = tst_delta
+TEMPLATE = app
+
+SOURCES += tst_delta.cpp \
+    $$SRC_DIR/transfer/delta.cpp
+
+HEADERS += $$SRC_DIR/transfer/delta.h
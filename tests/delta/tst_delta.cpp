@@ -0,0 +1,210 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest>
+#include <QBuffer>
+#include <QtEndian>
+
+#include "delta.h"
+
+/*
+ * Same bytes for the same seed, so basis and new file share content
+ */
+static QByteArray randomData(int size, quint32 seed)
+{
+    QByteArray data(size, Qt::Uninitialized);
+    for (int i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = static_cast<char>(seed >> 16);
+    }
+
+    return data;
+}
+
+static QByteArray signatureOf(const QByteArray& basis, int blockSize)
+{
+    QBuffer file;
+    file.setData(basis);
+    file.open(QIODevice::ReadOnly);
+    return DeltaSignature::build(&file, blockSize);
+}
+
+/*
+ * Rebuild the new file from the ops the way the receiver does,
+ * false on a malformed op or one that reads past the basis.
+ */
+static bool apply(const QByteArray& ops, const QByteArray& basis, int blockSize,
+                  QByteArray& target, qint64& literalBytes)
+{
+    DeltaReader reader(ops);
+    DeltaReader::Op op;
+    while (reader.next(op)) {
+        if (!op.copy) {
+            target.append(op.data, op.size);
+            literalBytes += op.size;
+            continue;
+        }
+
+        qint64 offset = static_cast<qint64>(op.first) * blockSize;
+        qint64 length = static_cast<qint64>(op.count) * blockSize;
+        if (offset + length > basis.size())
+            return false;
+
+        target.append(basis.constData() + offset, static_cast<int>(length));
+    }
+
+    return reader.atEnd();
+}
+
+class TestDelta : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void encodeApply_data();
+    void encodeApply();
+    void signature();
+    void readerRejectsMalformedOps_data();
+    void readerRejectsMalformedOps();
+};
+
+void TestDelta::encodeApply_data()
+{
+    QTest::addColumn<QByteArray>("basis");
+    QTest::addColumn<QByteArray>("file");
+    QTest::addColumn<qint64>("maxLiteralBytes");
+
+    const int size = 1024 * 1024;
+    QByteArray basis = randomData(size, 1);
+    int blockSize = DeltaSignature::blockSizeFor(size);
+
+    QByteArray inserted = basis;
+    inserted.insert(size / 2, randomData(1000, 2));
+
+    QByteArray removed = basis;
+    removed.remove(size / 3, 5000);
+
+    QByteArray changed = basis;
+    changed.replace(size / 4, 100, randomData(100, 3));
+
+    /*
+     * At most the changed bytes and the blocks they touch are sent
+     */
+    QTest::newRow("same") << basis << basis << qint64(0);
+    QTest::newRow("insert") << basis << inserted << qint64(1000 + 2 * blockSize);
+    QTest::newRow("remove") << basis << removed << qint64(2 * blockSize);
+    QTest::newRow("change") << basis << changed << qint64(2 * blockSize);
+    QTest::newRow("append") << basis << basis + randomData(3000, 4) << qint64(3000);
+    QTest::newRow("unrelated") << basis << randomData(size, 5) << qint64(size);
+    QTest::newRow("shorter than a block") << basis << randomData(100, 6) << qint64(100);
+    QTest::newRow("empty") << basis << QByteArray() << qint64(0);
+    QTest::newRow("empty basis") << QByteArray() << basis << qint64(size);
+}
+
+void TestDelta::encodeApply()
+{
+    QFETCH(QByteArray, basis);
+    QFETCH(QByteArray, file);
+    QFETCH(qint64, maxLiteralBytes);
+
+    int blockSize = DeltaSignature::blockSizeFor(basis.size());
+    DeltaSignature signature;
+    QVERIFY(signature.parse(signatureOf(basis, blockSize)));
+
+    QBuffer source;
+    source.setData(file);
+    QVERIFY(source.open(QIODevice::ReadOnly));
+
+    /*
+     * Small slices, so ops and matches span several next() calls
+     */
+    DeltaEncoder encoder(&source, signature);
+    QByteArray target;
+    qint64 consumed = 0;
+    qint64 literalBytes = 0;
+    while (!encoder.atEnd()) {
+        qint64 sliceConsumed;
+        QByteArray ops = encoder.next(64 * 1024, sliceConsumed);
+        QVERIFY(!encoder.hasError());
+        QVERIFY(apply(ops, basis, blockSize, target, literalBytes));
+        consumed += sliceConsumed;
+    }
+
+    QCOMPARE(consumed, static_cast<qint64>(file.size()));
+    QCOMPARE(target, file);
+    QVERIFY(literalBytes <= maxLiteralBytes);
+}
+
+void TestDelta::signature()
+{
+    QByteArray basis = randomData(10000, 7);
+    int blockSize = 2048;
+    QByteArray data = signatureOf(basis, blockSize);
+
+    /*
+     * The partial last block isn't listed
+     */
+    DeltaSignature signature;
+    QVERIFY(signature.parse(data));
+    QCOMPARE(signature.blockSize(), blockSize);
+    QCOMPARE(signature.blockCount(), 10000 / blockSize);
+    QCOMPARE(data.size(), static_cast<int>(sizeof(qint32)) + signature.blockCount() * DeltaSignature::EntrySize);
+
+    RollingChecksum weak;
+    weak.reset(basis.constData() + 2 * blockSize, blockSize);
+    QCOMPARE(signature.findBlock(weak.value(), basis.constData() + 2 * blockSize), 2);
+
+    QVERIFY(!signature.parse(data.left(data.size() - 1)));
+    QVERIFY(!signature.parse(QByteArray()));
+}
+
+void TestDelta::readerRejectsMalformedOps_data()
+{
+    QTest::addColumn<QByteArray>("ops");
+
+    auto op = [](char type, qint32 a, qint32 b) {
+        QByteArray data(1 + 2 * sizeof(qint32), Qt::Uninitialized);
+        data[0] = type;
+        qToLittleEndian<qint32>(a, data.data() + 1);
+        qToLittleEndian<qint32>(b, data.data() + 1 + sizeof(qint32));
+        return data;
+    };
+
+    QTest::newRow("unknown op") << QByteArray("X");
+    QTest::newRow("truncated copy") << op('C', 0, 1).left(6);
+    QTest::newRow("negative block") << op('C', -1, 1);
+    QTest::newRow("no block") << op('C', 0, 0);
+    QTest::newRow("truncated literal") << op('L', 10, 0);
+    QTest::newRow("negative literal") << op('L', -1, 0);
+}
+
+void TestDelta::readerRejectsMalformedOps()
+{
+    QFETCH(QByteArray, ops);
+
+    DeltaReader reader(ops);
+    DeltaReader::Op op;
+    while (reader.next(op)) {
+    }
+
+    QVERIFY(!reader.atEnd());
+}
+
+QTEST_APPLESS_MAIN(TestDelta)
+
+#include "tst_delta.moc"
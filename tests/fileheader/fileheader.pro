@@ -0,0 +1,9 @@
+include(../tests.pri)
+
+TARGET = tst_fileheader
+TEMPLATE = app
+
+SOURCES += tst_fileheader.cpp \
+    $$SRC_DIR/transfer/fileheader.cpp
+
+HEADERS += $$SRC_DIR/transfer/fileheader.h
@@ -0,0 +1,153 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest>
+
+#include "fileheader.h"
+
+Q_DECLARE_METATYPE(FileHeader)
+
+static FileHeader fileHeader(const QString& name, const QString& folder, qint64 size)
+{
+    FileHeader header;
+    header.name = name;
+    header.folder = folder;
+    header.size = size;
+    return header;
+}
+
+static void compareHeaders(const FileHeader& actual, const FileHeader& expected)
+{
+    QCOMPARE(actual.name, expected.name);
+    QCOMPARE(actual.folder, expected.folder);
+    QCOMPARE(actual.size, expected.size);
+    QCOMPARE(actual.mtime, expected.mtime);
+    QCOMPARE(actual.hash, expected.hash);
+    QCOMPARE(actual.flags, expected.flags);
+    QCOMPARE(actual.token, expected.token);
+    QCOMPARE(actual.join, expected.join);
+    QCOMPARE(actual.stripe, expected.stripe);
+    QCOMPARE(actual.payload, expected.payload);
+}
+
+class TestFileHeader : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void roundTrip_data();
+    void binaryRoundTrip();
+    void jsonRoundTrip();
+    void rejectsTruncatedBinary();
+    void rejectsBadInlinePayload();
+    void rejectsGarbage();
+};
+
+/*
+ * Only fields the JSON format carries for the kind of header are set,
+ * so both formats must give them back unchanged.
+ */
+void TestFileHeader::roundTrip_data()
+{
+    QTest::addColumn<FileHeader>("header");
+
+    QTest::newRow("plain") << fileHeader("report.pdf", QString(), 123456);
+    QTest::newRow("in folder") << fileHeader("a.txt", "photos/2016", 0);
+    QTest::newRow("unicode") << fileHeader(QString::fromUtf8("\xc3\xa9t\xc3\xa9.txt"),
+                                           QString::fromUtf8("\xe6\x96\x87\xe4\xbb\xb6"), 42);
+
+    FileHeader negotiated = fileHeader("big.iso", QString(), Q_INT64_C(5) * 1024 * 1024 * 1024);
+    negotiated.token = "{6f1c0cfa-8b0d-4b57-9c4a-1d0c2a3b4c5d}";
+    negotiated.mtime = Q_INT64_C(1476950400000);
+    negotiated.hash = Q_UINT64_C(0xfedcba9876543210);
+    negotiated.flags = FileHeader::Delta | FileHeader::Verify | FileHeader::Chunks |
+                       FileHeader::Compress | FileHeader::HasHash;
+    QTest::newRow("negotiated") << negotiated;
+
+    FileHeader stripe;
+    stripe.join = negotiated.token;
+    stripe.stripe = 3;
+    QTest::newRow("stripe") << stripe;
+
+    FileHeader folder = fileHeader("photos", QString(), 987654321);
+    folder.flags = FileHeader::Folder;
+    QTest::newRow("folder") << folder;
+
+    FileHeader inlined = fileHeader("small.bin", "docs", 5);
+    inlined.flags = FileHeader::Inline;
+    inlined.payload = QByteArray("\x00\x01\x02\xfe\xff", 5);
+    QTest::newRow("inline") << inlined;
+
+    FileHeader empty = fileHeader("empty", QString(), 0);
+    empty.flags = FileHeader::Inline;
+    QTest::newRow("inline empty") << empty;
+}
+
+void TestFileHeader::binaryRoundTrip()
+{
+    QFETCH(FileHeader, header);
+
+    FileHeader parsed;
+    QVERIFY(FileHeader::parse(header.toBinary(), parsed));
+    compareHeaders(parsed, header);
+}
+
+void TestFileHeader::jsonRoundTrip()
+{
+    QFETCH(FileHeader, header);
+
+    FileHeader parsed;
+    QVERIFY(FileHeader::parse(header.toJson(), parsed));
+    compareHeaders(parsed, header);
+}
+
+void TestFileHeader::rejectsTruncatedBinary()
+{
+    FileHeader header = fileHeader("report.pdf", "docs", 1000);
+    header.token = "token";
+    QByteArray data = header.toBinary();
+
+    FileHeader parsed;
+    for (int size = 0; size < data.size(); size++)
+        QVERIFY2(!FileHeader::parse(data.left(size), parsed), qPrintable(QString::number(size)));
+}
+
+void TestFileHeader::rejectsBadInlinePayload()
+{
+    FileHeader header = fileHeader("small.bin", QString(), 5);
+    header.flags = FileHeader::Inline;
+    header.payload = "12345";
+
+    FileHeader parsed;
+    QVERIFY(!FileHeader::parse(header.toBinary().left(header.toBinary().size() - 1), parsed));
+
+    header.payload = "1234";
+    QVERIFY(!FileHeader::parse(header.toJson(), parsed));
+}
+
+void TestFileHeader::rejectsGarbage()
+{
+    FileHeader parsed;
+    QVERIFY(!FileHeader::parse(QByteArray(), parsed));
+    QVERIFY(!FileHeader::parse("not a header", parsed));
+    QVERIFY(!FileHeader::parse("{\"name\":\"a\",\"size\":-1}", parsed));
+}
+
+QTEST_APPLESS_MAIN(TestFileHeader)
+
+#include "tst_fileheader.moc"
@@ -0,0 +1,11 @@
+include(../tests.pri)
+
+TARGET = tst_manifest
+TEMPLATE = app
+
+SOURCES += tst_manifest.cpp \
+    $$SRC_DIR/transfer/fileheader.cpp \
+    $$SRC_DIR/transfer/manifest.cpp
+
+HEADERS += $$SRC_DIR/transfer/fileheader.h \
+    $$SRC_DIR/transfer/manifest.h
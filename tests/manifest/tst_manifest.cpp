@@ -0,0 +1,123 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest>
+#include <QtEndian>
+
+#include "manifest.h"
+
+static QVector<Manifest::Entry> sampleEntries()
+{
+    return {
+        { QString(), "readme.txt", 1200 },
+        { "photos/2016", "IMG_0001.JPG", Q_INT64_C(4) * 1024 * 1024 * 1024 },
+        { "photos/2016", "empty", 0 },
+        { QString::fromUtf8("\xe6\x96\x87\xe4\xbb\xb6"), QString::fromUtf8("\xc3\xa9t\xc3\xa9.txt"), 7 }
+    };
+}
+
+static bool sameEntries(const QVector<Manifest::Entry>& a, const QVector<Manifest::Entry>& b)
+{
+    if (a.size() != b.size())
+        return false;
+
+    for (int i = 0; i < a.size(); i++) {
+        if (a.at(i).folder != b.at(i).folder || a.at(i).name != b.at(i).name || a.at(i).size != b.at(i).size)
+            return false;
+    }
+
+    return true;
+}
+
+class TestManifest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void roundTrip();
+    void encodesRange();
+    void decodeAppends();
+    void emptyBatch();
+    void rejectsTruncated();
+    void rejectsNegativeSize();
+};
+
+void TestManifest::roundTrip()
+{
+    QVector<Manifest::Entry> entries = sampleEntries();
+
+    QVector<Manifest::Entry> decoded;
+    QVERIFY(Manifest::decode(Manifest::encode(entries, 0, entries.size()), decoded));
+    QVERIFY(sameEntries(decoded, entries));
+}
+
+void TestManifest::encodesRange()
+{
+    QVector<Manifest::Entry> entries = sampleEntries();
+
+    QVector<Manifest::Entry> decoded;
+    QVERIFY(Manifest::decode(Manifest::encode(entries, 1, 2), decoded));
+    QVERIFY(sameEntries(decoded, entries.mid(1, 2)));
+}
+
+void TestManifest::decodeAppends()
+{
+    QVector<Manifest::Entry> entries = sampleEntries();
+
+    QVector<Manifest::Entry> decoded;
+    QVERIFY(Manifest::decode(Manifest::encode(entries, 0, 2), decoded));
+    QVERIFY(Manifest::decode(Manifest::encode(entries, 2, entries.size() - 2), decoded));
+    QVERIFY(sameEntries(decoded, entries));
+}
+
+void TestManifest::emptyBatch()
+{
+    QVector<Manifest::Entry> decoded;
+    QVERIFY(Manifest::encode(sampleEntries(), 0, 0).isEmpty());
+    QVERIFY(Manifest::decode(QByteArray(), decoded));
+    QVERIFY(decoded.isEmpty());
+}
+
+void TestManifest::rejectsTruncated()
+{
+    QVector<Manifest::Entry> entries = sampleEntries();
+    QByteArray data = Manifest::encode(entries, 0, entries.size());
+
+    /*
+     * Cut inside the last entry, the ones before it are complete
+     */
+    int lastEntry = Manifest::encode(entries, 0, entries.size() - 1).size();
+    for (int size = lastEntry + 1; size < data.size(); size++) {
+        QVector<Manifest::Entry> decoded;
+        QVERIFY2(!Manifest::decode(data.left(size), decoded), qPrintable(QString::number(size)));
+    }
+}
+
+void TestManifest::rejectsNegativeSize()
+{
+    QVector<Manifest::Entry> entries = { { QString(), "a", 1 } };
+    QByteArray data = Manifest::encode(entries, 0, 1);
+    qToLittleEndian<qint64>(-1, data.data());
+
+    QVector<Manifest::Entry> decoded;
+    QVERIFY(!Manifest::decode(data, decoded));
+}
+
+QTEST_APPLESS_MAIN(TestManifest)
+
+#include "tst_manifest.moc"
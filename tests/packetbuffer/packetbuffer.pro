@@ -0,0 +1,9 @@
+include(../tests.pri)
+
+TARGET = tst_packetbuffer
+TEMPLATE = app
+
+SOURCES += tst_packetbuffer.cpp \
+    $$SRC_DIR/transfer/packetbuffer.cpp
+
+HEADERS += $$SRC_DIR/transfer/packetbuffer.h
@@ -0,0 +1,277 @@
+/*
+    LANShare - LAN file transfer.
+    Copyright (C) 2016 Abdul Aris R. <abdularisrahmanudin10@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest>
+#include <QtEndian>
+
+#include "packetbuffer.h"
+
+/*
+ * Packets are framed as Session frames them:
+ * size (4 bytes) | type (1 byte) | stream id (4 bytes) | payload
+ */
+static constexpr int HeaderSize = 9;
+
+/*
+ * Bytes handed over per socket read, as Session::onReadyRead()
+ */
+static constexpr int ReadSize = 256 * 1024;
+
+static QByteArray frame(const QByteArray& payload, char type = 1, quint32 streamId = 1)
+{
+    QByteArray packet(HeaderSize, Qt::Uninitialized);
+    qToLittleEndian<qint32>(payload.size(), packet.data());
+    packet[4] = type;
+    qToLittleEndian<quint32>(streamId, packet.data() + 5);
+    packet.append(payload);
+    return packet;
+}
+
+static QByteArray payload(int size, int seed)
+{
+    QByteArray data(size, Qt::Uninitialized);
+    for (int i = 0; i < size; i++)
+        data[i] = static_cast<char>((i + seed) * 31);
+
+    return data;
+}
+
+/*
+ * Complete packets in 'buff' are consumed, their payloads
+ * appended to 'packets' (or only counted when it is null).
+ */
+static int parse(PacketBuffer& buff, QVector<QByteArray>* packets)
+{
+    int count = 0;
+    while (buff.size() >= HeaderSize) {
+        qint32 size = qFromLittleEndian<qint32>(buff.data());
+        if (buff.size() - HeaderSize < size)
+            break;
+
+        if (packets)
+            packets->push_back(QByteArray(buff.view(HeaderSize, size)));
+
+        buff.consume(HeaderSize + size);
+        count++;
+    }
+
+    return count;
+}
+
+/*
+ * Feed 'wire' to 'buff' 'readSize' bytes at a time
+ */
+static int feed(PacketBuffer& buff, const QByteArray& wire, int readSize, QVector<QByteArray>* packets)
+{
+    int count = 0;
+    for (int pos = 0; pos < wire.size(); pos += readSize) {
+        int len = qMin(readSize, wire.size() - pos);
+        char* dst = buff.reserve(len);
+        if (!dst)
+            return -1;
+
+        memcpy(dst, wire.constData() + pos, len);
+        buff.commit(len);
+        count += parse(buff, packets);
+    }
+
+    return count;
+}
+
+/*
+ * How packets were parsed before PacketBuffer: append every read,
+ * copy the payload out with mid() and remove() it from the front.
+ */
+static int feedByteArray(const QByteArray& wire, int readSize)
+{
+    QByteArray buff;
+    int count = 0;
+    for (int pos = 0; pos < wire.size(); pos += readSize) {
+        buff.append(wire.constData() + pos, qMin(readSize, wire.size() - pos));
+
+        while (buff.size() >= HeaderSize) {
+            qint32 size = qFromLittleEndian<qint32>(buff.constData());
+            if (buff.size() - HeaderSize < size)
+                break;
+
+            QByteArray data = buff.mid(HeaderSize, size);
+            buff.remove(0, HeaderSize + size);
+            count += !data.isNull();
+        }
+    }
+
+    return count;
+}
+
+class TestPacketBuffer : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void startsEmpty();
+    void framing_data();
+    void framing();
+    void keepsIncompletePacket();
+    void growsForLargePacket();
+    void rejectsPastMaxCapacity();
+    void clearFreesMemory();
+
+    void benchmarkParse_data();
+    void benchmarkParse();
+};
+
+void TestPacketBuffer::startsEmpty()
+{
+    PacketBuffer buff;
+    QVERIFY(buff.isEmpty());
+    QCOMPARE(buff.capacity(), 0);
+
+    QVERIFY(buff.reserve(1));
+    QCOMPARE(buff.capacity(), static_cast<int>(PacketBuffer::DefaultCapacity));
+}
+
+void TestPacketBuffer::framing_data()
+{
+    QTest::addColumn<int>("packetSize");
+    QTest::addColumn<int>("readSize");
+
+    QTest::newRow("empty packets") << 0 << 7;
+    QTest::newRow("byte by byte") << 100 << 1;
+    QTest::newRow("split headers") << 1000 << 5;
+    QTest::newRow("many per read") << 100 << ReadSize;
+    QTest::newRow("larger than capacity") << 1024 * 1024 << ReadSize;
+}
+
+void TestPacketBuffer::framing()
+{
+    QFETCH(int, packetSize);
+    QFETCH(int, readSize);
+
+    QVector<QByteArray> sent;
+    QByteArray wire;
+    for (int i = 0; i < 8; i++) {
+        sent.push_back(payload(packetSize, i));
+        wire.append(frame(sent.last()));
+    }
+
+    PacketBuffer buff(64 * 1024);
+    QVector<QByteArray> received;
+    QCOMPARE(feed(buff, wire, readSize, &received), sent.size());
+    QCOMPARE(received, sent);
+    QVERIFY(buff.isEmpty());
+}
+
+void TestPacketBuffer::keepsIncompletePacket()
+{
+    QByteArray first = payload(600, 1);
+    QByteArray second = payload(600, 2);
+    QByteArray wire = frame(first) + frame(second);
+
+    /*
+     * The second packet is cut short by the end of the buffer,
+     * its start has to be moved to the front to make room.
+     */
+    PacketBuffer buff(1024);
+    QVector<QByteArray> received;
+    QCOMPARE(feed(buff, wire.left(1000), 1000, &received), 1);
+    QCOMPARE(buff.size(), 1000 - HeaderSize - first.size());
+
+    QCOMPARE(feed(buff, wire.mid(1000), 1000, &received), 1);
+    QCOMPARE(received.size(), 2);
+    QCOMPARE(received.at(1), second);
+    QCOMPARE(buff.capacity(), 1024);
+}
+
+void TestPacketBuffer::growsForLargePacket()
+{
+    QByteArray data = payload(3 * PacketBuffer::DefaultCapacity, 3);
+
+    PacketBuffer buff;
+    QVector<QByteArray> received;
+    QCOMPARE(feed(buff, frame(data), ReadSize, &received), 1);
+    QCOMPARE(received.first(), data);
+    QVERIFY(buff.capacity() >= data.size() + HeaderSize);
+    QVERIFY(buff.capacity() <= PacketBuffer::MaxCapacity);
+}
+
+void TestPacketBuffer::rejectsPastMaxCapacity()
+{
+    PacketBuffer buff;
+    QVERIFY(buff.reserve(PacketBuffer::MaxCapacity));
+    buff.commit(PacketBuffer::MaxCapacity - 10);
+
+    QVERIFY(buff.reserve(10));
+    QVERIFY(!buff.reserve(11));
+    QCOMPARE(buff.capacity(), static_cast<int>(PacketBuffer::MaxCapacity));
+}
+
+void TestPacketBuffer::clearFreesMemory()
+{
+    PacketBuffer buff;
+    buff.reserve(PacketBuffer::DefaultCapacity * 2);
+    buff.commit(100);
+
+    buff.clear();
+    QVERIFY(buff.isEmpty());
+    QCOMPARE(buff.capacity(), 0);
+}
+
+void TestPacketBuffer::benchmarkParse_data()
+{
+    QTest::addColumn<int>("packetSize");
+    QTest::addColumn<bool>("packetBuffer");
+
+    for (int size : { 1024, 64 * 1024, 1024 * 1024 }) {
+        QByteArray name = QByteArray::number(size / 1024) + " KB packets, ";
+        QTest::newRow(name + "QByteArray") << size << false;
+        QTest::newRow(name + "PacketBuffer") << size << true;
+    }
+}
+
+/*
+ * 16 MB of packets of each size, read ReadSize bytes at a time
+ */
+void TestPacketBuffer::benchmarkParse()
+{
+    QFETCH(int, packetSize);
+    QFETCH(bool, packetBuffer);
+
+    QByteArray packet = frame(payload(packetSize, 0));
+    int count = 16 * 1024 * 1024 / packetSize;
+    QByteArray wire;
+    wire.reserve(count * packet.size());
+    for (int i = 0; i < count; i++)
+        wire.append(packet);
+
+    int parsed = 0;
+    QBENCHMARK {
+        if (packetBuffer) {
+            PacketBuffer buff;
+            parsed = feed(buff, wire, ReadSize, nullptr);
+        }
+        else {
+            parsed = feedByteArray(wire, ReadSize);
+        }
+    }
+
+    QCOMPARE(parsed, count);
+}
+
+QTEST_APPLESS_MAIN(TestPacketBuffer)
+
+#include "tst_packetbuffer.moc"
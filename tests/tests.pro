@@ -0,0 +1,6 @@
+TEMPLATE = subdirs
+
+SUBDIRS += delta \
+    fileheader \
+    manifest \
+    packetbuffer